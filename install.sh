@@ -43,21 +43,21 @@ install_deps() {
         run_sudo dnf install -y \
             gcc meson ninja-build pkgconf-pkg-config \
             libva-devel libdrm-devel libglvnd-devel \
-            gstreamer1-plugins-bad-free-devel nv-codec-headers
+            nv-codec-headers
     elif command -v apt-get >/dev/null 2>&1; then
         run_sudo apt-get update
         run_sudo apt-get install -y \
             build-essential meson ninja-build pkg-config \
             libva-dev libegl-dev libdrm-dev \
-            libgstreamer-plugins-bad1.0-dev libffmpeg-nvenc-dev vainfo
+            libffmpeg-nvenc-dev vainfo
     elif command -v pacman >/dev/null 2>&1; then
         run_sudo pacman -S --needed \
             base-devel meson ninja pkgconf libva libdrm \
-            gst-plugins-bad ffnvcodec-headers libglvnd libva-utils
+            ffnvcodec-headers libglvnd libva-utils
     elif command -v zypper >/dev/null 2>&1; then
         run_sudo zypper install -y \
             gcc meson ninja pkg-config libva-devel libdrm-devel \
-            Mesa-libEGL-devel gstreamer-plugins-bad-devel nv-codec-headers
+            Mesa-libEGL-devel nv-codec-headers
     else
         echo "No supported package manager found. Install the build dependencies manually." >&2
         exit 1
@@ -0,0 +1,399 @@
+#include "convert-cpu.h"
+
+#include <pthread.h>
+#include <stddef.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#if defined(__GNUC__)
+#define CONVERT_CPU_AVX2
+#endif
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+static uint8_t clampU8(int value) {
+    if (value < 0) {
+        return 0;
+    }
+    if (value > 255) {
+        return 255;
+    }
+    return (uint8_t) value;
+}
+
+static void storeRgbPixel(uint8_t *dst, uint32_t order, uint8_t r, uint8_t g, uint8_t b) {
+    switch (order) {
+    case 1:
+        dst[0] = r;
+        dst[1] = g;
+        dst[2] = b;
+        dst[3] = 255;
+        break;
+    case 2:
+        dst[0] = 255;
+        dst[1] = r;
+        dst[2] = g;
+        dst[3] = b;
+        break;
+    case 3:
+        dst[0] = 255;
+        dst[1] = b;
+        dst[2] = g;
+        dst[3] = r;
+        break;
+    default:
+        dst[0] = b;
+        dst[1] = g;
+        dst[2] = r;
+        dst[3] = 255;
+        break;
+    }
+}
+
+void nvConvertYuvRowToRgbScalar(const void *yRow, const void *uvRow, uint32_t x, uint32_t count, uint8_t *dst,
+                                uint32_t order, bool is16Bit, const ColorMatrix *matrix, const VideoProcSampleInfo *sampleInfo) {
+    for (uint32_t i = 0; i < count; i++, x++) {
+        const uint32_t uvIndex = x & ~1u;
+        int yy, u, v;
+        if (is16Bit) {
+            yy = ((const uint16_t*) yRow)[x] >> sampleInfo->sampleShift;
+            u = ((const uint16_t*) uvRow)[uvIndex] >> sampleInfo->sampleShift;
+            v = ((const uint16_t*) uvRow)[uvIndex + 1] >> sampleInfo->sampleShift;
+        } else {
+            yy = ((const uint8_t*) yRow)[x];
+            u = ((const uint8_t*) uvRow)[uvIndex];
+            v = ((const uint8_t*) uvRow)[uvIndex + 1];
+        }
+        const int c = yy > sampleInfo->yOffset ? yy - sampleInfo->yOffset : 0;
+        const int d = u - sampleInfo->uvOffset;
+        const int e = v - sampleInfo->uvOffset;
+        const uint8_t r = clampU8((sampleInfo->yScale * c + matrix->vToR * e + sampleInfo->rounding) >> sampleInfo->valueShift);
+        const uint8_t g = clampU8((sampleInfo->yScale * c - matrix->uToG * d - matrix->vToG * e + sampleInfo->rounding) >> sampleInfo->valueShift);
+        const uint8_t b = clampU8((sampleInfo->yScale * c + matrix->uToB * d + sampleInfo->rounding) >> sampleInfo->valueShift);
+        storeRgbPixel(dst + (size_t) i * 4, order, r, g, b);
+    }
+}
+
+#if defined(__SSE2__) || defined(__ARM_NEON)
+
+// The vector paths work on whole luma pairs, so an odd starting column is
+// converted on its own first. Returns false if nothing is left to do.
+static bool alignRowStart(const void *yRow, const void *uvRow, uint32_t *x, uint32_t *count, uint8_t **dst,
+                          uint32_t order, bool is16Bit, const ColorMatrix *matrix, const VideoProcSampleInfo *sampleInfo) {
+    if (*count == 0) {
+        return false;
+    }
+    if (*x & 1) {
+        nvConvertYuvRowToRgbScalar(yRow, uvRow, *x, 1, *dst, order, is16Bit, matrix, sampleInfo);
+        (*x)++;
+        (*count)--;
+        *dst += 4;
+    }
+    return *count != 0;
+}
+
+#endif
+
+#if defined(__SSE2__)
+
+// Packs a signed 16-bit pair of chroma coefficients for madd, u in the low half
+// to match the U,V interleaving of the chroma plane.
+static int32_t chromaCoefficients(int uCoef, int vCoef) {
+    return (int32_t) (((uint32_t) (uint16_t) uCoef) | ((uint32_t) (uint16_t) vCoef << 16));
+}
+
+// Interleaves 8 pixels worth of 16-bit R, G and B (already clamped to 0-255)
+// into 32 bytes in the requested order.
+static void storeRgbSse2(uint8_t *dst, uint32_t order, __m128i r, __m128i g, __m128i b) {
+    const __m128i a = _mm_set1_epi16(255);
+    __m128i c0, c1, c2, c3;
+    switch (order) {
+    case 1:
+        c0 = r; c1 = g; c2 = b; c3 = a;
+        break;
+    case 2:
+        c0 = a; c1 = r; c2 = g; c3 = b;
+        break;
+    case 3:
+        c0 = a; c1 = b; c2 = g; c3 = r;
+        break;
+    default:
+        c0 = b; c1 = g; c2 = r; c3 = a;
+        break;
+    }
+    const __m128i lo = _mm_or_si128(c0, _mm_slli_epi16(c1, 8));
+    const __m128i hi = _mm_or_si128(c2, _mm_slli_epi16(c3, 8));
+    _mm_storeu_si128((__m128i*) dst, _mm_unpacklo_epi16(lo, hi));
+    _mm_storeu_si128((__m128i*) (dst + 16), _mm_unpackhi_epi16(lo, hi));
+}
+
+static void convertRowSse2(const void *yRow, const void *uvRow, uint32_t x, uint32_t count, uint8_t *dst,
+                           uint32_t order, bool is16Bit, const ColorMatrix *matrix, const VideoProcSampleInfo *sampleInfo) {
+    if (!alignRowStart(yRow, uvRow, &x, &count, &dst, order, is16Bit, matrix, sampleInfo)) {
+        return;
+    }
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i max = _mm_set1_epi16(255);
+    const __m128i yOffset = _mm_set1_epi16((int16_t) sampleInfo->yOffset);
+    const __m128i uvOffset = _mm_set1_epi16((int16_t) sampleInfo->uvOffset);
+    const __m128i yScale = _mm_set1_epi16((int16_t) sampleInfo->yScale);
+    const __m128i rounding = _mm_set1_epi32(sampleInfo->rounding);
+    const __m128i rCoef = _mm_set1_epi32(chromaCoefficients(0, matrix->vToR));
+    const __m128i gCoef = _mm_set1_epi32(chromaCoefficients(matrix->uToG, matrix->vToG));
+    const __m128i bCoef = _mm_set1_epi32(chromaCoefficients(matrix->uToB, 0));
+    const __m128i sampleShift = _mm_cvtsi32_si128(sampleInfo->sampleShift);
+    const __m128i valueShift = _mm_cvtsi32_si128(sampleInfo->valueShift);
+
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const uint32_t px = x + i;
+        __m128i yv, uv;
+        if (is16Bit) {
+            yv = _mm_srl_epi16(_mm_loadu_si128((const __m128i*) ((const uint16_t*) yRow + px)), sampleShift);
+            uv = _mm_srl_epi16(_mm_loadu_si128((const __m128i*) ((const uint16_t*) uvRow + px)), sampleShift);
+        } else {
+            yv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) ((const uint8_t*) yRow + px)), zero);
+            uv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) ((const uint8_t*) uvRow + px)), zero);
+        }
+
+        const __m128i c = _mm_max_epi16(_mm_sub_epi16(yv, yOffset), zero);
+        const __m128i de = _mm_sub_epi16(uv, uvOffset);
+        const __m128i ycLo = _mm_mullo_epi16(c, yScale);
+        const __m128i ycHi = _mm_mulhi_epi16(c, yScale);
+        const __m128i yc0 = _mm_add_epi32(_mm_unpacklo_epi16(ycLo, ycHi), rounding);
+        const __m128i yc1 = _mm_add_epi32(_mm_unpackhi_epi16(ycLo, ycHi), rounding);
+        //one value per chroma pair, duplicated across the two pixels sharing it
+        const __m128i rv = _mm_madd_epi16(de, rCoef);
+        const __m128i gv = _mm_madd_epi16(de, gCoef);
+        const __m128i bv = _mm_madd_epi16(de, bCoef);
+
+        __m128i r = _mm_packs_epi32(_mm_sra_epi32(_mm_add_epi32(yc0, _mm_unpacklo_epi32(rv, rv)), valueShift),
+                                    _mm_sra_epi32(_mm_add_epi32(yc1, _mm_unpackhi_epi32(rv, rv)), valueShift));
+        __m128i g = _mm_packs_epi32(_mm_sra_epi32(_mm_sub_epi32(yc0, _mm_unpacklo_epi32(gv, gv)), valueShift),
+                                    _mm_sra_epi32(_mm_sub_epi32(yc1, _mm_unpackhi_epi32(gv, gv)), valueShift));
+        __m128i b = _mm_packs_epi32(_mm_sra_epi32(_mm_add_epi32(yc0, _mm_unpacklo_epi32(bv, bv)), valueShift),
+                                    _mm_sra_epi32(_mm_add_epi32(yc1, _mm_unpackhi_epi32(bv, bv)), valueShift));
+        r = _mm_min_epi16(_mm_max_epi16(r, zero), max);
+        g = _mm_min_epi16(_mm_max_epi16(g, zero), max);
+        b = _mm_min_epi16(_mm_max_epi16(b, zero), max);
+
+        storeRgbSse2(dst + (size_t) i * 4, order, r, g, b);
+    }
+
+    nvConvertYuvRowToRgbScalar(yRow, uvRow, x + i, count - i, dst + (size_t) i * 4, order, is16Bit, matrix, sampleInfo);
+}
+
+#endif
+
+#if defined(CONVERT_CPU_AVX2)
+
+// Same as storeRgbSse2 for 16 pixels. The unpacks work within 128-bit lanes,
+// leaving pixels 0-3/8-11 and 4-7/12-15 together, which the final lane
+// permutes put back in order.
+__attribute__((target("avx2")))
+static void storeRgbAvx2(uint8_t *dst, uint32_t order, __m256i r, __m256i g, __m256i b) {
+    const __m256i a = _mm256_set1_epi16(255);
+    __m256i c0, c1, c2, c3;
+    switch (order) {
+    case 1:
+        c0 = r; c1 = g; c2 = b; c3 = a;
+        break;
+    case 2:
+        c0 = a; c1 = r; c2 = g; c3 = b;
+        break;
+    case 3:
+        c0 = a; c1 = b; c2 = g; c3 = r;
+        break;
+    default:
+        c0 = b; c1 = g; c2 = r; c3 = a;
+        break;
+    }
+    const __m256i lo = _mm256_or_si256(c0, _mm256_slli_epi16(c1, 8));
+    const __m256i hi = _mm256_or_si256(c2, _mm256_slli_epi16(c3, 8));
+    const __m256i p0 = _mm256_unpacklo_epi16(lo, hi);
+    const __m256i p1 = _mm256_unpackhi_epi16(lo, hi);
+    _mm256_storeu_si256((__m256i*) dst, _mm256_permute2x128_si256(p0, p1, 0x20));
+    _mm256_storeu_si256((__m256i*) (dst + 32), _mm256_permute2x128_si256(p0, p1, 0x31));
+}
+
+__attribute__((target("avx2")))
+static void convertRowAvx2(const void *yRow, const void *uvRow, uint32_t x, uint32_t count, uint8_t *dst,
+                           uint32_t order, bool is16Bit, const ColorMatrix *matrix, const VideoProcSampleInfo *sampleInfo) {
+    if (!alignRowStart(yRow, uvRow, &x, &count, &dst, order, is16Bit, matrix, sampleInfo)) {
+        return;
+    }
+
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i max = _mm256_set1_epi16(255);
+    const __m256i yOffset = _mm256_set1_epi16((int16_t) sampleInfo->yOffset);
+    const __m256i uvOffset = _mm256_set1_epi16((int16_t) sampleInfo->uvOffset);
+    const __m256i yScale = _mm256_set1_epi16((int16_t) sampleInfo->yScale);
+    const __m256i rounding = _mm256_set1_epi32(sampleInfo->rounding);
+    const __m256i rCoef = _mm256_set1_epi32(chromaCoefficients(0, matrix->vToR));
+    const __m256i gCoef = _mm256_set1_epi32(chromaCoefficients(matrix->uToG, matrix->vToG));
+    const __m256i bCoef = _mm256_set1_epi32(chromaCoefficients(matrix->uToB, 0));
+    const __m128i sampleShift = _mm_cvtsi32_si128(sampleInfo->sampleShift);
+    const __m128i valueShift = _mm_cvtsi32_si128(sampleInfo->valueShift);
+
+    uint32_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const uint32_t px = x + i;
+        __m256i yv, uv;
+        if (is16Bit) {
+            yv = _mm256_srl_epi16(_mm256_loadu_si256((const __m256i*) ((const uint16_t*) yRow + px)), sampleShift);
+            uv = _mm256_srl_epi16(_mm256_loadu_si256((const __m256i*) ((const uint16_t*) uvRow + px)), sampleShift);
+        } else {
+            yv = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) ((const uint8_t*) yRow + px)));
+            uv = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) ((const uint8_t*) uvRow + px)));
+        }
+
+        const __m256i c = _mm256_max_epi16(_mm256_sub_epi16(yv, yOffset), zero);
+        const __m256i de = _mm256_sub_epi16(uv, uvOffset);
+        const __m256i ycLo = _mm256_mullo_epi16(c, yScale);
+        const __m256i ycHi = _mm256_mulhi_epi16(c, yScale);
+        const __m256i yc0 = _mm256_add_epi32(_mm256_unpacklo_epi16(ycLo, ycHi), rounding);
+        const __m256i yc1 = _mm256_add_epi32(_mm256_unpackhi_epi16(ycLo, ycHi), rounding);
+        const __m256i rv = _mm256_madd_epi16(de, rCoef);
+        const __m256i gv = _mm256_madd_epi16(de, gCoef);
+        const __m256i bv = _mm256_madd_epi16(de, bCoef);
+
+        __m256i r = _mm256_packs_epi32(_mm256_sra_epi32(_mm256_add_epi32(yc0, _mm256_unpacklo_epi32(rv, rv)), valueShift),
+                                       _mm256_sra_epi32(_mm256_add_epi32(yc1, _mm256_unpackhi_epi32(rv, rv)), valueShift));
+        __m256i g = _mm256_packs_epi32(_mm256_sra_epi32(_mm256_sub_epi32(yc0, _mm256_unpacklo_epi32(gv, gv)), valueShift),
+                                       _mm256_sra_epi32(_mm256_sub_epi32(yc1, _mm256_unpackhi_epi32(gv, gv)), valueShift));
+        __m256i b = _mm256_packs_epi32(_mm256_sra_epi32(_mm256_add_epi32(yc0, _mm256_unpacklo_epi32(bv, bv)), valueShift),
+                                       _mm256_sra_epi32(_mm256_add_epi32(yc1, _mm256_unpackhi_epi32(bv, bv)), valueShift));
+        r = _mm256_min_epi16(_mm256_max_epi16(r, zero), max);
+        g = _mm256_min_epi16(_mm256_max_epi16(g, zero), max);
+        b = _mm256_min_epi16(_mm256_max_epi16(b, zero), max);
+
+        storeRgbAvx2(dst + (size_t) i * 4, order, r, g, b);
+    }
+
+    convertRowSse2(yRow, uvRow, x + i, count - i, dst + (size_t) i * 4, order, is16Bit, matrix, sampleInfo);
+}
+
+#endif
+
+#if defined(__ARM_NEON)
+
+static void convertRowNeon(const void *yRow, const void *uvRow, uint32_t x, uint32_t count, uint8_t *dst,
+                           uint32_t order, bool is16Bit, const ColorMatrix *matrix, const VideoProcSampleInfo *sampleInfo) {
+    if (!alignRowStart(yRow, uvRow, &x, &count, &dst, order, is16Bit, matrix, sampleInfo)) {
+        return;
+    }
+
+    const int16x8_t zero = vdupq_n_s16(0);
+    const int16x8_t yOffset = vdupq_n_s16((int16_t) sampleInfo->yOffset);
+    const int16x8_t uvOffset = vdupq_n_s16((int16_t) sampleInfo->uvOffset);
+    const int16_t yScale = (int16_t) sampleInfo->yScale;
+    const int16_t vToR = (int16_t) matrix->vToR;
+    const int16_t uToG = (int16_t) matrix->uToG;
+    const int16_t vToG = (int16_t) matrix->vToG;
+    const int16_t uToB = (int16_t) matrix->uToB;
+    const int32x4_t rounding = vdupq_n_s32(sampleInfo->rounding);
+    const int16x8_t sampleShift = vdupq_n_s16((int16_t) -sampleInfo->sampleShift);
+    const int32x4_t valueShift = vdupq_n_s32(-sampleInfo->valueShift);
+    const uint8x8_t alpha = vdup_n_u8(255);
+
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const uint32_t px = x + i;
+        int16x8_t yv, uv;
+        if (is16Bit) {
+            yv = vreinterpretq_s16_u16(vshlq_u16(vld1q_u16((const uint16_t*) yRow + px), sampleShift));
+            uv = vreinterpretq_s16_u16(vshlq_u16(vld1q_u16((const uint16_t*) uvRow + px), sampleShift));
+        } else {
+            yv = vreinterpretq_s16_u16(vmovl_u8(vld1_u8((const uint8_t*) yRow + px)));
+            uv = vreinterpretq_s16_u16(vmovl_u8(vld1_u8((const uint8_t*) uvRow + px)));
+        }
+
+        const int16x8_t c = vmaxq_s16(vsubq_s16(yv, yOffset), zero);
+        //split U and V, then duplicate each across the two pixels sharing it
+        const int16x8x2_t de = vuzpq_s16(vsubq_s16(uv, uvOffset), zero);
+        const int16x4x2_t d = vzip_s16(vget_low_s16(de.val[0]), vget_low_s16(de.val[0]));
+        const int16x4x2_t e = vzip_s16(vget_low_s16(de.val[1]), vget_low_s16(de.val[1]));
+
+        int16x4_t r16[2], g16[2], b16[2];
+        for (int h = 0; h < 2; h++) {
+            const int16x4_t ch = h == 0 ? vget_low_s16(c) : vget_high_s16(c);
+            const int32x4_t yc = vmlal_n_s16(rounding, ch, yScale);
+            r16[h] = vqmovn_s32(vshlq_s32(vmlal_n_s16(yc, e.val[h], vToR), valueShift));
+            g16[h] = vqmovn_s32(vshlq_s32(vmlsl_n_s16(vmlsl_n_s16(yc, d.val[h], uToG), e.val[h], vToG), valueShift));
+            b16[h] = vqmovn_s32(vshlq_s32(vmlal_n_s16(yc, d.val[h], uToB), valueShift));
+        }
+        const uint8x8_t r = vqmovun_s16(vcombine_s16(r16[0], r16[1]));
+        const uint8x8_t g = vqmovun_s16(vcombine_s16(g16[0], g16[1]));
+        const uint8x8_t b = vqmovun_s16(vcombine_s16(b16[0], b16[1]));
+
+        uint8x8x4_t out;
+        switch (order) {
+        case 1:
+            out.val[0] = r; out.val[1] = g; out.val[2] = b; out.val[3] = alpha;
+            break;
+        case 2:
+            out.val[0] = alpha; out.val[1] = r; out.val[2] = g; out.val[3] = b;
+            break;
+        case 3:
+            out.val[0] = alpha; out.val[1] = b; out.val[2] = g; out.val[3] = r;
+            break;
+        default:
+            out.val[0] = b; out.val[1] = g; out.val[2] = r; out.val[3] = alpha;
+            break;
+        }
+        vst4_u8(dst + (size_t) i * 4, out);
+    }
+
+    nvConvertYuvRowToRgbScalar(yRow, uvRow, x + i, count - i, dst + (size_t) i * 4, order, is16Bit, matrix, sampleInfo);
+}
+
+#endif
+
+#define CONVERT_ROW_MAX_IMPLS 4
+
+static ConvertYuvRowToRgbImpl convertRowImpls[CONVERT_ROW_MAX_IMPLS];
+static int convertRowImplCount;
+static ConvertYuvRowToRgbFunc convertRow = nvConvertYuvRowToRgbScalar;
+static const char *convertRowName = "scalar";
+static pthread_once_t convertRowOnce = PTHREAD_ONCE_INIT;
+
+static void addConvertRowImpl(const char *name, ConvertYuvRowToRgbFunc convert) {
+    convertRowImpls[convertRowImplCount++] = (ConvertYuvRowToRgbImpl) { name, convert };
+}
+
+static void selectConvertRow(void) {
+#if defined(CONVERT_CPU_AVX2)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        addConvertRowImpl("AVX2", convertRowAvx2);
+    }
+#endif
+#if defined(__SSE2__)
+    addConvertRowImpl("SSE2", convertRowSse2);
+#elif defined(__ARM_NEON)
+    addConvertRowImpl("NEON", convertRowNeon);
+#endif
+    addConvertRowImpl("scalar", nvConvertYuvRowToRgbScalar);
+
+    convertRow = convertRowImpls[0].convert;
+    convertRowName = convertRowImpls[0].name;
+}
+
+void nvConvertYuvRowToRgb(const void *yRow, const void *uvRow, uint32_t x, uint32_t count, uint8_t *dst,
+                          uint32_t order, bool is16Bit, const ColorMatrix *matrix, const VideoProcSampleInfo *sampleInfo) {
+    pthread_once(&convertRowOnce, selectConvertRow);
+    convertRow(yRow, uvRow, x, count, dst, order, is16Bit, matrix, sampleInfo);
+}
+
+const char *nvConvertYuvRowToRgbImplementation(void) {
+    pthread_once(&convertRowOnce, selectConvertRow);
+    return convertRowName;
+}
+
+int nvConvertYuvRowToRgbImplementations(const ConvertYuvRowToRgbImpl **impls) {
+    pthread_once(&convertRowOnce, selectConvertRow);
+    *impls = convertRowImpls;
+    return convertRowImplCount;
+}
@@ -0,0 +1,55 @@
+#ifndef CONVERT_CPU_H
+#define CONVERT_CPU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+    int vToR;
+    int uToG;
+    int vToG;
+    int uToB;
+} ColorMatrix;
+
+typedef struct {
+    int sampleShift;
+    int yScale;
+    int yOffset;
+    int uvOffset;
+    int rounding;
+    int valueShift;
+} VideoProcSampleInfo;
+
+typedef void (*ConvertYuvRowToRgbFunc)(const void *yRow, const void *uvRow, uint32_t x, uint32_t count, uint8_t *dst,
+                                       uint32_t order, bool is16Bit, const ColorMatrix *matrix, const VideoProcSampleInfo *sampleInfo);
+
+typedef struct {
+    const char              *name;
+    ConvertYuvRowToRgbFunc  convert;
+} ConvertYuvRowToRgbImpl;
+
+// Converts count pixels of one NV12 (or P010/P012 when is16Bit) row to packed
+// 8-bit RGB, starting at source column x. yRow and uvRow point at the start
+// of the luma row and of the interleaved chroma row covering it. order selects
+// the output byte order the same way as the CUDA kernels' p_order parameter
+// (0 BGRA, 1 RGBA, 2 ARGB, 3 ABGR), alpha is always 255.
+//
+// Uses the widest SIMD implementation the CPU supports; the result is
+// bit-identical to nvConvertYuvRowToRgbScalar.
+void nvConvertYuvRowToRgb(const void *yRow, const void *uvRow, uint32_t x, uint32_t count, uint8_t *dst,
+                          uint32_t order, bool is16Bit, const ColorMatrix *matrix, const VideoProcSampleInfo *sampleInfo);
+
+// Plain C reference implementation of nvConvertYuvRowToRgb.
+void nvConvertYuvRowToRgbScalar(const void *yRow, const void *uvRow, uint32_t x, uint32_t count, uint8_t *dst,
+                                uint32_t order, bool is16Bit, const ColorMatrix *matrix, const VideoProcSampleInfo *sampleInfo);
+
+// Name of the implementation nvConvertYuvRowToRgb dispatches to, for logging.
+const char *nvConvertYuvRowToRgbImplementation(void);
+
+// Every implementation that was built in and that the CPU supports, widest
+// first, so the first is the one nvConvertYuvRowToRgb dispatches to and the
+// last is the scalar reference. Lets tests and benchmarks cover the narrower
+// paths too. Returns how many there are.
+int nvConvertYuvRowToRgbImplementations(const ConvertYuvRowToRgbImpl **impls);
+
+#endif // CONVERT_CPU_H
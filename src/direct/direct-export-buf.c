@@ -7,12 +7,14 @@
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
 #include <fcntl.h>
 #include <unistd.h>
 #ifdef __linux__
 #include <sys/sysmacros.h>
 #endif
 #include <string.h>
+#include <time.h>
 #include "../backend-common.h"
 
 #include <drm.h>
@@ -20,6 +22,17 @@
 
 static void destroyBackingImage(NVDriver *drv, BackingImage *img);
 
+#ifndef CUDA_ARRAY3D_SURFACE_LDST
+#define CUDA_ARRAY3D_SURFACE_LDST 0x02
+#endif
+
+//how often the free video memory is sampled to resize the detached cache budget
+#define VRAM_PRESSURE_CHECK_INTERVAL_NS 1000000000ULL
+//free VRAM (as a fraction of the heap) below which the detached cache is emptied
+#define VRAM_PRESSURE_LOW_WATERMARK_DIVISOR 32
+//free VRAM (as a fraction of the heap) above which the full budget is allowed
+#define VRAM_PRESSURE_HIGH_WATERMARK_DIVISOR 8
+
 static bool isRgbSurfaceFourcc(uint32_t fourcc) {
     return fourcc == VA_FOURCC_ARGB ||
            fourcc == VA_FOURCC_XRGB ||
@@ -36,6 +49,17 @@ static NVFormat nvFormatForSurface(const NVSurface *surface) {
         return NV_FORMAT_ARGB;
     }
 
+    switch ((uint32_t) surface->fourcc) {
+    case VA_FOURCC_I420:
+        return NV_FORMAT_I420;
+    case VA_FOURCC_YUY2:
+        return NV_FORMAT_YUY2;
+    case VA_FOURCC_RGBP:
+        return NV_FORMAT_RGBP;
+    default:
+        break;
+    }
+
     switch (surface->format) {
     case cudaVideoSurfaceFormat_P016:
         switch (surface->bitDepth) {
@@ -103,13 +127,18 @@ static bool import_to_cuda(NVDriver *drv, NVDriverImage *image, int bpc, int cha
             .Depth = 0,
             .Format = bpc == 8 ? CU_AD_FORMAT_UNSIGNED_INT8 : CU_AD_FORMAT_UNSIGNED_INT16,
             .NumChannels = channels,
-            .Flags = 0
+            //allows VideoProc to write into the array with surface stores
+            .Flags = CUDA_ARRAY3D_SURFACE_LDST
         },
         .numLevels = 1,
         .offset = 0
     };
     //create a mimap array from the imported memory
-    CHECK_CUDA_RESULT_RETURN(drv->cu->cuExternalMemoryGetMappedMipmappedArray(&cudaImage->mipmapArray, cudaImage->extMem, &mipmapArrayDesc), false);
+    if (drv->cu->cuExternalMemoryGetMappedMipmappedArray(&cudaImage->mipmapArray, cudaImage->extMem, &mipmapArrayDesc) != CUDA_SUCCESS) {
+        //retry without surface support, VideoProc will use its staged path instead
+        mipmapArrayDesc.arrayDesc.Flags = 0;
+        CHECK_CUDA_RESULT_RETURN(drv->cu->cuExternalMemoryGetMappedMipmappedArray(&cudaImage->mipmapArray, cudaImage->extMem, &mipmapArrayDesc), false);
+    }
 
     //create an array from the mipmap array
     CHECK_CUDA_RESULT_RETURN(drv->cu->cuMipmappedArrayGetLevel(array, cudaImage->mipmapArray, 0), false);
@@ -175,6 +204,9 @@ static bool direct_initExporter(NVDriver *drv) {
 
     const bool ret = init_nvdriver(&drv->driverContext, drv->drmFd);
 
+    pthread_mutex_init(&drv->reapMutex, NULL);
+    pthread_cond_init(&drv->reapCond, NULL);
+
     //TODO this isn't really correct as we don't know if the driver version actually supports importing them
     //but we don't have an easy way to find out.
     drv->supports16BitSurface = true;
@@ -186,6 +218,8 @@ static bool direct_initExporter(NVDriver *drv) {
 
 static void direct_releaseExporter(NVDriver *drv) {
     free_nvdriver(&drv->driverContext);
+    pthread_cond_destroy(&drv->reapCond);
+    pthread_mutex_destroy(&drv->reapMutex);
 }
 
 static void initBackingImageSync(BackingImage *img) {
@@ -220,6 +254,18 @@ static void fillBackingImageClearRows(uint8_t *rows, size_t widthInBytes, uint32
         return;
     }
 
+    if (format == NV_FORMAT_RGBP) {
+        memset(rows, 0, widthInBytes * rowsCount);
+        return;
+    }
+
+    if (format == NV_FORMAT_YUY2) {
+        for (size_t i = 0; i < widthInBytes * rowsCount; i++) {
+            rows[i] = (i & 1) == 0 ? 16 : 128;
+        }
+        return;
+    }
+
     if (formatsInfo[format].bppc == 1) {
         memset(rows, plane == 0 ? 16 : 128, widthInBytes * rowsCount);
         return;
@@ -327,14 +373,118 @@ static bool detachedBackingImagesOverLimit(uint64_t bytes, uint32_t count, const
     if (count == 0) {
         return false;
     }
-    if (drv->maxDetachedBackingImages == 0 || drv->maxDetachedBackingImageBytes == 0) {
+    if (drv->maxDetachedBackingImages == 0 || drv->detachedBackingImageBudgetBytes == 0) {
         return true;
     }
     return count > drv->maxDetachedBackingImages ||
-           bytes > drv->maxDetachedBackingImageBytes;
+           bytes > drv->detachedBackingImageBudgetBytes;
 }
 
-static bool pruneOldestDetachedBackingImageLocked(NVDriver *drv, uint64_t *bytes, uint32_t *count) {
+// Destroy everything still waiting on the reaper from the calling thread.
+// Used when an allocation fails, so memory that is already on its way out is
+// returned before anything still cached is given up, and to pick up what a
+// reaper that gave up left behind.
+static uint32_t destroyQueuedBackingImages(NVDriver *drv) {
+    uint32_t destroyed = 0;
+
+    pthread_mutex_lock(&drv->reapMutex);
+    while (drv->reapImages.size > 0) {
+        BackingImage *img = get_element_at(&drv->reapImages, drv->reapImages.size - 1);
+        remove_element_at(&drv->reapImages, drv->reapImages.size - 1);
+        pthread_mutex_unlock(&drv->reapMutex);
+        destroyBackingImage(drv, img);
+        destroyed++;
+        pthread_mutex_lock(&drv->reapMutex);
+    }
+    pthread_mutex_unlock(&drv->reapMutex);
+
+    return destroyed;
+}
+
+// Destroys evicted backing images off the decode path. Tearing an image down
+// means cuDestroyExternalMemory, array/mipmap destruction and closing the
+// dma-buf fds, which is slow enough to stall the resolve thread when a prune
+// evicts several images at once; the hot path now only unlinks them.
+static void *reapBackingImages(void *param) {
+    NVDriver *drv = (NVDriver*) param;
+    if (CHECK_CUDA_RESULT(drv->cu->cuCtxPushCurrent(drv->cudaContext))) {
+        //nothing can be destroyed without the context, so give up and have
+        //reapBackingImage destroy inline, draining what was already queued
+        LOG("BackingImage reaper thread unable to push the CUDA context, destroying inline");
+        pthread_mutex_lock(&drv->reapMutex);
+        drv->reapThreadExiting = true;
+        pthread_mutex_unlock(&drv->reapMutex);
+        return NULL;
+    }
+
+    //this is housekeeping, let decoding threads win any contention
+    setpriority(PRIO_PROCESS, (id_t) nv_gettid(), 10);
+
+    pthread_mutex_lock(&drv->reapMutex);
+    while (true) {
+        while (drv->reapImages.size == 0 && !drv->reapThreadExiting) {
+            pthread_cond_wait(&drv->reapCond, &drv->reapMutex);
+        }
+        if (drv->reapImages.size == 0) {
+            //exiting, and everything queued has been destroyed
+            break;
+        }
+
+        BackingImage *img = get_element_at(&drv->reapImages, drv->reapImages.size - 1);
+        remove_element_at(&drv->reapImages, drv->reapImages.size - 1);
+        pthread_mutex_unlock(&drv->reapMutex);
+        destroyBackingImage(drv, img);
+        pthread_mutex_lock(&drv->reapMutex);
+    }
+    pthread_mutex_unlock(&drv->reapMutex);
+
+    CHECK_CUDA_RESULT(drv->cu->cuCtxPopCurrent(NULL));
+    return NULL;
+}
+
+// Hand an image that has already been unlinked from drv->images to the reaper
+// thread, starting it on first use. If the thread can't be started, or has
+// given up, the image is destroyed inline, which is what used to happen
+// unconditionally, along with anything the thread left queued.
+static void reapBackingImage(NVDriver *drv, BackingImage *img) {
+    pthread_mutex_lock(&drv->reapMutex);
+    if (!drv->reapThreadStarted && !drv->reapThreadExiting) {
+        drv->reapThreadStarted = pthread_create(&drv->reapThread, NULL, &reapBackingImages, drv) == 0;
+        if (!drv->reapThreadStarted) {
+            LOG("Unable to start BackingImage reaper thread, destroying inline");
+            drv->reapThreadExiting = true;
+        }
+    }
+    if (drv->reapThreadStarted && !drv->reapThreadExiting) {
+        add_element(&drv->reapImages, img);
+        pthread_cond_signal(&drv->reapCond);
+        pthread_mutex_unlock(&drv->reapMutex);
+        return;
+    }
+    pthread_mutex_unlock(&drv->reapMutex);
+
+    destroyBackingImage(drv, img);
+    destroyQueuedBackingImages(drv);
+}
+
+static void stopBackingImageReaper(NVDriver *drv) {
+    pthread_mutex_lock(&drv->reapMutex);
+    const bool started = drv->reapThreadStarted;
+    drv->reapThreadExiting = true;
+    pthread_cond_signal(&drv->reapCond);
+    pthread_mutex_unlock(&drv->reapMutex);
+
+    //the reaper drains the queue before exiting, unless it gave up early
+    if (started) {
+        pthread_join(drv->reapThread, NULL);
+        drv->reapThreadStarted = false;
+    }
+    destroyQueuedBackingImages(drv);
+}
+
+// Unlink the oldest reclaimable detached image from drv->images and return it,
+// leaving destruction to the caller. Must be called with imagesMutex held.
+static BackingImage *unlinkOldestDetachedBackingImageLocked(NVDriver *drv, uint64_t *bytes, uint32_t *count) {
     uint32_t pruneIndex = UINT32_MAX;
     uint64_t oldestSerial = UINT64_MAX;
 
@@ -346,12 +496,11 @@ static bool pruneOldestDetachedBackingImageLocked(NVDriver *drv, uint64_t *bytes
     END_FOR_EACH
 
     if (pruneIndex == UINT32_MAX) {
-        return false;
+        return NULL;
     }
 
     BackingImage *img = get_element_at(&drv->images, pruneIndex);
     uint64_t imageBytes = backingImageMemorySize(img);
-    destroyBackingImage(drv, img);
     remove_element_at(&drv->images, pruneIndex);
     if (*bytes >= imageBytes) {
         *bytes -= imageBytes;
@@ -361,7 +510,7 @@ static bool pruneOldestDetachedBackingImageLocked(NVDriver *drv, uint64_t *bytes
     if (*count > 0) {
         (*count)--;
     }
-    return true;
+    return img;
 }
 
 static void pruneDetachedBackingImagesToLimits(NVDriver *drv) {
@@ -378,12 +527,69 @@ static void pruneDetachedBackingImagesToLimits(NVDriver *drv) {
     END_FOR_EACH
 
     while (detachedBackingImagesOverLimit(bytes, count, drv)) {
-        if (!pruneOldestDetachedBackingImageLocked(drv, &bytes, &count)) {
+        BackingImage *img = unlinkOldestDetachedBackingImageLocked(drv, &bytes, &count);
+        if (img == NULL) {
             break;
         }
+        reapBackingImage(drv, img);
+    }
+
+    pthread_mutex_unlock(&drv->imagesMutex);
+}
+
+// Scale the detached cache budget with the amount of free video memory. Above
+// the high watermark the full configured ceiling is allowed; between the
+// watermarks the budget shrinks linearly; at or below the low watermark it is
+// zero, so every reclaimable image is dropped before our next allocation (or
+// someone else's) has a chance to fail. The budget grows back on its own once
+// the pressure goes away. The heap query is rate limited since realise/detach
+// run for every decoded frame.
+static void updateDetachedBackingImageBudget(NVDriver *drv) {
+    if (drv->vramPressureCheckDisabled || drv->driverContext.useSystemMemory) {
+        return;
+    }
+
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    const uint64_t now = (uint64_t) tp.tv_sec * 1000000000ULL + (uint64_t) tp.tv_nsec;
+
+    pthread_mutex_lock(&drv->imagesMutex);
+    if (drv->vramPressureCheckTimeNs != 0 && now - drv->vramPressureCheckTimeNs < VRAM_PRESSURE_CHECK_INTERVAL_NS) {
+        pthread_mutex_unlock(&drv->imagesMutex);
+        return;
+    }
+    drv->vramPressureCheckTimeNs = now;
+
+    uint64_t totalBytes = 0;
+    uint64_t freeBytes = 0;
+    if (!query_fb_heap_info(&drv->driverContext, &totalBytes, &freeBytes)) {
+        LOG("Unable to query free video memory, using a fixed detached cache budget");
+        drv->vramPressureCheckDisabled = true;
+        pthread_mutex_unlock(&drv->imagesMutex);
+        return;
+    }
+
+    const uint64_t lowWatermark = totalBytes / VRAM_PRESSURE_LOW_WATERMARK_DIVISOR;
+    const uint64_t highWatermark = totalBytes / VRAM_PRESSURE_HIGH_WATERMARK_DIVISOR;
+    uint64_t budget = drv->maxDetachedBackingImageBytes;
+    if (freeBytes <= lowWatermark) {
+        budget = 0;
+    } else if (freeBytes < highWatermark) {
+        budget = (uint64_t) ((double) budget * (double) (freeBytes - lowWatermark) / (double) (highWatermark - lowWatermark));
     }
 
+    const uint64_t oldBudget = drv->detachedBackingImageBudgetBytes;
+    drv->detachedBackingImageBudgetBytes = budget;
     pthread_mutex_unlock(&drv->imagesMutex);
+
+    if (budget != oldBudget) {
+        LOG_DEBUG("Detached backing-image budget %llu -> %llu bytes (free VRAM %llu of %llu bytes)",
+                  (unsigned long long) oldBudget, (unsigned long long) budget,
+                  (unsigned long long) freeBytes, (unsigned long long) totalBytes);
+    }
+    if (budget < oldBudget) {
+        pruneDetachedBackingImagesToLimits(drv);
+    }
 }
 
 // Allocate a multi-plane YUV backing image as one dma-buf object per plane, all sharing a
@@ -752,15 +958,23 @@ static void destroyBackingImage(NVDriver *drv, BackingImage *img) {
 // whose exported dma-bufs are the most likely to still be in the client's
 // display pipeline, or about to be re-imported across a codec/format switch --
 // are freed last rather than all at once.
+//
+// Unlike the limit-driven prune this destroys the image synchronously (outside
+// imagesMutex): the caller retries its allocation straight away and needs the
+// memory to actually be back.
 static bool pruneOldestReclaimableDetachedBackingImage(NVDriver *drv) {
     uint64_t bytes = 0;
     uint32_t count = 0;
 
     pthread_mutex_lock(&drv->imagesMutex);
-    const bool pruned = pruneOldestDetachedBackingImageLocked(drv, &bytes, &count);
+    BackingImage *img = unlinkOldestDetachedBackingImageLocked(drv, &bytes, &count);
     pthread_mutex_unlock(&drv->imagesMutex);
 
-    return pruned;
+    if (img == NULL) {
+        return false;
+    }
+    destroyBackingImage(drv, img);
+    return true;
 }
 
 static void direct_attachBackingImageToSurface(NVSurface *surface, BackingImage *img) {
@@ -770,6 +984,48 @@ static void direct_attachBackingImageToSurface(NVSurface *surface, BackingImage
     nvBackingImageStoreSurfaceColorMetadata(img, surface);
 }
 
+static bool backingImageCompatibleWithSurface(const BackingImage *img, const NVSurface *surface) {
+    // Only plain driver-allocated images are recycled; imported/borrowed ones
+    // never reach the detached cache, but guard against it anyway. The layout
+    // (single buffer vs one object per plane) must match what a fresh
+    // allocation would produce, otherwise the exported descriptor would change
+    // shape underneath a client that already negotiated one.
+    const bool wantSingleBuffer = !isRgbSurfaceFourcc((uint32_t) surface->fourcc) && nvdSingleBufferForced();
+    return img->format == nvFormatForSurface(surface) &&
+           img->width == surface->width &&
+           img->height == surface->height &&
+           img->isSingleBuffer == wantSingleBuffer &&
+           !img->isExternalBuffer &&
+           !img->borrowedCudaResources &&
+           img->borrowedBackingImage == NULL;
+}
+
+// Reattach a compatible detached backing image to the surface instead of
+// allocating a new one. The oldest compatible image (lowest detachedSerial) is
+// picked, for the same reason pruning goes oldest-first: the most recently
+// detached images are the ones whose exported dma-bufs are most likely still
+// held by the client. The image stays in drv->images, so the caller must not
+// add it again.
+static BackingImage *direct_findReusableBackingImage(NVDriver *drv, NVSurface *surface) {
+    BackingImage *ret = NULL;
+
+    pthread_mutex_lock(&drv->imagesMutex);
+    ARRAY_FOR_EACH(BackingImage*, img, &drv->images)
+        if (backingImageCanPrune(img) && backingImageCompatibleWithSurface(img, surface) &&
+            (ret == NULL || img->detachedSerial < ret->detachedSerial)) {
+            ret = img;
+        }
+    END_FOR_EACH
+
+    if (ret != NULL) {
+        LOG_DEBUG("Reusing BackingImage %p for Surface %p", ret, surface);
+        direct_attachBackingImageToSurface(surface, ret);
+    }
+    pthread_mutex_unlock(&drv->imagesMutex);
+
+    return ret;
+}
+
 static void direct_detachBackingImageFromSurface(NVDriver *drv, NVSurface *surface) {
     if (surface->backingImage == NULL) {
         return;
@@ -798,6 +1054,8 @@ static void direct_detachBackingImageFromSurface(NVDriver *drv, NVSurface *surfa
 }
 
 static void direct_destroyAllBackingImage(NVDriver *drv) {
+    stopBackingImageReaper(drv);
+
     pthread_mutex_lock(&drv->imagesMutex);
 
     ARRAY_FOR_EACH_REV(BackingImage*, it, &drv->images)
@@ -892,7 +1150,16 @@ static bool direct_realiseSurface(NVDriver *drv, NVSurface *surface) {
     pthread_mutex_lock(&surface->mutex);
     //check again to see if it's just been created
     if (surface->backingImage == NULL) {
+        updateDetachedBackingImageBudget(drv);
+
         //try to find a free surface
+        if (direct_findReusableBackingImage(drv, surface) != NULL) {
+            nvStatsIncrement(drv, NV_STAT_BACKING_IMAGE_REUSE_HITS);
+            pthread_mutex_unlock(&surface->mutex);
+            return true;
+        }
+        nvStatsIncrement(drv, NV_STAT_BACKING_IMAGE_REUSE_MISSES);
+
         BackingImage *img = direct_allocateBackingImage(drv, surface);
         if (img == NULL) {
             // Allocation failed, typically under VRAM pressure. Reclaim detached
@@ -904,6 +1171,9 @@ static bool direct_realiseSurface(NVDriver *drv, NVSurface *surface) {
             // under the client corrupts the displayed frame. Oldest-first with a
             // retry between each prune frees only what this allocation needs and
             // keeps the recent frames alive.
+            if (destroyQueuedBackingImages(drv) > 0) {
+                img = direct_allocateBackingImage(drv, surface);
+            }
             uint32_t reclaimed = 0;
             while (img == NULL && pruneOldestReclaimableDetachedBackingImage(drv)) {
                 reclaimed++;
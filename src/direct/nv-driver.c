@@ -360,6 +360,29 @@ static bool query_ram_location(NVDriverContext *context) {
     return unified;
 }
 
+// Query the size of the video memory heap and how much of it is currently
+// free, in bytes. The free figure is device-wide and includes every other
+// client's allocations.
+bool query_fb_heap_info(const NVDriverContext *context, uint64_t *totalBytes, uint64_t *freeBytes) {
+    NV2080_CTRL_FB_GET_INFO_V2_PARAMS params = {
+        .fbInfoListSize = 2,
+        .fbInfoList = {
+            { .index = NV2080_CTRL_FB_INFO_INDEX_HEAP_SIZE, .data = 0 },
+            { .index = NV2080_CTRL_FB_INFO_INDEX_HEAP_FREE, .data = 0 }
+        }
+    };
+
+    if (!nv_rm_control(context->nvctlFd, context->clientObject, context->subdeviceObject,
+                      NV2080_CTRL_CMD_FB_GET_INFO_V2, 0, sizeof(params), &params)) {
+        return false;
+    }
+
+    //both values are reported in KiB
+    *totalBytes = (uint64_t) params.fbInfoList[0].data * 1024;
+    *freeBytes = (uint64_t) params.fbInfoList[1].data * 1024;
+    return *totalBytes != 0;
+}
+
 bool init_nvdriver(NVDriverContext *context, const int drmFd) {
     LOG("Initing nvdriver...")
     int nv0Fd = -1;
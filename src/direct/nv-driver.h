@@ -55,6 +55,7 @@ bool alloc_image(NVDriverContext *context, uint32_t width, uint32_t height, uint
 uint32_t calculate_unified_image_layout(const NVDriverContext *context, NVDriverImage images[], uint32_t width, uint32_t height,
                                         uint32_t bppc, uint32_t numPlanes, const NVFormatPlane planes[],
                                         bool unifyBlockHeight);
+bool query_fb_heap_info(const NVDriverContext *context, uint64_t *totalBytes, uint64_t *freeBytes);
 bool alloc_buffer(NVDriverContext *context, uint32_t totalSize, const NVDriverImage images[], int *nvFd, int *nvFd2, int *drmFd);
 
 #endif
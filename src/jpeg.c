@@ -25,6 +25,22 @@
 
 #define JPEG_MAX_COMPONENTS 4U
 
+// Largest DQT block (four tables) and DHT block (two DC and two AC tables)
+#define JPEG_MAX_DQT_SIZE (4U * (2U + 2U + 1U + 64U))
+#define JPEG_MAX_DHT_SIZE (2U * ((2U + 2U + 1U + 16U + 12U) + (2U + 2U + 1U + 16U + 162U)))
+// Largest block writeJPEGHeader produces: SOI + APP0, DQT, SOF0 with every component, DHT, DRI
+#define JPEG_MAX_HEADER_SIZE (20U + JPEG_MAX_DQT_SIZE + \
+                              (2U + 2U + 1U + 2U + 2U + 1U + JPEG_MAX_COMPONENTS * 3U) + \
+                              JPEG_MAX_DHT_SIZE + (2U + 2U + 2U))
+
+// A serialized run of marker segments, reused while key is unchanged
+typedef struct {
+    bool     valid;
+    uint64_t key;
+    uint32_t size;
+    uint8_t  data[JPEG_MAX_DHT_SIZE > JPEG_MAX_DQT_SIZE ? JPEG_MAX_DHT_SIZE : JPEG_MAX_DQT_SIZE];
+} JPEGSegmentCache;
+
 typedef struct {
     VAPictureParameterBufferJPEGBaseline picParams;
     VAIQMatrixBufferJPEGBaseline         iqMatrix;
@@ -35,6 +51,17 @@ typedef struct {
     uint8_t                              validQuantTablesMask;
     uint8_t                              validHuffmanDcMask;
     uint8_t                              validHuffmanAcMask;
+    // Copies of the last IQ matrix and Huffman table buffers as the client sent
+    // them, so a resent copy can be skipped with a single memcmp
+    bool                                 hasLastIQBuffer;
+    VAIQMatrixBufferJPEGBaseline         lastIQBuffer;
+    bool                                 hasLastHuffmanBuffer;
+    VAHuffmanTableBufferJPEGBaseline     lastHuffmanBuffer;
+    // Bumped whenever the stored tables' contents change, part of the segment cache keys
+    uint32_t                             iqGeneration;
+    uint32_t                             huffmanGeneration;
+    JPEGSegmentCache                     dqtCache;
+    JPEGSegmentCache                     dhtCache;
 } JPEGContext;
 
 // Minimal APP0/JFIF header
@@ -389,71 +416,78 @@ static uint8_t *writeSOS(uint8_t *ptr, const VASliceParameterBufferJPEGBaseline
     return ptr;
 }
 
-// Reconstruct complete JPEG frame
-static uint8_t *reconstructJPEG(const JPEGContext *jpegCtx,
+// What reconstructJPEG learns about a picture's scans while validating them
+typedef struct {
+    uint64_t totalEcsSize;
+    uint8_t  requiredDcMask;
+    uint8_t  requiredAcMask;
+    bool     allSameSOSHeader;
+    bool     allSameRestartInterval;
+    // Restart interval written once in the header, 0 for none
+    uint16_t headerRestartInterval;
+} JPEGScanInfo;
+
+static bool validateJPEGPicture(const JPEGContext *jpegCtx,
                                 const VASliceParameterBufferJPEGBaseline *slices,
                                 uint32_t sliceCount,
-                                const uint8_t *sliceData,
                                 uint32_t sliceDataSize,
-                                uint32_t *outSize) {
+                                JPEGScanInfo *scan) {
     if (!jpegCtx->hasPicParams || !jpegCtx->hasIQMatrix) {
         LOG("JPEG: Missing picture params or IQ matrix");
-        return NULL;
+        return false;
     }
 
     if (jpegCtx->picParams.picture_width == 0U || jpegCtx->picParams.picture_height == 0U) {
         LOG("JPEG: Invalid dimensions: %ux%u",
             jpegCtx->picParams.picture_width,
             jpegCtx->picParams.picture_height);
-        return NULL;
+        return false;
     }
 
     if (jpegCtx->picParams.num_components == 0U || jpegCtx->picParams.num_components > JPEG_MAX_COMPONENTS) {
         LOG("JPEG: Unsupported frame component count: %u", jpegCtx->picParams.num_components);
-        return NULL;
+        return false;
     }
 
     uint8_t usedQuantMask = 0;
     if (!getUsedQuantTablesMask(&jpegCtx->picParams, &usedQuantMask)) {
-        return NULL;
+        return false;
     }
 
     if ((jpegCtx->validQuantTablesMask & usedQuantMask) != usedQuantMask) {
         LOG("JPEG: Missing required quant tables (used=0x%02x valid=0x%02x)",
             usedQuantMask,
             jpegCtx->validQuantTablesMask);
-        return NULL;
+        return false;
     }
 
     if (sliceCount == 0U) {
         LOG("JPEG: No slice parameters");
-        return NULL;
+        return false;
     }
 
-    uint64_t totalEcsSize = 0;
-    uint8_t requiredDcMask = 0;
-    uint8_t requiredAcMask = 0;
+    memset(scan, 0, sizeof(*scan));
 
     for (uint32_t i = 0; i < sliceCount; i++) {
         const VASliceParameterBufferJPEGBaseline *slice = &slices[i];
 
         if (slice->slice_data_flag != VA_SLICE_DATA_FLAG_ALL) {
             LOG("JPEG: slice_data_flag=%u not supported (expected ALL)", slice->slice_data_flag);
-            return NULL;
+            return false;
         }
 
         if (!validateSliceAndCollectHuffmanUsage(&jpegCtx->picParams,
                                                  slice,
-                                                 &requiredDcMask,
-                                                 &requiredAcMask)) {
-            return NULL;
+                                                 &scan->requiredDcMask,
+                                                 &scan->requiredAcMask)) {
+            return false;
         }
 
         if (slice->slice_data_offset > sliceDataSize) {
             LOG("JPEG: Invalid slice_data_offset (%u) exceeds buffer size (%u)",
                 slice->slice_data_offset,
                 sliceDataSize);
-            return NULL;
+            return false;
         }
 
         uint32_t availableData = sliceDataSize - slice->slice_data_offset;
@@ -461,30 +495,30 @@ static uint8_t *reconstructJPEG(const JPEGContext *jpegCtx,
             LOG("JPEG: Invalid slice_data_size (%u) exceeds available data (%u)",
                 slice->slice_data_size,
                 availableData);
-            return NULL;
+            return false;
         }
 
-        if (UINT64_MAX - totalEcsSize < slice->slice_data_size) {
+        if (UINT64_MAX - scan->totalEcsSize < slice->slice_data_size) {
             LOG("JPEG: Total ECS size overflow");
-            return NULL;
+            return false;
         }
-        totalEcsSize += slice->slice_data_size;
+        scan->totalEcsSize += slice->slice_data_size;
     }
 
     const VASliceParameterBufferJPEGBaseline *slice0 = &slices[0];
 
-    bool allSameSOSHeader = true;
-    bool allSameRestartInterval = true;
+    scan->allSameSOSHeader = true;
+    scan->allSameRestartInterval = true;
 
     for (uint32_t i = 1; i < sliceCount; i++) {
         const VASliceParameterBufferJPEGBaseline *slice = &slices[i];
 
         if (slice->restart_interval != slice0->restart_interval) {
-            allSameRestartInterval = false;
+            scan->allSameRestartInterval = false;
         }
 
         if (slice->num_components != slice0->num_components) {
-            allSameSOSHeader = false;
+            scan->allSameSOSHeader = false;
             continue;
         }
 
@@ -492,79 +526,138 @@ static uint8_t *reconstructJPEG(const JPEGContext *jpegCtx,
             if (slice->components[c].component_selector != slice0->components[c].component_selector ||
                 slice->components[c].dc_table_selector != slice0->components[c].dc_table_selector ||
                 slice->components[c].ac_table_selector != slice0->components[c].ac_table_selector) {
-                allSameSOSHeader = false;
+                scan->allSameSOSHeader = false;
                 break;
             }
         }
     }
 
-    // Worst-case buffer size calculation (overestimate for safety)
-    const uint64_t dqtSize = 4U * (2U + 2U + 1U + 64U);
-    const uint64_t sof0Size = 2U + 2U + 1U + 2U + 2U + 1U +
-                              ((uint64_t)jpegCtx->picParams.num_components * 3U);
-    const uint64_t dhtSize = 2U * ((2U + 2U + 1U + 16U + 12U) +
-                                   (2U + 2U + 1U + 16U + 162U));
-    const uint64_t driSize = (uint64_t)sliceCount * (2U + 2U + 2U);
-    const uint64_t sosSize = (uint64_t)sliceCount * (2U + 2U + 1U + 4U * 2U + 3U);
+    scan->headerRestartInterval = scan->allSameRestartInterval ? slice0->restart_interval : 0U;
 
-    uint64_t maxSize64 = sizeof(jfifHeader) + dqtSize + sof0Size + dhtSize +
-                         driSize + sosSize + totalEcsSize + 2U;
+    return true;
+}
 
-    if (maxSize64 > SIZE_MAX) {
-        LOG("JPEG: Frame size too large to allocate (%llu bytes)", (unsigned long long)maxSize64);
-        return NULL;
+// Copies a cached segment run to *pptr if it was built with key. Otherwise
+// returns false, and the caller writes the segments and stores them.
+static bool useJPEGSegmentCache(NVDriver *drv, const JPEGSegmentCache *cache, uint64_t key, uint8_t **pptr) {
+    if (!cache->valid || cache->key != key) {
+        nvStatsIncrement(drv, NV_STAT_JPEG_SEGMENT_CACHE_MISSES);
+        return false;
     }
 
-    uint8_t *frame = (uint8_t *)malloc((size_t)maxSize64);
-    if (frame == NULL) {
-        LOG("JPEG: Failed to allocate frame buffer");
-        return NULL;
-    }
+    memcpy(*pptr, cache->data, cache->size);
+    *pptr += cache->size;
+    nvStatsIncrement(drv, NV_STAT_JPEG_SEGMENT_CACHE_HITS);
+    return true;
+}
 
-    uint8_t *ptr = frame;
+static void storeJPEGSegmentCache(JPEGSegmentCache *cache, uint64_t key, const uint8_t *start, const uint8_t *end) {
+    cache->size = (uint32_t)(end - start);
+    memcpy(cache->data, start, cache->size);
+    cache->key = key;
+    cache->valid = true;
+}
+
+// Write everything ahead of the first scan: SOI + JFIF, DQT, SOF0, DHT and,
+// when all scans share it, DRI. The DQT and DHT runs only depend on the tables
+// and which of them the picture uses, so they come from the segment caches
+// whenever those haven't changed.
+static bool writeJPEGHeader(NVDriver *drv, uint8_t **pptr, JPEGContext *jpegCtx, const JPEGScanInfo *scan) {
+    uint8_t *ptr = *pptr;
 
     // 1. SOI + JFIF header
     memcpy(ptr, jfifHeader, sizeof(jfifHeader));
     ptr += sizeof(jfifHeader);
 
     // 2. DQT
-    if (!writeDQT(&ptr, &jpegCtx->iqMatrix, &jpegCtx->picParams, jpegCtx->validQuantTablesMask)) {
-        free(frame);
-        return NULL;
+    uint8_t usedQuantMask = 0;
+    if (!getUsedQuantTablesMask(&jpegCtx->picParams, &usedQuantMask)) {
+        return false;
+    }
+    const uint64_t dqtKey = ((uint64_t)jpegCtx->iqGeneration << 8) | usedQuantMask;
+    if (!useJPEGSegmentCache(drv, &jpegCtx->dqtCache, dqtKey, &ptr)) {
+        uint8_t *dqt = ptr;
+        if (!writeDQT(&ptr, &jpegCtx->iqMatrix, &jpegCtx->picParams, jpegCtx->validQuantTablesMask)) {
+            return false;
+        }
+        storeJPEGSegmentCache(&jpegCtx->dqtCache, dqtKey, dqt, ptr);
     }
 
     // 3. SOF0
     ptr = writeSOF0(ptr, &jpegCtx->picParams);
 
     // 4. DHT (VA tables if complete and valid, else standard)
-    bool useVAHuffman = jpegCtx->hasHuffmanTable &&
-                        ((jpegCtx->validHuffmanDcMask & requiredDcMask) == requiredDcMask) &&
-                        ((jpegCtx->validHuffmanAcMask & requiredAcMask) == requiredAcMask);
-
-    if (useVAHuffman) {
-        uint8_t *tmp = ptr;
-        if (writeVAHuffmanTables(&tmp,
-                                 &jpegCtx->huffmanTable,
-                                 requiredDcMask,
-                                 requiredAcMask,
-                                 jpegCtx->validHuffmanDcMask,
-                                 jpegCtx->validHuffmanAcMask)) {
-            ptr = tmp;
+    const uint64_t dhtKey = ((uint64_t)jpegCtx->huffmanGeneration << 16) |
+                            ((uint64_t)scan->requiredDcMask << 8) |
+                            scan->requiredAcMask;
+    if (!useJPEGSegmentCache(drv, &jpegCtx->dhtCache, dhtKey, &ptr)) {
+        uint8_t *dht = ptr;
+        bool useVAHuffman = jpegCtx->hasHuffmanTable &&
+                            ((jpegCtx->validHuffmanDcMask & scan->requiredDcMask) == scan->requiredDcMask) &&
+                            ((jpegCtx->validHuffmanAcMask & scan->requiredAcMask) == scan->requiredAcMask);
+
+        if (useVAHuffman) {
+            uint8_t *tmp = ptr;
+            if (writeVAHuffmanTables(&tmp,
+                                     &jpegCtx->huffmanTable,
+                                     scan->requiredDcMask,
+                                     scan->requiredAcMask,
+                                     jpegCtx->validHuffmanDcMask,
+                                     jpegCtx->validHuffmanAcMask)) {
+                ptr = tmp;
+            } else {
+                ptr = writeStandardHuffmanTables(ptr);
+            }
         } else {
             ptr = writeStandardHuffmanTables(ptr);
         }
-    } else {
-        ptr = writeStandardHuffmanTables(ptr);
+        storeJPEGSegmentCache(&jpegCtx->dhtCache, dhtKey, dht, ptr);
     }
 
     // 4b. DRI (Restart interval) once if consistent across slices
-    if (allSameRestartInterval && slice0->restart_interval != 0U) {
-        ptr = writeDRI(ptr, slice0->restart_interval);
+    if (scan->headerRestartInterval != 0U) {
+        ptr = writeDRI(ptr, scan->headerRestartInterval);
+    }
+
+    *pptr = ptr;
+    return true;
+}
+
+// Reconstruct a complete JPEG frame straight into the end of out.
+static bool reconstructJPEG(NVDriver *drv,
+                            JPEGContext *jpegCtx,
+                            const VASliceParameterBufferJPEGBaseline *slices,
+                            uint32_t sliceCount,
+                            const uint8_t *sliceData,
+                            uint32_t sliceDataSize,
+                            AppendableBuffer *out,
+                            uint32_t *outSize) {
+    JPEGScanInfo scan;
+    if (!validateJPEGPicture(jpegCtx, slices, sliceCount, sliceDataSize, &scan)) {
+        return false;
+    }
+
+    // Worst-case size (overestimate for safety)
+    const uint64_t driSize = (uint64_t)sliceCount * (2U + 2U + 2U);
+    const uint64_t sosSize = (uint64_t)sliceCount * (2U + 2U + 1U + 4U * 2U + 3U);
+    const uint64_t maxSize64 = JPEG_MAX_HEADER_SIZE + driSize + sosSize + scan.totalEcsSize + 2U;
+
+    // The whole bitstream is handed to CUVID with a 32-bit length
+    if (maxSize64 > UINT32_MAX || out->size > UINT32_MAX - maxSize64) {
+        LOG("JPEG: Reconstructed bitstream would overflow CUVID limit (%llu bytes)", (unsigned long long)maxSize64);
+        return false;
+    }
+
+    uint8_t *const frame = (uint8_t *)reserveBuffer(out, maxSize64);
+    uint8_t *ptr = frame;
+
+    if (!writeJPEGHeader(drv, &ptr, jpegCtx, &scan)) {
+        return false;
     }
 
     // 5/6. Scan(s)
-    if (allSameSOSHeader) {
-        ptr = writeSOS(ptr, slice0);
+    if (scan.allSameSOSHeader) {
+        ptr = writeSOS(ptr, &slices[0]);
         for (uint32_t i = 0; i < sliceCount; i++) {
             const VASliceParameterBufferJPEGBaseline *slice = &slices[i];
             memcpy(ptr, sliceData + slice->slice_data_offset, slice->slice_data_size);
@@ -575,7 +668,7 @@ static uint8_t *reconstructJPEG(const JPEGContext *jpegCtx,
             const VASliceParameterBufferJPEGBaseline *slice = &slices[i];
 
             // If restart_interval wasn't consistent globally, emit per-scan DRI.
-            if (!allSameRestartInterval && slice->restart_interval != 0U) {
+            if (!scan.allSameRestartInterval && slice->restart_interval != 0U) {
                 ptr = writeDRI(ptr, slice->restart_interval);
             }
 
@@ -591,15 +684,9 @@ static uint8_t *reconstructJPEG(const JPEGContext *jpegCtx,
         *ptr++ = JPEG_EOI;
     }
 
-    uint64_t frameSize64 = (uint64_t)(ptr - frame);
-    if (frameSize64 > UINT32_MAX) {
-        LOG("JPEG: Reconstructed frame too large (%llu bytes)", (unsigned long long)frameSize64);
-        free(frame);
-        return NULL;
-    }
-
-    *outSize = (uint32_t)frameSize64;
-    return frame;
+    *outSize = (uint32_t)(ptr - frame);
+    out->size += *outSize;
+    return true;
 }
 
 static void copyJPEGPicParam(NVContext *ctx, NVBuffer *buffer, CUVIDPICPARAMS *picParams)
@@ -633,8 +720,24 @@ static void copyJPEGIQMatrix(NVContext *ctx, NVBuffer *buffer, CUVIDPICPARAMS *p
         return;
     }
 
+    // Clients resend the same tables with every frame of an MJPEG stream
+    if (jpegCtx->hasLastIQBuffer && memcmp(&jpegCtx->lastIQBuffer, buf, sizeof(*buf)) == 0) {
+        nvStatsIncrement(ctx->drv, NV_STAT_JPEG_TABLE_CACHE_HITS);
+        return;
+    }
+    nvStatsIncrement(ctx->drv, NV_STAT_JPEG_TABLE_CACHE_MISSES);
+    memcpy(&jpegCtx->lastIQBuffer, buf, sizeof(*buf));
+    jpegCtx->hasLastIQBuffer = true;
+
     for (uint32_t table = 0; table < 4U; table++) {
         if (buf->load_quantiser_table[table] != 0U) {
+            // A different buffer can still carry the tables we have, keep the DQT cache then
+            if ((jpegCtx->validQuantTablesMask & (1U << table)) == 0U ||
+                memcmp(jpegCtx->iqMatrix.quantiser_table[table],
+                       buf->quantiser_table[table],
+                       sizeof(jpegCtx->iqMatrix.quantiser_table[table])) != 0) {
+                jpegCtx->iqGeneration++;
+            }
             memcpy(jpegCtx->iqMatrix.quantiser_table[table],
                    buf->quantiser_table[table],
                    sizeof(jpegCtx->iqMatrix.quantiser_table[table]));
@@ -646,6 +749,23 @@ static void copyJPEGIQMatrix(NVContext *ctx, NVBuffer *buffer, CUVIDPICPARAMS *p
     (void)picParams;
 }
 
+static bool huffmanTableChanged(const VAHuffmanTableBufferJPEGBaseline *current,
+                                const VAHuffmanTableBufferJPEGBaseline *incoming,
+                                uint32_t table) {
+    return memcmp(current->huffman_table[table].num_dc_codes,
+                  incoming->huffman_table[table].num_dc_codes,
+                  sizeof(current->huffman_table[table].num_dc_codes)) != 0 ||
+           memcmp(current->huffman_table[table].dc_values,
+                  incoming->huffman_table[table].dc_values,
+                  sizeof(current->huffman_table[table].dc_values)) != 0 ||
+           memcmp(current->huffman_table[table].num_ac_codes,
+                  incoming->huffman_table[table].num_ac_codes,
+                  sizeof(current->huffman_table[table].num_ac_codes)) != 0 ||
+           memcmp(current->huffman_table[table].ac_values,
+                  incoming->huffman_table[table].ac_values,
+                  sizeof(current->huffman_table[table].ac_values)) != 0;
+}
+
 static void copyJPEGHuffmanTable(NVContext *ctx, NVBuffer *buffer, CUVIDPICPARAMS *picParams)
 {
     VAHuffmanTableBufferJPEGBaseline *buf = (VAHuffmanTableBufferJPEGBaseline *)buffer->ptr;
@@ -655,8 +775,20 @@ static void copyJPEGHuffmanTable(NVContext *ctx, NVBuffer *buffer, CUVIDPICPARAM
         return;
     }
 
+    if (jpegCtx->hasLastHuffmanBuffer && memcmp(&jpegCtx->lastHuffmanBuffer, buf, sizeof(*buf)) == 0) {
+        nvStatsIncrement(ctx->drv, NV_STAT_JPEG_TABLE_CACHE_HITS);
+        return;
+    }
+    nvStatsIncrement(ctx->drv, NV_STAT_JPEG_TABLE_CACHE_MISSES);
+    memcpy(&jpegCtx->lastHuffmanBuffer, buf, sizeof(*buf));
+    jpegCtx->hasLastHuffmanBuffer = true;
+
     for (uint32_t table = 0; table < 2U; table++) {
         if (buf->load_huffman_table[table] != 0U) {
+            if ((jpegCtx->validHuffmanDcMask & (1U << table)) == 0U ||
+                huffmanTableChanged(&jpegCtx->huffmanTable, buf, table)) {
+                jpegCtx->huffmanGeneration++;
+            }
             memcpy(jpegCtx->huffmanTable.huffman_table[table].num_dc_codes,
                    buf->huffman_table[table].num_dc_codes,
                    sizeof(jpegCtx->huffmanTable.huffman_table[table].num_dc_codes));
@@ -711,35 +843,27 @@ static void copyJPEGSliceData(NVContext *ctx, NVBuffer *buf, CUVIDPICPARAMS *pic
         return;
     }
 
+    uint32_t offset = (uint32_t)ctx->bitstreamBuffer.size;
     uint32_t frameSize = 0;
-    uint8_t *frame = reconstructJPEG(jpegCtx,
-                                     slices,
-                                     ctx->lastSliceParamsCount,
-                                     (const uint8_t *)buf->ptr,
-                                     (uint32_t)buf->size,
-                                     &frameSize);
-    if (frame == NULL) {
+    if (!reconstructJPEG(ctx->drv,
+                         jpegCtx,
+                         slices,
+                         ctx->lastSliceParamsCount,
+                         (const uint8_t *)buf->ptr,
+                         (uint32_t)buf->size,
+                         &ctx->bitstreamBuffer,
+                         &frameSize)) {
         LOG("JPEG: Failed to reconstruct JPEG frame");
         return;
     }
 
-    if (ctx->bitstreamBuffer.size > UINT32_MAX - frameSize) {
-        LOG("JPEG: Reconstructed bitstream would overflow CUVID limit");
-        free(frame);
-        return;
-    }
-
     // NVDEC can consume a full JPEG as a single "slice" (same approach as FFmpeg's mjpeg_nvdec)
     picParams->nNumSlices = 1U;
 
-    uint32_t offset = (uint32_t)ctx->bitstreamBuffer.size;
     appendBuffer(&ctx->sliceOffsets, &offset, sizeof(offset));
-    appendBuffer(&ctx->bitstreamBuffer, frame, frameSize);
     picParams->nBitstreamDataLen = (uint32_t)ctx->bitstreamBuffer.size;
 
     LOG("JPEG: Reconstructed %u bytes for NVDEC", frameSize);
-
-    free(frame);
 }
 
 static cudaVideoCodec computeJPEGCudaCodec(VAProfile profile) {
@@ -309,3 +309,1026 @@ const char p010ToArgbPtx[] =
 "DONE:\n"
 "    ret;\n"
 "}\n";
+
+// Single-pass variant of the two kernels above: the source planes are sampled
+// straight from their CUDA arrays through texture objects (unnormalised
+// coordinates, normalised float reads that are scaled back to integer samples
+// by p_sample_max), and the result is written either into the destination
+// array through a surface object, or, when p_dst_surf is 0, to linear memory
+// at p_dst. The integer colour maths is identical to
+// nv12_to_argb/p010_to_argb; NV12 passes p_sample_max=255 and a zero shift.
+//
+// The grid covers the whole p_width x p_height target. Pixels inside the
+// p_dst_* rectangle map back to the source through p_src_x/y + (d + 0.5) *
+// p_scale_x/y, everything else is filled with p_background (already packed in
+// the output byte order). Nearest and bilinear scaling come from the
+// textures' own filter mode; p_filter == 2 selects a cubic B-spline built
+// from four bilinear fetches, so it also needs linearly filtered textures.
+const char yuvToArgbTexPtx[] =
+".version 3.2\n"
+".target sm_30\n"
+".address_size 64\n"
+".func (.param .align 8 .b8 c_ret[8]) cubic_sample(\n"
+"    .param .b64 c_tex,\n"
+"    .param .b32 c_x,\n"
+"    .param .b32 c_y\n"
+")\n"
+"{\n"
+"    .reg .f32 %f<64>;\n"
+"    .reg .b64 %rd<2>;\n"
+"    ld.param.u64 %rd1, [c_tex];\n"
+"    ld.param.f32 %f1, [c_x];\n"
+"    ld.param.f32 %f2, [c_y];\n"
+// integer texel (i) and fraction (t) relative to the texel centres
+"    sub.f32 %f1, %f1, 0f3F000000;\n"
+"    sub.f32 %f2, %f2, 0f3F000000;\n"
+"    cvt.rmi.f32.f32 %f3, %f1;\n"
+"    cvt.rmi.f32.f32 %f4, %f2;\n"
+"    sub.f32 %f5, %f1, %f3;\n"
+"    sub.f32 %f6, %f2, %f4;\n"
+// x weights: w0=(1-t)^3/6 w1=(3t^3-6t^2+4)/6 w3=t^3/6, g0=w0+w1 g1=1-g0,
+// h0=i-0.5+w1/g0 h1=i+1.5+w3/g1
+"    mul.f32 %f7, %f5, %f5;\n"
+"    mul.f32 %f8, %f7, %f5;\n"
+"    mov.f32 %f9, 0f3F800000;\n"
+"    sub.f32 %f9, %f9, %f5;\n"
+"    mul.f32 %f10, %f9, %f9;\n"
+"    mul.f32 %f10, %f10, %f9;\n"
+"    mul.f32 %f10, %f10, 0f3E2AAAAB;\n"
+"    mul.f32 %f11, %f8, 0f40400000;\n"
+"    fma.rn.f32 %f11, %f7, 0fC0C00000, %f11;\n"
+"    add.f32 %f11, %f11, 0f40800000;\n"
+"    mul.f32 %f11, %f11, 0f3E2AAAAB;\n"
+"    mul.f32 %f12, %f8, 0f3E2AAAAB;\n"
+"    add.f32 %f13, %f10, %f11;\n"
+"    mov.f32 %f14, 0f3F800000;\n"
+"    sub.f32 %f14, %f14, %f13;\n"
+"    div.rn.f32 %f15, %f11, %f13;\n"
+"    add.f32 %f15, %f15, %f3;\n"
+"    sub.f32 %f15, %f15, 0f3F000000;\n"
+"    div.rn.f32 %f16, %f12, %f14;\n"
+"    add.f32 %f16, %f16, %f3;\n"
+"    add.f32 %f16, %f16, 0f3FC00000;\n"
+// y weights, same as above: g0=%f23 g1=%f24 h0=%f25 h1=%f26
+"    mul.f32 %f17, %f6, %f6;\n"
+"    mul.f32 %f18, %f17, %f6;\n"
+"    mov.f32 %f19, 0f3F800000;\n"
+"    sub.f32 %f19, %f19, %f6;\n"
+"    mul.f32 %f20, %f19, %f19;\n"
+"    mul.f32 %f20, %f20, %f19;\n"
+"    mul.f32 %f20, %f20, 0f3E2AAAAB;\n"
+"    mul.f32 %f21, %f18, 0f40400000;\n"
+"    fma.rn.f32 %f21, %f17, 0fC0C00000, %f21;\n"
+"    add.f32 %f21, %f21, 0f40800000;\n"
+"    mul.f32 %f21, %f21, 0f3E2AAAAB;\n"
+"    mul.f32 %f22, %f18, 0f3E2AAAAB;\n"
+"    add.f32 %f23, %f20, %f21;\n"
+"    mov.f32 %f24, 0f3F800000;\n"
+"    sub.f32 %f24, %f24, %f23;\n"
+"    div.rn.f32 %f25, %f21, %f23;\n"
+"    add.f32 %f25, %f25, %f4;\n"
+"    sub.f32 %f25, %f25, 0f3F000000;\n"
+"    div.rn.f32 %f26, %f22, %f24;\n"
+"    add.f32 %f26, %f26, %f4;\n"
+"    add.f32 %f26, %f26, 0f3FC00000;\n"
+"    tex.2d.v4.f32.f32 {%f30, %f31, %f32, %f33}, [%rd1, {%f15, %f25}];\n"
+"    tex.2d.v4.f32.f32 {%f34, %f35, %f36, %f37}, [%rd1, {%f16, %f25}];\n"
+"    tex.2d.v4.f32.f32 {%f38, %f39, %f40, %f41}, [%rd1, {%f15, %f26}];\n"
+"    tex.2d.v4.f32.f32 {%f42, %f43, %f44, %f45}, [%rd1, {%f16, %f26}];\n"
+"    mul.f32 %f46, %f34, %f14;\n"
+"    fma.rn.f32 %f46, %f30, %f13, %f46;\n"
+"    mul.f32 %f47, %f42, %f14;\n"
+"    fma.rn.f32 %f47, %f38, %f13, %f47;\n"
+"    mul.f32 %f48, %f47, %f24;\n"
+"    fma.rn.f32 %f48, %f46, %f23, %f48;\n"
+"    mul.f32 %f49, %f35, %f14;\n"
+"    fma.rn.f32 %f49, %f31, %f13, %f49;\n"
+"    mul.f32 %f50, %f43, %f14;\n"
+"    fma.rn.f32 %f50, %f39, %f13, %f50;\n"
+"    mul.f32 %f51, %f50, %f24;\n"
+"    fma.rn.f32 %f51, %f49, %f23, %f51;\n"
+"    st.param.f32 [c_ret+0], %f48;\n"
+"    st.param.f32 [c_ret+4], %f51;\n"
+"    ret;\n"
+"}\n"
+".visible .entry yuv_to_argb_tex(\n"
+"    .param .u64 p_y_tex,\n"
+"    .param .u64 p_uv_tex,\n"
+"    .param .u64 p_dst_surf,\n"
+"    .param .u64 p_dst,\n"
+"    .param .u32 p_width,\n"
+"    .param .u32 p_height,\n"
+"    .param .u32 p_dst_pitch,\n"
+"    .param .u32 p_order,\n"
+"    .param .u32 p_v_to_r,\n"
+"    .param .u32 p_u_to_g,\n"
+"    .param .u32 p_v_to_g,\n"
+"    .param .u32 p_u_to_b,\n"
+"    .param .u32 p_y_scale,\n"
+"    .param .f32 p_sample_max,\n"
+"    .param .u32 p_sample_shift,\n"
+"    .param .u32 p_y_offset,\n"
+"    .param .u32 p_uv_offset,\n"
+"    .param .u32 p_rounding,\n"
+"    .param .u32 p_value_shift,\n"
+"    .param .f32 p_src_x,\n"
+"    .param .f32 p_src_y,\n"
+"    .param .f32 p_scale_x,\n"
+"    .param .f32 p_scale_y,\n"
+"    .param .u32 p_dst_x,\n"
+"    .param .u32 p_dst_y,\n"
+"    .param .u32 p_dst_w,\n"
+"    .param .u32 p_dst_h,\n"
+"    .param .u32 p_filter,\n"
+"    .param .u32 p_background\n"
+")\n"
+"{\n"
+"    .reg .pred %p<8>;\n"
+"    .reg .f32 %f<32>;\n"
+"    .reg .b32 %r<70>;\n"
+"    .reg .b64 %rd<18>;\n"
+"    ld.param.u64 %rd1, [p_y_tex];\n"
+"    ld.param.u64 %rd2, [p_uv_tex];\n"
+"    ld.param.u64 %rd3, [p_dst_surf];\n"
+"    ld.param.u64 %rd4, [p_dst];\n"
+"    ld.param.u32 %r1, [p_width];\n"
+"    ld.param.u32 %r2, [p_height];\n"
+"    ld.param.u32 %r5, [p_dst_pitch];\n"
+"    ld.param.u32 %r6, [p_order];\n"
+"    ld.param.u32 %r40, [p_v_to_r];\n"
+"    ld.param.u32 %r41, [p_u_to_g];\n"
+"    ld.param.u32 %r42, [p_v_to_g];\n"
+"    ld.param.u32 %r43, [p_u_to_b];\n"
+"    ld.param.u32 %r44, [p_y_scale];\n"
+"    ld.param.f32 %f20, [p_sample_max];\n"
+"    ld.param.u32 %r45, [p_sample_shift];\n"
+"    ld.param.u32 %r46, [p_y_offset];\n"
+"    ld.param.u32 %r47, [p_uv_offset];\n"
+"    ld.param.u32 %r48, [p_rounding];\n"
+"    ld.param.u32 %r49, [p_value_shift];\n"
+"    ld.param.f32 %f21, [p_src_x];\n"
+"    ld.param.f32 %f22, [p_src_y];\n"
+"    ld.param.f32 %f23, [p_scale_x];\n"
+"    ld.param.f32 %f24, [p_scale_y];\n"
+"    ld.param.u32 %r56, [p_dst_x];\n"
+"    ld.param.u32 %r57, [p_dst_y];\n"
+"    ld.param.u32 %r58, [p_dst_w];\n"
+"    ld.param.u32 %r59, [p_dst_h];\n"
+"    ld.param.u32 %r62, [p_filter];\n"
+"    ld.param.u32 %r63, [p_background];\n"
+"    mov.u32 %r7, %ctaid.x;\n"
+"    mov.u32 %r8, %ntid.x;\n"
+"    mov.u32 %r9, %tid.x;\n"
+"    mad.lo.u32 %r10, %r7, %r8, %r9;\n"
+"    mov.u32 %r11, %ctaid.y;\n"
+"    mov.u32 %r12, %ntid.y;\n"
+"    mov.u32 %r13, %tid.y;\n"
+"    mad.lo.u32 %r14, %r11, %r12, %r13;\n"
+"    setp.ge.u32 %p1, %r10, %r1;\n"
+"    @%p1 bra DONE;\n"
+"    setp.ge.u32 %p2, %r14, %r2;\n"
+"    @%p2 bra DONE;\n"
+// position inside the output rectangle; pixels left of/above it wrap around
+// and fail the unsigned compare just like the ones right of/below it
+"    sub.u32 %r60, %r10, %r56;\n"
+"    setp.ge.u32 %p3, %r60, %r58;\n"
+"    @%p3 bra BACKGROUND;\n"
+"    sub.u32 %r61, %r14, %r57;\n"
+"    setp.ge.u32 %p3, %r61, %r59;\n"
+"    @%p3 bra BACKGROUND;\n"
+// Source position of the output pixel centre; the chroma plane is half
+// resolution in both directions, so halving the luma position lands on the
+// matching chroma location.
+"    cvt.rn.f32.u32 %f1, %r60;\n"
+"    add.f32 %f1, %f1, 0f3F000000;\n"
+"    fma.rn.f32 %f1, %f1, %f23, %f21;\n"
+"    cvt.rn.f32.u32 %f2, %r61;\n"
+"    add.f32 %f2, %f2, 0f3F000000;\n"
+"    fma.rn.f32 %f2, %f2, %f24, %f22;\n"
+"    mul.f32 %f7, %f1, 0f3F000000;\n"
+"    mul.f32 %f8, %f2, 0f3F000000;\n"
+"    setp.eq.u32 %p5, %r62, 2;\n"
+"    @%p5 bra SAMPLE_CUBIC;\n"
+"    tex.2d.v4.f32.f32 {%f3, %f4, %f5, %f6}, [%rd1, {%f1, %f2}];\n"
+"    tex.2d.v4.f32.f32 {%f9, %f10, %f11, %f12}, [%rd2, {%f7, %f8}];\n"
+"    bra CONVERT;\n"
+"SAMPLE_CUBIC:\n"
+"    {\n"
+"    .param .b64 c_arg0;\n"
+"    .param .b32 c_arg1;\n"
+"    .param .b32 c_arg2;\n"
+"    .param .align 8 .b8 c_val[8];\n"
+"    st.param.b64 [c_arg0], %rd1;\n"
+"    st.param.f32 [c_arg1], %f1;\n"
+"    st.param.f32 [c_arg2], %f2;\n"
+"    call (c_val), cubic_sample, (c_arg0, c_arg1, c_arg2);\n"
+"    ld.param.f32 %f3, [c_val+0];\n"
+"    }\n"
+"    {\n"
+"    .param .b64 c_arg0;\n"
+"    .param .b32 c_arg1;\n"
+"    .param .b32 c_arg2;\n"
+"    .param .align 8 .b8 c_val[8];\n"
+"    st.param.b64 [c_arg0], %rd2;\n"
+"    st.param.f32 [c_arg1], %f7;\n"
+"    st.param.f32 [c_arg2], %f8;\n"
+"    call (c_val), cubic_sample, (c_arg0, c_arg1, c_arg2);\n"
+"    ld.param.f32 %f9, [c_val+0];\n"
+"    ld.param.f32 %f10, [c_val+4];\n"
+"    }\n"
+"CONVERT:\n"
+"    mul.f32 %f3, %f3, %f20;\n"
+"    cvt.rni.s32.f32 %r15, %f3;\n"
+"    shr.u32 %r15, %r15, %r45;\n"
+"    mul.f32 %f9, %f9, %f20;\n"
+"    cvt.rni.s32.f32 %r18, %f9;\n"
+"    shr.u32 %r18, %r18, %r45;\n"
+"    mul.f32 %f10, %f10, %f20;\n"
+"    cvt.rni.s32.f32 %r19, %f10;\n"
+"    shr.u32 %r19, %r19, %r45;\n"
+"    sub.s32 %r20, %r15, %r46;\n"
+"    max.s32 %r20, %r20, 0;\n"
+"    sub.s32 %r21, %r18, %r47;\n"
+"    sub.s32 %r22, %r19, %r47;\n"
+"    mul.lo.s32 %r23, %r20, %r44;\n"
+"    mul.lo.s32 %r24, %r22, %r40;\n"
+"    add.s32 %r25, %r23, %r24;\n"
+"    add.s32 %r25, %r25, %r48;\n"
+"    shr.s32 %r26, %r25, %r49;\n"
+"    max.s32 %r26, %r26, 0;\n"
+"    min.s32 %r26, %r26, 255;\n"
+"    mul.lo.s32 %r27, %r21, %r41;\n"
+"    sub.s32 %r28, %r23, %r27;\n"
+"    mul.lo.s32 %r29, %r22, %r42;\n"
+"    sub.s32 %r30, %r28, %r29;\n"
+"    add.s32 %r30, %r30, %r48;\n"
+"    shr.s32 %r31, %r30, %r49;\n"
+"    max.s32 %r31, %r31, 0;\n"
+"    min.s32 %r31, %r31, 255;\n"
+"    mul.lo.s32 %r32, %r21, %r43;\n"
+"    add.s32 %r33, %r23, %r32;\n"
+"    add.s32 %r33, %r33, %r48;\n"
+"    shr.s32 %r34, %r33, %r49;\n"
+"    max.s32 %r34, %r34, 0;\n"
+"    min.s32 %r34, %r34, 255;\n"
+"    mov.u32 %r35, 255;\n"
+// R=%r26 G=%r31 B=%r34 A=255, packed into %r53 with the same per-order byte
+// layout as the linear kernels.
+"    setp.eq.u32 %p1, %r6, 1;\n"
+"    @%p1 bra PACK_RGBA;\n"
+"    setp.eq.u32 %p2, %r6, 2;\n"
+"    @%p2 bra PACK_ARGB;\n"
+"    setp.eq.u32 %p3, %r6, 3;\n"
+"    @%p3 bra PACK_ABGR;\n"
+"PACK_BGRA:\n"
+"    shl.b32 %r50, %r31, 8;\n"
+"    shl.b32 %r51, %r26, 16;\n"
+"    shl.b32 %r52, %r35, 24;\n"
+"    or.b32 %r53, %r34, %r50;\n"
+"    or.b32 %r53, %r53, %r51;\n"
+"    or.b32 %r53, %r53, %r52;\n"
+"    bra STORE;\n"
+"PACK_RGBA:\n"
+"    shl.b32 %r50, %r31, 8;\n"
+"    shl.b32 %r51, %r34, 16;\n"
+"    shl.b32 %r52, %r35, 24;\n"
+"    or.b32 %r53, %r26, %r50;\n"
+"    or.b32 %r53, %r53, %r51;\n"
+"    or.b32 %r53, %r53, %r52;\n"
+"    bra STORE;\n"
+"PACK_ARGB:\n"
+"    shl.b32 %r50, %r26, 8;\n"
+"    shl.b32 %r51, %r31, 16;\n"
+"    shl.b32 %r52, %r34, 24;\n"
+"    or.b32 %r53, %r35, %r50;\n"
+"    or.b32 %r53, %r53, %r51;\n"
+"    or.b32 %r53, %r53, %r52;\n"
+"    bra STORE;\n"
+"PACK_ABGR:\n"
+"    shl.b32 %r50, %r34, 8;\n"
+"    shl.b32 %r51, %r31, 16;\n"
+"    shl.b32 %r52, %r26, 24;\n"
+"    or.b32 %r53, %r35, %r50;\n"
+"    or.b32 %r53, %r53, %r51;\n"
+"    or.b32 %r53, %r53, %r52;\n"
+"    bra STORE;\n"
+"BACKGROUND:\n"
+"    mov.u32 %r53, %r63;\n"
+"STORE:\n"
+"    setp.eq.u64 %p4, %rd3, 0;\n"
+"    @%p4 bra STORE_LINEAR;\n"
+// surface x coordinates are in bytes
+"    shl.b32 %r54, %r10, 2;\n"
+"    sust.b.2d.b32.trap [%rd3, {%r54, %r14}], {%r53};\n"
+"    bra DONE;\n"
+"STORE_LINEAR:\n"
+"    mul.wide.u32 %rd8, %r14, %r5;\n"
+"    add.u64 %rd8, %rd4, %rd8;\n"
+"    mul.wide.u32 %rd9, %r10, 4;\n"
+"    add.u64 %rd8, %rd8, %rd9;\n"
+"    st.global.u32 [%rd8], %r53;\n"
+"DONE:\n"
+"    ret;\n"
+"}\n";
+
+// Format conversions that don't change the colour values: 4:2:0 semi-planar
+// sources to semi-planar (with 8 <-> 16 bit sample conversion), I420 or YUY2
+// targets, one thread per 2x2 luma block. p_layout is 0 for semi-planar, 1 for
+// I420 and 2 for YUY2; the last two are always 8 bit.
+const char yuvFormatPtx[] =
+".version 3.2\n"
+".target sm_30\n"
+".address_size 64\n"
+".visible .entry yuv420_convert(\n"
+"    .param .u64 p_y,\n"
+"    .param .u64 p_uv,\n"
+"    .param .u64 p_dst0,\n"
+"    .param .u64 p_dst1,\n"
+"    .param .u64 p_dst2,\n"
+"    .param .u32 p_chroma_width,\n"
+"    .param .u32 p_chroma_height,\n"
+"    .param .u32 p_y_pitch,\n"
+"    .param .u32 p_uv_pitch,\n"
+"    .param .u32 p_dst0_pitch,\n"
+"    .param .u32 p_dst1_pitch,\n"
+"    .param .u32 p_dst2_pitch,\n"
+"    .param .u32 p_src_16,\n"
+"    .param .u32 p_dst_16,\n"
+"    .param .u32 p_layout\n"
+")\n"
+"{\n"
+"    .reg .pred %p<8>;\n"
+"    .reg .b32 %r<40>;\n"
+"    .reg .b64 %rd<20>;\n"
+"    ld.param.u64 %rd1, [p_y];\n"
+"    ld.param.u64 %rd2, [p_uv];\n"
+"    ld.param.u64 %rd3, [p_dst0];\n"
+"    ld.param.u64 %rd4, [p_dst1];\n"
+"    ld.param.u64 %rd5, [p_dst2];\n"
+"    ld.param.u32 %r1, [p_chroma_width];\n"
+"    ld.param.u32 %r2, [p_chroma_height];\n"
+"    ld.param.u32 %r3, [p_y_pitch];\n"
+"    ld.param.u32 %r4, [p_uv_pitch];\n"
+"    ld.param.u32 %r5, [p_dst0_pitch];\n"
+"    ld.param.u32 %r6, [p_dst1_pitch];\n"
+"    ld.param.u32 %r7, [p_dst2_pitch];\n"
+"    ld.param.u32 %r8, [p_src_16];\n"
+"    ld.param.u32 %r9, [p_dst_16];\n"
+"    ld.param.u32 %r10, [p_layout];\n"
+"    mov.u32 %r11, %ctaid.x;\n"
+"    mov.u32 %r12, %ntid.x;\n"
+"    mov.u32 %r13, %tid.x;\n"
+"    mad.lo.u32 %r14, %r11, %r12, %r13;\n"
+"    mov.u32 %r11, %ctaid.y;\n"
+"    mov.u32 %r12, %ntid.y;\n"
+"    mov.u32 %r13, %tid.y;\n"
+"    mad.lo.u32 %r15, %r11, %r12, %r13;\n"
+"    setp.ge.u32 %p1, %r14, %r1;\n"
+"    @%p1 bra DONE;\n"
+"    setp.ge.u32 %p2, %r15, %r2;\n"
+"    @%p2 bra DONE;\n"
+// %r16 = first luma row, %r17 = first luma column of the block
+"    shl.b32 %r16, %r15, 1;\n"
+"    shl.b32 %r17, %r14, 1;\n"
+"    shl.b32 %r18, %r17, %r8;\n"
+"    cvt.u64.u32 %rd9, %r18;\n"
+"    mul.wide.u32 %rd6, %r16, %r3;\n"
+"    add.u64 %rd6, %rd1, %rd6;\n"
+"    add.u64 %rd6, %rd6, %rd9;\n"
+"    cvt.u64.u32 %rd7, %r3;\n"
+"    add.u64 %rd10, %rd6, %rd7;\n"
+"    mul.wide.u32 %rd8, %r15, %r4;\n"
+"    add.u64 %rd8, %rd2, %rd8;\n"
+"    add.u64 %rd8, %rd8, %rd9;\n"
+"    setp.ne.u32 %p3, %r8, 0;\n"
+"    @%p3 bra LOAD16;\n"
+"    ld.global.u8 %r20, [%rd6];\n"
+"    ld.global.u8 %r21, [%rd6+1];\n"
+"    ld.global.u8 %r22, [%rd10];\n"
+"    ld.global.u8 %r23, [%rd10+1];\n"
+"    ld.global.u8 %r24, [%rd8];\n"
+"    ld.global.u8 %r25, [%rd8+1];\n"
+"    bra DEPTH;\n"
+"LOAD16:\n"
+"    ld.global.u16 %r20, [%rd6];\n"
+"    ld.global.u16 %r21, [%rd6+2];\n"
+"    ld.global.u16 %r22, [%rd10];\n"
+"    ld.global.u16 %r23, [%rd10+2];\n"
+"    ld.global.u16 %r24, [%rd8];\n"
+"    ld.global.u16 %r25, [%rd8+2];\n"
+"DEPTH:\n"
+"    setp.eq.u32 %p4, %r8, %r9;\n"
+"    @%p4 bra STORE;\n"
+"    @%p3 bra DOWN;\n"
+// 16 bit samples are MSB aligned, so widening is a plain shift
+"    shl.b32 %r20, %r20, 8;\n"
+"    shl.b32 %r21, %r21, 8;\n"
+"    shl.b32 %r22, %r22, 8;\n"
+"    shl.b32 %r23, %r23, 8;\n"
+"    shl.b32 %r24, %r24, 8;\n"
+"    shl.b32 %r25, %r25, 8;\n"
+"    bra STORE;\n"
+"DOWN:\n"
+"    add.u32 %r20, %r20, 128;\n"
+"    add.u32 %r21, %r21, 128;\n"
+"    add.u32 %r22, %r22, 128;\n"
+"    add.u32 %r23, %r23, 128;\n"
+"    add.u32 %r24, %r24, 128;\n"
+"    add.u32 %r25, %r25, 128;\n"
+"    shr.u32 %r20, %r20, 8;\n"
+"    shr.u32 %r21, %r21, 8;\n"
+"    shr.u32 %r22, %r22, 8;\n"
+"    shr.u32 %r23, %r23, 8;\n"
+"    shr.u32 %r24, %r24, 8;\n"
+"    shr.u32 %r25, %r25, 8;\n"
+"    min.u32 %r20, %r20, 255;\n"
+"    min.u32 %r21, %r21, 255;\n"
+"    min.u32 %r22, %r22, 255;\n"
+"    min.u32 %r23, %r23, 255;\n"
+"    min.u32 %r24, %r24, 255;\n"
+"    min.u32 %r25, %r25, 255;\n"
+"STORE:\n"
+"    mul.wide.u32 %rd11, %r16, %r5;\n"
+"    add.u64 %rd11, %rd3, %rd11;\n"
+"    cvt.u64.u32 %rd12, %r5;\n"
+"    setp.eq.u32 %p5, %r10, 2;\n"
+"    @%p5 bra STORE_YUY2;\n"
+"    shl.b32 %r26, %r17, %r9;\n"
+"    cvt.u64.u32 %rd13, %r26;\n"
+"    add.u64 %rd11, %rd11, %rd13;\n"
+"    add.u64 %rd14, %rd11, %rd12;\n"
+"    mul.wide.u32 %rd15, %r15, %r6;\n"
+"    add.u64 %rd15, %rd4, %rd15;\n"
+"    setp.ne.u32 %p6, %r9, 0;\n"
+"    @%p6 bra STORE16;\n"
+"    st.global.u8 [%rd11], %r20;\n"
+"    st.global.u8 [%rd11+1], %r21;\n"
+"    st.global.u8 [%rd14], %r22;\n"
+"    st.global.u8 [%rd14+1], %r23;\n"
+"    setp.eq.u32 %p7, %r10, 1;\n"
+"    @%p7 bra STORE_I420;\n"
+"    add.u64 %rd15, %rd15, %rd13;\n"
+"    st.global.u8 [%rd15], %r24;\n"
+"    st.global.u8 [%rd15+1], %r25;\n"
+"    bra DONE;\n"
+"STORE_I420:\n"
+"    cvt.u64.u32 %rd16, %r14;\n"
+"    add.u64 %rd15, %rd15, %rd16;\n"
+"    st.global.u8 [%rd15], %r24;\n"
+"    mul.wide.u32 %rd17, %r15, %r7;\n"
+"    add.u64 %rd17, %rd5, %rd17;\n"
+"    add.u64 %rd17, %rd17, %rd16;\n"
+"    st.global.u8 [%rd17], %r25;\n"
+"    bra DONE;\n"
+"STORE16:\n"
+"    st.global.u16 [%rd11], %r20;\n"
+"    st.global.u16 [%rd11+2], %r21;\n"
+"    st.global.u16 [%rd14], %r22;\n"
+"    st.global.u16 [%rd14+2], %r23;\n"
+"    add.u64 %rd15, %rd15, %rd13;\n"
+"    st.global.u16 [%rd15], %r24;\n"
+"    st.global.u16 [%rd15+2], %r25;\n"
+"    bra DONE;\n"
+// YUY2: each luma row of the block gets Y0 U Y1 V, the chroma is shared
+"STORE_YUY2:\n"
+"    shl.b32 %r27, %r14, 2;\n"
+"    cvt.u64.u32 %rd13, %r27;\n"
+"    add.u64 %rd11, %rd11, %rd13;\n"
+"    add.u64 %rd14, %rd11, %rd12;\n"
+"    shl.b32 %r28, %r24, 8;\n"
+"    shl.b32 %r29, %r25, 24;\n"
+"    or.b32 %r28, %r28, %r29;\n"
+"    shl.b32 %r30, %r21, 16;\n"
+"    or.b32 %r31, %r20, %r30;\n"
+"    or.b32 %r31, %r31, %r28;\n"
+"    st.global.u32 [%rd11], %r31;\n"
+"    shl.b32 %r30, %r23, 16;\n"
+"    or.b32 %r32, %r22, %r30;\n"
+"    or.b32 %r32, %r32, %r28;\n"
+"    st.global.u32 [%rd14], %r32;\n"
+"DONE:\n"
+"    ret;\n"
+"}\n"
+// Splits packed RGBA (R in the lowest byte) into three 8-bit planes.
+".visible .entry rgba_to_planar(\n"
+"    .param .u64 p_src,\n"
+"    .param .u64 p_r,\n"
+"    .param .u64 p_g,\n"
+"    .param .u64 p_b,\n"
+"    .param .u32 p_width,\n"
+"    .param .u32 p_height,\n"
+"    .param .u32 p_src_pitch,\n"
+"    .param .u32 p_r_pitch,\n"
+"    .param .u32 p_g_pitch,\n"
+"    .param .u32 p_b_pitch\n"
+")\n"
+"{\n"
+"    .reg .pred %p<3>;\n"
+"    .reg .b32 %r<24>;\n"
+"    .reg .b64 %rd<14>;\n"
+"    ld.param.u64 %rd1, [p_src];\n"
+"    ld.param.u64 %rd2, [p_r];\n"
+"    ld.param.u64 %rd3, [p_g];\n"
+"    ld.param.u64 %rd4, [p_b];\n"
+"    ld.param.u32 %r1, [p_width];\n"
+"    ld.param.u32 %r2, [p_height];\n"
+"    ld.param.u32 %r3, [p_src_pitch];\n"
+"    ld.param.u32 %r4, [p_r_pitch];\n"
+"    ld.param.u32 %r5, [p_g_pitch];\n"
+"    ld.param.u32 %r6, [p_b_pitch];\n"
+"    mov.u32 %r7, %ctaid.x;\n"
+"    mov.u32 %r8, %ntid.x;\n"
+"    mov.u32 %r9, %tid.x;\n"
+"    mad.lo.u32 %r10, %r7, %r8, %r9;\n"
+"    mov.u32 %r11, %ctaid.y;\n"
+"    mov.u32 %r12, %ntid.y;\n"
+"    mov.u32 %r13, %tid.y;\n"
+"    mad.lo.u32 %r14, %r11, %r12, %r13;\n"
+"    setp.ge.u32 %p1, %r10, %r1;\n"
+"    @%p1 bra DONE;\n"
+"    setp.ge.u32 %p2, %r14, %r2;\n"
+"    @%p2 bra DONE;\n"
+"    mul.wide.u32 %rd5, %r14, %r3;\n"
+"    add.u64 %rd5, %rd1, %rd5;\n"
+"    mul.wide.u32 %rd6, %r10, 4;\n"
+"    add.u64 %rd5, %rd5, %rd6;\n"
+"    ld.global.u32 %r15, [%rd5];\n"
+"    and.b32 %r16, %r15, 255;\n"
+"    shr.u32 %r17, %r15, 8;\n"
+"    and.b32 %r17, %r17, 255;\n"
+"    shr.u32 %r18, %r15, 16;\n"
+"    and.b32 %r18, %r18, 255;\n"
+"    cvt.u64.u32 %rd7, %r10;\n"
+"    mul.wide.u32 %rd8, %r14, %r4;\n"
+"    add.u64 %rd8, %rd2, %rd8;\n"
+"    add.u64 %rd8, %rd8, %rd7;\n"
+"    st.global.u8 [%rd8], %r16;\n"
+"    mul.wide.u32 %rd9, %r14, %r5;\n"
+"    add.u64 %rd9, %rd3, %rd9;\n"
+"    add.u64 %rd9, %rd9, %rd7;\n"
+"    st.global.u8 [%rd9], %r17;\n"
+"    mul.wide.u32 %rd10, %r14, %r6;\n"
+"    add.u64 %rd10, %rd4, %rd10;\n"
+"    add.u64 %rd10, %rd10, %rd7;\n"
+"    st.global.u8 [%rd10], %r18;\n"
+"DONE:\n"
+"    ret;\n"
+"}\n";
+
+// Rebuilds the lines of the field that isn't kept (row parity != p_parity) of
+// one plane, one thread per sample. Bob averages the kept lines above and
+// below; with a reference frame (p_ref != 0) the woven line is kept where it
+// differs from the reference by no more than p_threshold. Chroma planes are
+// handled as rows of individual samples, U and V alike.
+const char deinterlacePtx[] =
+".version 3.2\n"
+".target sm_30\n"
+".address_size 64\n"
+".visible .entry deinterlace_plane(\n"
+"    .param .u64 p_cur,\n"
+"    .param .u64 p_ref,\n"
+"    .param .u64 p_dst,\n"
+"    .param .u32 p_width,\n"
+"    .param .u32 p_height,\n"
+"    .param .u32 p_pitch,\n"
+"    .param .u32 p_16,\n"
+"    .param .u32 p_parity,\n"
+"    .param .u32 p_threshold\n"
+")\n"
+"{\n"
+"    .reg .pred %p<10>;\n"
+"    .reg .b32 %r<30>;\n"
+"    .reg .b64 %rd<14>;\n"
+"    ld.param.u64 %rd1, [p_cur];\n"
+"    ld.param.u64 %rd2, [p_ref];\n"
+"    ld.param.u64 %rd3, [p_dst];\n"
+"    ld.param.u32 %r1, [p_width];\n"
+"    ld.param.u32 %r2, [p_height];\n"
+"    ld.param.u32 %r3, [p_pitch];\n"
+"    ld.param.u32 %r4, [p_16];\n"
+"    ld.param.u32 %r5, [p_parity];\n"
+"    ld.param.u32 %r6, [p_threshold];\n"
+"    mov.u32 %r7, %ctaid.x;\n"
+"    mov.u32 %r8, %ntid.x;\n"
+"    mov.u32 %r9, %tid.x;\n"
+"    mad.lo.u32 %r10, %r7, %r8, %r9;\n"
+"    mov.u32 %r11, %ctaid.y;\n"
+"    mov.u32 %r12, %ntid.y;\n"
+"    mov.u32 %r13, %tid.y;\n"
+"    mad.lo.u32 %r14, %r11, %r12, %r13;\n"
+"    setp.ge.u32 %p1, %r10, %r1;\n"
+"    @%p1 bra DONE;\n"
+"    setp.ge.u32 %p2, %r14, %r2;\n"
+"    @%p2 bra DONE;\n"
+// %rd5 = offset of the sample, the same in every buffer
+"    shl.b32 %r15, %r10, %r4;\n"
+"    cvt.u64.u32 %rd4, %r15;\n"
+"    mul.wide.u32 %rd5, %r14, %r3;\n"
+"    add.u64 %rd5, %rd5, %rd4;\n"
+"    add.u64 %rd6, %rd1, %rd5;\n"
+"    cvt.u64.u32 %rd7, %r3;\n"
+"    setp.ne.u32 %p4, %r4, 0;\n"
+"    @%p4 ld.global.u16 %r20, [%rd6];\n"
+"    @!%p4 ld.global.u8 %r20, [%rd6];\n"
+"    and.b32 %r16, %r14, 1;\n"
+"    setp.eq.u32 %p3, %r16, %r5;\n"
+"    @%p3 bra STORE;\n"
+// a single line has no neighbours to interpolate from
+"    setp.lt.u32 %p5, %r2, 2;\n"
+"    @%p5 bra STORE;\n"
+"    sub.u64 %rd8, %rd6, %rd7;\n"
+"    add.u64 %rd9, %rd6, %rd7;\n"
+"    setp.eq.u32 %p6, %r14, 0;\n"
+"    @%p6 mov.u64 %rd8, %rd9;\n"
+"    add.u32 %r17, %r14, 1;\n"
+"    setp.ge.u32 %p7, %r17, %r2;\n"
+"    @%p7 mov.u64 %rd9, %rd8;\n"
+"    @%p4 ld.global.u16 %r21, [%rd8];\n"
+"    @!%p4 ld.global.u8 %r21, [%rd8];\n"
+"    @%p4 ld.global.u16 %r22, [%rd9];\n"
+"    @!%p4 ld.global.u8 %r22, [%rd9];\n"
+"    add.u32 %r23, %r21, %r22;\n"
+"    add.u32 %r23, %r23, 1;\n"
+"    shr.u32 %r23, %r23, 1;\n"
+"    setp.eq.u64 %p8, %rd2, 0;\n"
+"    @%p8 bra BOB;\n"
+"    add.u64 %rd10, %rd2, %rd5;\n"
+"    @%p4 ld.global.u16 %r24, [%rd10];\n"
+"    @!%p4 ld.global.u8 %r24, [%rd10];\n"
+"    sub.s32 %r25, %r20, %r24;\n"
+"    abs.s32 %r25, %r25;\n"
+"    setp.le.s32 %p9, %r25, %r6;\n"
+"    @%p9 bra STORE;\n"
+"BOB:\n"
+"    mov.u32 %r20, %r23;\n"
+"STORE:\n"
+"    add.u64 %rd11, %rd3, %rd5;\n"
+"    @%p4 st.global.u16 [%rd11], %r20;\n"
+"    @!%p4 st.global.u8 [%rd11], %r20;\n"
+"DONE:\n"
+"    ret;\n"
+"}\n";
+
+// HDR variant of yuv_to_argb_tex for PQ and HLG sources, done in floating
+// point. The sampled codes are converted with the same matrix as the integer
+// kernels (pre-scaled to [0,1] by the host), the transfer function is undone,
+// the result is gamut mapped with the p_m* matrix in linear light (identity
+// when the output keeps the source primaries) and tone mapped with an
+// extended Reinhard curve on max(R,G,B). p_luminance_scale maps linear light
+// to units of the output's peak and p_inv_white2 is 1 / (source peak / output
+// peak)^2. The output is BT.709 coded, 8 bits per channel.
+//
+// Only the textures' own nearest/bilinear filtering is available here; the
+// host falls back to bilinear for bicubic requests.
+const char hdrToneMapPtx[] =
+".version 3.2\n"
+".target sm_30\n"
+".address_size 64\n"
+// PQ EOTF (relative to 10000 nits) or HLG inverse OETF (scene light) of one channel
+".func (.param .b32 e_ret) hdr_eotf(\n"
+"    .param .b32 e_v,\n"
+"    .param .b32 e_transfer\n"
+")\n"
+"{\n"
+"    .reg .pred %q<3>;\n"
+"    .reg .f32 %g<12>;\n"
+"    .reg .b32 %s<2>;\n"
+"    ld.param.f32 %g1, [e_v];\n"
+"    ld.param.u32 %s1, [e_transfer];\n"
+"    setp.ne.u32 %q1, %s1, 0;\n"
+"    @%q1 bra EOTF_HLG;\n"
+// p = v^(1/m2), L = (max(p - c1, 0) / (c2 - c3 * p))^(1/m1)
+"    lg2.approx.f32 %g2, %g1;\n"
+"    mul.f32 %g2, %g2, 0f3C4FCDAC;\n"
+"    ex2.approx.f32 %g3, %g2;\n"
+"    mov.f32 %g7, 0f3F560000;\n"
+"    sub.f32 %g4, %g3, %g7;\n"
+"    max.f32 %g4, %g4, 0f00000000;\n"
+"    mov.f32 %g8, 0fC1958000;\n"
+"    mov.f32 %g9, 0f4196D000;\n"
+"    fma.rn.f32 %g5, %g3, %g8, %g9;\n"
+"    div.approx.f32 %g6, %g4, %g5;\n"
+"    lg2.approx.f32 %g6, %g6;\n"
+"    mul.f32 %g6, %g6, 0f40C8E06B;\n"
+"    ex2.approx.f32 %g6, %g6;\n"
+"    bra EOTF_DONE;\n"
+"EOTF_HLG:\n"
+"    setp.gt.f32 %q2, %g1, 0f3F000000;\n"
+"    @%q2 bra EOTF_HLG_HIGH;\n"
+// v^2 / 3
+"    mul.f32 %g6, %g1, %g1;\n"
+"    mul.f32 %g6, %g6, 0f3EAAAAAB;\n"
+"    bra EOTF_DONE;\n"
+"EOTF_HLG_HIGH:\n"
+// (exp((v - c) / a) + b) / 12
+"    mov.f32 %g7, 0f3F0F564F;\n"
+"    sub.f32 %g6, %g1, %g7;\n"
+"    mul.f32 %g6, %g6, 0f4101139A;\n"
+"    ex2.approx.f32 %g6, %g6;\n"
+"    add.f32 %g6, %g6, 0f3E91C020;\n"
+"    mul.f32 %g6, %g6, 0f3DAAAAAB;\n"
+"EOTF_DONE:\n"
+"    st.param.f32 [e_ret], %g6;\n"
+"    ret;\n"
+"}\n"
+// BT.709 OETF of one channel in [0,1], returned as an 8-bit code
+".func (.param .b32 o_ret) bt709_oetf(\n"
+"    .param .b32 o_v\n"
+")\n"
+"{\n"
+"    .reg .pred %q<2>;\n"
+"    .reg .f32 %g<6>;\n"
+"    .reg .b32 %s<2>;\n"
+"    ld.param.f32 %g1, [o_v];\n"
+"    cvt.sat.f32.f32 %g1, %g1;\n"
+"    mul.f32 %g2, %g1, 0f40900000;\n"
+"    setp.lt.f32 %q1, %g1, 0f3C9374BC;\n"
+"    @%q1 bra OETF_DONE;\n"
+"    lg2.approx.f32 %g2, %g1;\n"
+"    mul.f32 %g2, %g2, 0f3EE66666;\n"
+"    ex2.approx.f32 %g2, %g2;\n"
+"    mov.f32 %g3, 0f3F8CAC08;\n"
+"    mov.f32 %g4, 0fBDCAC083;\n"
+"    fma.rn.f32 %g2, %g2, %g3, %g4;\n"
+"OETF_DONE:\n"
+"    cvt.sat.f32.f32 %g2, %g2;\n"
+"    mul.f32 %g2, %g2, 0f437F0000;\n"
+"    cvt.rni.u32.f32 %s1, %g2;\n"
+"    st.param.b32 [o_ret], %s1;\n"
+"    ret;\n"
+"}\n"
+".visible .entry yuv_to_argb_hdr(\n"
+"    .param .u64 p_y_tex,\n"
+"    .param .u64 p_uv_tex,\n"
+"    .param .u64 p_dst_surf,\n"
+"    .param .u64 p_dst,\n"
+"    .param .u32 p_width,\n"
+"    .param .u32 p_height,\n"
+"    .param .u32 p_dst_pitch,\n"
+"    .param .u32 p_order,\n"
+"    .param .f32 p_code_scale,\n"
+"    .param .f32 p_y_offset,\n"
+"    .param .f32 p_uv_offset,\n"
+"    .param .f32 p_y_scale,\n"
+"    .param .f32 p_v_to_r,\n"
+"    .param .f32 p_u_to_g,\n"
+"    .param .f32 p_v_to_g,\n"
+"    .param .f32 p_u_to_b,\n"
+"    .param .f32 p_src_x,\n"
+"    .param .f32 p_src_y,\n"
+"    .param .f32 p_scale_x,\n"
+"    .param .f32 p_scale_y,\n"
+"    .param .u32 p_dst_x,\n"
+"    .param .u32 p_dst_y,\n"
+"    .param .u32 p_dst_w,\n"
+"    .param .u32 p_dst_h,\n"
+"    .param .u32 p_background,\n"
+"    .param .u32 p_transfer,\n"
+"    .param .f32 p_luminance_scale,\n"
+"    .param .f32 p_inv_white2,\n"
+"    .param .u32 p_tone_map,\n"
+"    .param .f32 p_m0,\n"
+"    .param .f32 p_m1,\n"
+"    .param .f32 p_m2,\n"
+"    .param .f32 p_m3,\n"
+"    .param .f32 p_m4,\n"
+"    .param .f32 p_m5,\n"
+"    .param .f32 p_m6,\n"
+"    .param .f32 p_m7,\n"
+"    .param .f32 p_m8\n"
+")\n"
+"{\n"
+"    .reg .pred %p<8>;\n"
+"    .reg .f32 %f<70>;\n"
+"    .reg .b32 %r<40>;\n"
+"    .reg .b64 %rd<12>;\n"
+"    ld.param.u64 %rd1, [p_y_tex];\n"
+"    ld.param.u64 %rd2, [p_uv_tex];\n"
+"    ld.param.u64 %rd3, [p_dst_surf];\n"
+"    ld.param.u64 %rd4, [p_dst];\n"
+"    ld.param.u32 %r1, [p_width];\n"
+"    ld.param.u32 %r2, [p_height];\n"
+"    ld.param.u32 %r3, [p_dst_pitch];\n"
+"    ld.param.u32 %r4, [p_order];\n"
+"    ld.param.f32 %f40, [p_code_scale];\n"
+"    ld.param.f32 %f41, [p_y_offset];\n"
+"    ld.param.f32 %f42, [p_uv_offset];\n"
+"    ld.param.f32 %f43, [p_y_scale];\n"
+"    ld.param.f32 %f44, [p_v_to_r];\n"
+"    ld.param.f32 %f45, [p_u_to_g];\n"
+"    ld.param.f32 %f46, [p_v_to_g];\n"
+"    ld.param.f32 %f47, [p_u_to_b];\n"
+"    ld.param.f32 %f48, [p_src_x];\n"
+"    ld.param.f32 %f49, [p_src_y];\n"
+"    ld.param.f32 %f50, [p_scale_x];\n"
+"    ld.param.f32 %f51, [p_scale_y];\n"
+"    ld.param.u32 %r5, [p_dst_x];\n"
+"    ld.param.u32 %r6, [p_dst_y];\n"
+"    ld.param.u32 %r7, [p_dst_w];\n"
+"    ld.param.u32 %r8, [p_dst_h];\n"
+"    ld.param.u32 %r9, [p_background];\n"
+"    ld.param.u32 %r10, [p_transfer];\n"
+"    ld.param.f32 %f52, [p_luminance_scale];\n"
+"    ld.param.f32 %f53, [p_inv_white2];\n"
+"    ld.param.u32 %r11, [p_tone_map];\n"
+"    ld.param.f32 %f60, [p_m0];\n"
+"    ld.param.f32 %f61, [p_m1];\n"
+"    ld.param.f32 %f62, [p_m2];\n"
+"    ld.param.f32 %f63, [p_m3];\n"
+"    ld.param.f32 %f64, [p_m4];\n"
+"    ld.param.f32 %f65, [p_m5];\n"
+"    ld.param.f32 %f66, [p_m6];\n"
+"    ld.param.f32 %f67, [p_m7];\n"
+"    ld.param.f32 %f68, [p_m8];\n"
+"    mov.u32 %r14, %ctaid.x;\n"
+"    mov.u32 %r15, %ntid.x;\n"
+"    mov.u32 %r16, %tid.x;\n"
+"    mad.lo.u32 %r12, %r14, %r15, %r16;\n"
+"    mov.u32 %r17, %ctaid.y;\n"
+"    mov.u32 %r18, %ntid.y;\n"
+"    mov.u32 %r19, %tid.y;\n"
+"    mad.lo.u32 %r13, %r17, %r18, %r19;\n"
+"    setp.ge.u32 %p1, %r12, %r1;\n"
+"    @%p1 bra DONE;\n"
+"    setp.ge.u32 %p2, %r13, %r2;\n"
+"    @%p2 bra DONE;\n"
+// outside the output rectangle, see yuv_to_argb_tex
+"    sub.u32 %r20, %r12, %r5;\n"
+"    setp.ge.u32 %p3, %r20, %r7;\n"
+"    @%p3 bra BACKGROUND;\n"
+"    sub.u32 %r21, %r13, %r6;\n"
+"    setp.ge.u32 %p3, %r21, %r8;\n"
+"    @%p3 bra BACKGROUND;\n"
+"    cvt.rn.f32.u32 %f1, %r20;\n"
+"    add.f32 %f1, %f1, 0f3F000000;\n"
+"    fma.rn.f32 %f1, %f1, %f50, %f48;\n"
+"    cvt.rn.f32.u32 %f2, %r21;\n"
+"    add.f32 %f2, %f2, 0f3F000000;\n"
+"    fma.rn.f32 %f2, %f2, %f51, %f49;\n"
+"    mul.f32 %f7, %f1, 0f3F000000;\n"
+"    mul.f32 %f8, %f2, 0f3F000000;\n"
+"    tex.2d.v4.f32.f32 {%f3, %f4, %f5, %f6}, [%rd1, {%f1, %f2}];\n"
+"    tex.2d.v4.f32.f32 {%f9, %f10, %f11, %f12}, [%rd2, {%f7, %f8}];\n"
+// normalised reads back to sample codes, then Y'CbCr -> R'G'B' in [0,1]
+"    mul.f32 %f3, %f3, %f40;\n"
+"    sub.f32 %f3, %f3, %f41;\n"
+"    max.f32 %f3, %f3, 0f00000000;\n"
+"    mul.f32 %f9, %f9, %f40;\n"
+"    sub.f32 %f9, %f9, %f42;\n"
+"    mul.f32 %f10, %f10, %f40;\n"
+"    sub.f32 %f10, %f10, %f42;\n"
+"    mul.f32 %f13, %f3, %f43;\n"
+"    fma.rn.f32 %f14, %f10, %f44, %f13;\n"
+"    fma.rn.f32 %f15, %f9, %f45, %f13;\n"
+"    fma.rn.f32 %f15, %f10, %f46, %f15;\n"
+"    fma.rn.f32 %f16, %f9, %f47, %f13;\n"
+"    cvt.sat.f32.f32 %f14, %f14;\n"
+"    cvt.sat.f32.f32 %f15, %f15;\n"
+"    cvt.sat.f32.f32 %f16, %f16;\n"
+"    {\n"
+"    .param .b32 e_arg0;\n"
+"    .param .b32 e_arg1;\n"
+"    .param .b32 e_val;\n"
+"    st.param.f32 [e_arg0], %f14;\n"
+"    st.param.b32 [e_arg1], %r10;\n"
+"    call (e_val), hdr_eotf, (e_arg0, e_arg1);\n"
+"    ld.param.f32 %f17, [e_val];\n"
+"    }\n"
+"    {\n"
+"    .param .b32 e_arg0;\n"
+"    .param .b32 e_arg1;\n"
+"    .param .b32 e_val;\n"
+"    st.param.f32 [e_arg0], %f15;\n"
+"    st.param.b32 [e_arg1], %r10;\n"
+"    call (e_val), hdr_eotf, (e_arg0, e_arg1);\n"
+"    ld.param.f32 %f18, [e_val];\n"
+"    }\n"
+"    {\n"
+"    .param .b32 e_arg0;\n"
+"    .param .b32 e_arg1;\n"
+"    .param .b32 e_val;\n"
+"    st.param.f32 [e_arg0], %f16;\n"
+"    st.param.b32 [e_arg1], %r10;\n"
+"    call (e_val), hdr_eotf, (e_arg0, e_arg1);\n"
+"    ld.param.f32 %f19, [e_val];\n"
+"    }\n"
+// HLG OOTF: scale by Ys^(1.2 - 1) with the BT.2020 luminance weights
+"    setp.eq.u32 %p4, %r10, 0;\n"
+"    @%p4 bra LINEAR;\n"
+"    mul.f32 %f20, %f17, 0f3E86809D;\n"
+"    fma.rn.f32 %f20, %f18, 0f3F2D9168, %f20;\n"
+"    fma.rn.f32 %f20, %f19, 0f3D72E48F, %f20;\n"
+"    lg2.approx.f32 %f20, %f20;\n"
+"    mul.f32 %f20, %f20, 0f3E4CCCCD;\n"
+"    ex2.approx.f32 %f20, %f20;\n"
+"    mul.f32 %f17, %f17, %f20;\n"
+"    mul.f32 %f18, %f18, %f20;\n"
+"    mul.f32 %f19, %f19, %f20;\n"
+"LINEAR:\n"
+"    mul.f32 %f17, %f17, %f52;\n"
+"    mul.f32 %f18, %f18, %f52;\n"
+"    mul.f32 %f19, %f19, %f52;\n"
+// gamut mapping, out of gamut colours are clipped
+"    mul.f32 %f21, %f17, %f60;\n"
+"    fma.rn.f32 %f21, %f18, %f61, %f21;\n"
+"    fma.rn.f32 %f21, %f19, %f62, %f21;\n"
+"    mul.f32 %f22, %f17, %f63;\n"
+"    fma.rn.f32 %f22, %f18, %f64, %f22;\n"
+"    fma.rn.f32 %f22, %f19, %f65, %f22;\n"
+"    mul.f32 %f23, %f17, %f66;\n"
+"    fma.rn.f32 %f23, %f18, %f67, %f23;\n"
+"    fma.rn.f32 %f23, %f19, %f68, %f23;\n"
+"    max.f32 %f21, %f21, 0f00000000;\n"
+"    max.f32 %f22, %f22, 0f00000000;\n"
+"    max.f32 %f23, %f23, 0f00000000;\n"
+// m = max(R,G,B), scale by f(m) / m = (1 + m / white^2) / (1 + m)
+"    setp.eq.u32 %p5, %r11, 0;\n"
+"    @%p5 bra ENCODE;\n"
+"    max.f32 %f24, %f21, %f22;\n"
+"    max.f32 %f24, %f24, %f23;\n"
+"    mov.f32 %f25, 0f3F800000;\n"
+"    fma.rn.f32 %f26, %f24, %f53, %f25;\n"
+"    add.f32 %f27, %f24, %f25;\n"
+"    div.approx.f32 %f26, %f26, %f27;\n"
+"    mul.f32 %f21, %f21, %f26;\n"
+"    mul.f32 %f22, %f22, %f26;\n"
+"    mul.f32 %f23, %f23, %f26;\n"
+"ENCODE:\n"
+"    {\n"
+"    .param .b32 o_arg0;\n"
+"    .param .b32 o_val;\n"
+"    st.param.f32 [o_arg0], %f21;\n"
+"    call (o_val), bt709_oetf, (o_arg0);\n"
+"    ld.param.b32 %r22, [o_val];\n"
+"    }\n"
+"    {\n"
+"    .param .b32 o_arg0;\n"
+"    .param .b32 o_val;\n"
+"    st.param.f32 [o_arg0], %f22;\n"
+"    call (o_val), bt709_oetf, (o_arg0);\n"
+"    ld.param.b32 %r23, [o_val];\n"
+"    }\n"
+"    {\n"
+"    .param .b32 o_arg0;\n"
+"    .param .b32 o_val;\n"
+"    st.param.f32 [o_arg0], %f23;\n"
+"    call (o_val), bt709_oetf, (o_arg0);\n"
+"    ld.param.b32 %r24, [o_val];\n"
+"    }\n"
+"    mov.u32 %r25, 255;\n"
+// R=%r22 G=%r23 B=%r24 A=255, packed into %r30 like yuv_to_argb_tex
+"    setp.eq.u32 %p1, %r4, 1;\n"
+"    @%p1 bra PACK_RGBA;\n"
+"    setp.eq.u32 %p2, %r4, 2;\n"
+"    @%p2 bra PACK_ARGB;\n"
+"    setp.eq.u32 %p3, %r4, 3;\n"
+"    @%p3 bra PACK_ABGR;\n"
+"PACK_BGRA:\n"
+"    shl.b32 %r26, %r23, 8;\n"
+"    shl.b32 %r27, %r22, 16;\n"
+"    shl.b32 %r28, %r25, 24;\n"
+"    or.b32 %r30, %r24, %r26;\n"
+"    or.b32 %r30, %r30, %r27;\n"
+"    or.b32 %r30, %r30, %r28;\n"
+"    bra STORE;\n"
+"PACK_RGBA:\n"
+"    shl.b32 %r26, %r23, 8;\n"
+"    shl.b32 %r27, %r24, 16;\n"
+"    shl.b32 %r28, %r25, 24;\n"
+"    or.b32 %r30, %r22, %r26;\n"
+"    or.b32 %r30, %r30, %r27;\n"
+"    or.b32 %r30, %r30, %r28;\n"
+"    bra STORE;\n"
+"PACK_ARGB:\n"
+"    shl.b32 %r26, %r22, 8;\n"
+"    shl.b32 %r27, %r23, 16;\n"
+"    shl.b32 %r28, %r24, 24;\n"
+"    or.b32 %r30, %r25, %r26;\n"
+"    or.b32 %r30, %r30, %r27;\n"
+"    or.b32 %r30, %r30, %r28;\n"
+"    bra STORE;\n"
+"PACK_ABGR:\n"
+"    shl.b32 %r26, %r24, 8;\n"
+"    shl.b32 %r27, %r23, 16;\n"
+"    shl.b32 %r28, %r22, 24;\n"
+"    or.b32 %r30, %r25, %r26;\n"
+"    or.b32 %r30, %r30, %r27;\n"
+"    or.b32 %r30, %r30, %r28;\n"
+"    bra STORE;\n"
+"BACKGROUND:\n"
+"    mov.u32 %r30, %r9;\n"
+"STORE:\n"
+"    setp.eq.u64 %p6, %rd3, 0;\n"
+"    @%p6 bra STORE_LINEAR;\n"
+"    shl.b32 %r31, %r12, 2;\n"
+"    sust.b.2d.b32.trap [%rd3, {%r31, %r13}], {%r30};\n"
+"    bra DONE;\n"
+"STORE_LINEAR:\n"
+"    mul.wide.u32 %rd8, %r13, %r3;\n"
+"    add.u64 %rd8, %rd4, %rd8;\n"
+"    mul.wide.u32 %rd9, %r12, 4;\n"
+"    add.u64 %rd8, %rd8, %rd9;\n"
+"    st.global.u32 [%rd8], %r30;\n"
+"DONE:\n"
+"    ret;\n"
+"}\n";
@@ -3,5 +3,9 @@
 
 extern const char nv12ToArgbPtx[];
 extern const char p010ToArgbPtx[];
+extern const char yuvToArgbTexPtx[];
+extern const char yuvFormatPtx[];
+extern const char deinterlacePtx[];
+extern const char hdrToneMapPtx[];
 
 #endif
@@ -0,0 +1,58 @@
+#include "preallocate.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+int nvPreallocateWorkerCount(int count) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int workerCount = count / PREALLOCATE_SURFACES_PER_WORKER;
+    if (workerCount > PREALLOCATE_MAX_WORKERS) {
+        workerCount = PREALLOCATE_MAX_WORKERS;
+    }
+    if (cpus > 0 && workerCount > cpus - 1) {
+        workerCount = (int) cpus - 1;
+    }
+    return workerCount;
+}
+
+static void preallocateWork(PreallocateWork *work) {
+    int i;
+    while ((i = atomic_fetch_add(&work->next, 1)) < work->count) {
+        if (work->realise(work->ctx, i)) {
+            atomic_fetch_add(&work->realised, 1);
+        }
+    }
+}
+
+static void* preallocateThread(void *param) {
+    PreallocateWork *work = (PreallocateWork*) param;
+    if (work->threadBegin != NULL && !work->threadBegin(work->ctx)) {
+        return NULL;
+    }
+    preallocateWork(work);
+    if (work->threadEnd != NULL) {
+        work->threadEnd(work->ctx);
+    }
+    return NULL;
+}
+
+int nvRunPreallocateWork(PreallocateWork *work, int workerCount) {
+    if (workerCount > PREALLOCATE_MAX_WORKERS) {
+        workerCount = PREALLOCATE_MAX_WORKERS;
+    }
+
+    pthread_t workers[PREALLOCATE_MAX_WORKERS];
+    int started = 0;
+    for (; started < workerCount; started++) {
+        if (pthread_create(&workers[started], NULL, &preallocateThread, work) != 0) {
+            break;
+        }
+    }
+
+    preallocateWork(work);
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    return started + 1;
+}
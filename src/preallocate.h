@@ -0,0 +1,40 @@
+#ifndef PREALLOCATE_H
+#define PREALLOCATE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+//upper bound on the extra threads used to preallocate render targets
+#define PREALLOCATE_MAX_WORKERS 4
+//don't bother starting a worker for fewer surfaces than this
+#define PREALLOCATE_SURFACES_PER_WORKER 4
+
+//realises item index, returns true if it now has a backing image
+typedef bool (*PreallocateRealiseFunc)(void *ctx, int index);
+//run on each worker thread around its share of the items, begin returning
+//false keeps that worker out of the work
+typedef bool (*PreallocateThreadBeginFunc)(void *ctx);
+typedef void (*PreallocateThreadEndFunc)(void *ctx);
+
+typedef struct {
+    PreallocateRealiseFunc      realise;
+    PreallocateThreadBeginFunc  threadBegin;
+    PreallocateThreadEndFunc    threadEnd;
+    void                        *ctx;
+    int                         count;
+    atomic_int                  next;
+    atomic_int                  realised;
+} PreallocateWork;
+
+// Number of extra worker threads worth starting for count items: one per
+// PREALLOCATE_SURFACES_PER_WORKER, at most PREALLOCATE_MAX_WORKERS, and
+// leaving a CPU for the calling thread.
+int nvPreallocateWorkerCount(int count);
+
+// Shares work's items out between the calling thread and up to workerCount
+// short-lived workers, which pull indices from a shared counter, and waits for
+// all of them. threadBegin/threadEnd may be NULL and aren't run on the calling
+// thread. Returns the number of threads that took part, including the caller.
+int nvRunPreallocateWork(PreallocateWork *work, int workerCount);
+
+#endif // PREALLOCATE_H
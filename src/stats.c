@@ -78,10 +78,14 @@ void nvStatsLog(NVDriver *drv, const char *reason) {
                              &borrowedBackingImages, &externalBackingImages,
                              &activeBackingBytes, &detachedBackingBytes);
 
+    const uint64_t reuseHits = atomic_load_explicit(&drv->stats[NV_STAT_BACKING_IMAGE_REUSE_HITS], memory_order_relaxed);
+    const uint64_t reuseMisses = atomic_load_explicit(&drv->stats[NV_STAT_BACKING_IMAGE_REUSE_MISSES], memory_order_relaxed);
+    const double reuseHitRate = reuseHits + reuseMisses > 0 ? 100.0 * (double) reuseHits / (double) (reuseHits + reuseMisses) : 0.0;
+
     struct timespec tp;
     clock_gettime(CLOCK_MONOTONIC, &tp);
     fprintf(out,
-        "%10ld.%09ld [%d-%d] Stats[%s]: decoder_creates=%llu decode_pictures=%llu resolve_frames=%llu export_copies=%llu export_host_copies=%llu export_descriptors=%llu single_descriptors=%llu multi_descriptors=%llu videoproc_requests=%llu videoproc_cuda=%llu videoproc_cuda_failures=%llu videoproc_cpu_fallback=%llu active_backing_images=%u detached_backing_images=%u borrowed_backing_images=%u external_backing_images=%u active_backing_bytes=%llu detached_backing_bytes=%llu detached_backing_limit_bytes=%llu detached_backing_limit_images=%u\n",
+        "%10ld.%09ld [%d-%d] Stats[%s]: decoder_creates=%llu decode_pictures=%llu resolve_frames=%llu export_copies=%llu export_host_copies=%llu export_descriptors=%llu single_descriptors=%llu multi_descriptors=%llu videoproc_requests=%llu videoproc_cuda=%llu videoproc_cuda_failures=%llu videoproc_cpu_fallback=%llu backing_reuse_hits=%llu backing_reuse_misses=%llu backing_reuse_hit_rate=%.1f%% image_pool_hits=%llu image_pool_misses=%llu jpeg_table_cache_hits=%llu jpeg_table_cache_misses=%llu jpeg_segment_cache_hits=%llu jpeg_segment_cache_misses=%llu jpeg_decoder_pool_hits=%llu active_backing_images=%u detached_backing_images=%u borrowed_backing_images=%u external_backing_images=%u active_backing_bytes=%llu detached_backing_bytes=%llu detached_backing_limit_bytes=%llu detached_backing_budget_bytes=%llu detached_backing_limit_images=%u\n",
         (long)tp.tv_sec,
         tp.tv_nsec,
         getpid(),
@@ -99,6 +103,16 @@ void nvStatsLog(NVDriver *drv, const char *reason) {
         (unsigned long long) atomic_load_explicit(&drv->stats[NV_STAT_VIDEOPROC_CUDA], memory_order_relaxed),
         (unsigned long long) atomic_load_explicit(&drv->stats[NV_STAT_VIDEOPROC_CUDA_FAILURES], memory_order_relaxed),
         (unsigned long long) atomic_load_explicit(&drv->stats[NV_STAT_VIDEOPROC_CPU_FALLBACK], memory_order_relaxed),
+        (unsigned long long) reuseHits,
+        (unsigned long long) reuseMisses,
+        reuseHitRate,
+        (unsigned long long) atomic_load_explicit(&drv->stats[NV_STAT_IMAGE_POOL_HITS], memory_order_relaxed),
+        (unsigned long long) atomic_load_explicit(&drv->stats[NV_STAT_IMAGE_POOL_MISSES], memory_order_relaxed),
+        (unsigned long long) atomic_load_explicit(&drv->stats[NV_STAT_JPEG_TABLE_CACHE_HITS], memory_order_relaxed),
+        (unsigned long long) atomic_load_explicit(&drv->stats[NV_STAT_JPEG_TABLE_CACHE_MISSES], memory_order_relaxed),
+        (unsigned long long) atomic_load_explicit(&drv->stats[NV_STAT_JPEG_SEGMENT_CACHE_HITS], memory_order_relaxed),
+        (unsigned long long) atomic_load_explicit(&drv->stats[NV_STAT_JPEG_SEGMENT_CACHE_MISSES], memory_order_relaxed),
+        (unsigned long long) atomic_load_explicit(&drv->stats[NV_STAT_JPEG_DECODER_POOL_HITS], memory_order_relaxed),
         activeBackingImages,
         detachedBackingImages,
         borrowedBackingImages,
@@ -106,6 +120,7 @@ void nvStatsLog(NVDriver *drv, const char *reason) {
         (unsigned long long) activeBackingBytes,
         (unsigned long long) detachedBackingBytes,
         (unsigned long long) drv->maxDetachedBackingImageBytes,
+        (unsigned long long) drv->detachedBackingImageBudgetBytes,
         drv->maxDetachedBackingImages);
     fflush(out);
 }
@@ -14,6 +14,15 @@ typedef enum {
     NV_STAT_VIDEOPROC_CUDA,
     NV_STAT_VIDEOPROC_CUDA_FAILURES,
     NV_STAT_VIDEOPROC_CPU_FALLBACK,
+    NV_STAT_BACKING_IMAGE_REUSE_HITS,
+    NV_STAT_BACKING_IMAGE_REUSE_MISSES,
+    NV_STAT_IMAGE_POOL_HITS,
+    NV_STAT_IMAGE_POOL_MISSES,
+    NV_STAT_JPEG_TABLE_CACHE_HITS,
+    NV_STAT_JPEG_TABLE_CACHE_MISSES,
+    NV_STAT_JPEG_SEGMENT_CACHE_HITS,
+    NV_STAT_JPEG_SEGMENT_CACHE_MISSES,
+    NV_STAT_JPEG_DECODER_POOL_HITS,
     NV_STAT_COUNT
 } NVStatCounter;
 
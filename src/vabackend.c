@@ -3,6 +3,8 @@
 #include "vabackend.h"
 #include "backend-common.h"
 #include "kernels.h"
+#include "convert-cpu.h"
+#include "preallocate.h"
 
 #include <assert.h>
 #include <stdio.h>
@@ -16,6 +18,7 @@
 #include <sys/stat.h>
 
 #include <va/va_backend.h>
+#include <va/va_backend_vpp.h>
 #include <va/va_drmcommon.h>
 #include <va/va_vpp.h>
 
@@ -77,6 +80,22 @@ static uint32_t max_instances;
 static CudaFunctions *cu;
 static CuvidFunctions *cv;
 
+// Surface objects aren't part of ffnvcodec's CudaFunctions, so they are
+// resolved from libcuda directly. Both stay NULL if that fails, in which case
+// VideoProc falls back to writing through a linear scratch buffer.
+typedef CUresult CUDAAPI tcuSurfObjectCreate_l(unsigned long long *surfObject, const CUDA_RESOURCE_DESC *resDesc);
+typedef CUresult CUDAAPI tcuSurfObjectDestroy_l(unsigned long long surfObject);
+static void *libcudaExtra;
+static tcuSurfObjectCreate_l *cuSurfObjectCreate_l;
+static tcuSurfObjectDestroy_l *cuSurfObjectDestroy_l;
+
+// Likewise for page-locked host memory; without it, host copies of surfaces
+// use ordinary memory and the copies into it aren't straight DMA transfers.
+typedef CUresult CUDAAPI tcuMemHostAlloc_l(void **pp, size_t bytesize, unsigned int flags);
+typedef CUresult CUDAAPI tcuMemFreeHost_l(void *p);
+static tcuMemHostAlloc_l *cuMemHostAlloc_l;
+static tcuMemFreeHost_l *cuMemFreeHost_l;
+
 extern const NVCodec __start_nvd_codecs[];
 extern const NVCodec __stop_nvd_codecs[];
 
@@ -84,6 +103,10 @@ static FILE *LOG_OUTPUT;
 static FILE *STATS_OUTPUT;
 static bool LOG_DEBUG_ENABLED;
 static bool SINGLE_BUFFER_FORCED;
+static bool PREALLOCATE_SURFACES;
+static cudaVideoDeinterlaceMode DECODER_DEINTERLACE_MODE = cudaVideoDeinterlaceMode_Weave;
+static float TONEMAP_PEAK = 100.0f;
+static uint32_t JPEG_POOL_MAX_DIMENSION = 0;
 
 // Destination for the statistics dump: the dedicated stats log if one was opened
 // (NVD_STATS_LOG), otherwise the regular log stream. Used by the stats subsystem.
@@ -103,6 +126,24 @@ static const uint64_t MIN_DYNAMIC_DETACHED_BACKING_IMAGE_BYTES = 64ULL * 1024ULL
 static const uint64_t MAX_DYNAMIC_DETACHED_BACKING_IMAGE_BYTES = 512ULL * 1024ULL * 1024ULL;
 static const uint32_t DEFAULT_MAX_DETACHED_BACKING_IMAGES = 16;
 
+//rows converted per unit of work handed to a CPU VideoProc thread
+#define VIDEO_PROC_CPU_BAND_ROWS 32
+//largest 8-bit sample difference from the previous frame still treated as static when deinterlacing
+#define VIDEO_PROC_DEINTERLACE_MOTION_THRESHOLD 10
+//ITU-T H.273 code points used by VAProcColorProperties
+#define VIDEO_PROC_PRIMARIES_BT2020 9
+#define VIDEO_PROC_TRANSFER_CHARACTERISTICS_PQ 16
+#define VIDEO_PROC_TRANSFER_CHARACTERISTICS_HLG 18
+//peak luminance assumed for HDR sources without metadata (BT.2100's nominal HLG display), and for SDR output
+#define VIDEO_PROC_HDR_DEFAULT_PEAK 1000.0f
+#define VIDEO_PROC_SDR_PEAK 100.0f
+
+//idle decoders kept by the JPEG throughput mode (NVD_JPEG_POOL)
+#define JPEG_DECODER_POOL_CAPACITY 4
+
+//freed VAImage buffers kept for reuse, enough for a client cycling through a few readback images
+#define IMAGE_POOL_MAX_ENTRIES 4
+
 static int gpu = -1;
 static enum {
     EGL, DIRECT
@@ -120,6 +161,10 @@ const NVFormatInfo formatsInfo[] =
     [NV_FORMAT_Q416] = {2, 3, DRM_FORMAT_INVALID,  true,  true,  {{1, DRM_FORMAT_R16,      {0,0}}, {1, DRM_FORMAT_R16,    {0,0}}, {1, DRM_FORMAT_R16,{0,0}}}, {VA_FOURCC_Q416, VA_LSB_FIRST,   48, 0,0,0,0,0}},
 #endif
     [NV_FORMAT_ARGB] = {1, 1, VA_FOURCC_ARGB,      false, false, {{4, DRM_FORMAT_ARGB8888, {0,0}}},                            {VA_FOURCC_ARGB, VA_LSB_FIRST,   32, 0,0,0,0,0}},
+    //VideoProc output only
+    [NV_FORMAT_I420] = {1, 3, DRM_FORMAT_YUV420,   false, false, {{1, DRM_FORMAT_R8,       {0,0}}, {1, DRM_FORMAT_R8,     {1,1}}, {1, DRM_FORMAT_R8, {1,1}}}, {VA_FOURCC_I420, VA_LSB_FIRST,   12, 0,0,0,0,0}},
+    [NV_FORMAT_YUY2] = {1, 1, DRM_FORMAT_YUYV,     false, false, {{2, DRM_FORMAT_YUYV,     {0,0}}},                            {VA_FOURCC_YUY2, VA_LSB_FIRST,   16, 0,0,0,0,0}},
+    [NV_FORMAT_RGBP] = {1, 3, DRM_FORMAT_INVALID,  false, false, {{1, DRM_FORMAT_R8,       {0,0}}, {1, DRM_FORMAT_R8,     {0,0}}, {1, DRM_FORMAT_R8, {0,0}}}, {VA_FOURCC_RGBP, VA_LSB_FIRST,   24, 0,0,0,0,0}},
 };
 
 static NVFormat nvFormatFromVaFormat(uint32_t fourcc) {
@@ -142,6 +187,13 @@ static bool isRgbFourcc(uint32_t fourcc) {
            fourcc == VA_FOURCC_BGRX;
 }
 
+//formats only VideoProc can produce, the surface has to remember which one it was created as
+static bool isVideoProcOutputFourcc(uint32_t fourcc) {
+    return fourcc == VA_FOURCC_I420 ||
+           fourcc == VA_FOURCC_YUY2 ||
+           fourcc == VA_FOURCC_RGBP;
+}
+
 static NVFormat nvFormatFromSurfaceFourcc(uint32_t fourcc) {
     if (isRgbFourcc(fourcc)) {
         return NV_FORMAT_ARGB;
@@ -227,6 +279,22 @@ static void init() {
     // Global toggle read once here (like every other NVD_* env) instead of via a
     // getenv on each surface allocation in the direct backend.
     SINGLE_BUFFER_FORCED = getenv("NVD_SINGLE_BUFFER") != NULL;
+    char *nvdPreallocate = getenv("NVD_PREALLOCATE_SURFACES");
+    PREALLOCATE_SURFACES = nvdPreallocate != NULL && strcmp(nvdPreallocate, "0") != 0;
+    char *nvdDeinterlace = getenv("NVD_DEINTERLACE");
+    if (nvdDeinterlace != NULL && strcmp(nvdDeinterlace, "bob") == 0) {
+        DECODER_DEINTERLACE_MODE = cudaVideoDeinterlaceMode_Bob;
+    } else if (nvdDeinterlace != NULL && strcmp(nvdDeinterlace, "adaptive") == 0) {
+        DECODER_DEINTERLACE_MODE = cudaVideoDeinterlaceMode_Adaptive;
+    }
+    char *nvdTonemapPeak = getenv("NVD_TONEMAP_PEAK");
+    if (nvdTonemapPeak != NULL && atof(nvdTonemapPeak) > 0) {
+        TONEMAP_PEAK = (float) atof(nvdTonemapPeak);
+    }
+    char *nvdJpegPool = getenv("NVD_JPEG_POOL");
+    if (nvdJpegPool != NULL && atoi(nvdJpegPool) > 0) {
+        JPEG_POOL_MAX_DIMENSION = (uint32_t) atoi(nvdJpegPool);
+    }
     char *nvdStats = getenv("NVD_STATS");
     if (nvdStats != NULL && strcmp(nvdStats, "0") != 0) {
         char *nvdStatsLog = getenv("NVD_STATS_LOG");
@@ -294,6 +362,23 @@ static void init() {
 
     //Not really much we can do here to abort the loading of the library
     CHECK_CUDA_RESULT(cu->cuInit(0));
+
+    //libcuda is already loaded by cuda_load_functions, this just takes another reference
+    libcudaExtra = dlopen("libcuda.so.1", RTLD_NOW | RTLD_NOLOAD);
+    if (libcudaExtra != NULL) {
+        cuSurfObjectCreate_l = (tcuSurfObjectCreate_l *) dlsym(libcudaExtra, "cuSurfObjectCreate");
+        cuSurfObjectDestroy_l = (tcuSurfObjectDestroy_l *) dlsym(libcudaExtra, "cuSurfObjectDestroy");
+        if (cuSurfObjectCreate_l == NULL || cuSurfObjectDestroy_l == NULL) {
+            cuSurfObjectCreate_l = NULL;
+            cuSurfObjectDestroy_l = NULL;
+        }
+        cuMemHostAlloc_l = (tcuMemHostAlloc_l *) dlsym(libcudaExtra, "cuMemHostAlloc");
+        cuMemFreeHost_l = (tcuMemFreeHost_l *) dlsym(libcudaExtra, "cuMemFreeHost");
+        if (cuMemHostAlloc_l == NULL || cuMemFreeHost_l == NULL) {
+            cuMemHostAlloc_l = NULL;
+            cuMemFreeHost_l = NULL;
+        }
+    }
 }
 
 __attribute__ ((destructor))
@@ -301,6 +386,14 @@ static void cleanup() {
     if (cv != NULL) {
         cuvid_free_functions(&cv);
     }
+    if (libcudaExtra != NULL) {
+        cuSurfObjectCreate_l = NULL;
+        cuSurfObjectDestroy_l = NULL;
+        cuMemHostAlloc_l = NULL;
+        cuMemFreeHost_l = NULL;
+        dlclose(libcudaExtra);
+        libcudaExtra = NULL;
+    }
     if (cu != NULL) {
         cuda_free_functions(&cu);
     }
@@ -412,7 +505,7 @@ bool checkCudaErrors(CUresult err, const char *file, const char *function, const
     return false;
 }
 
-void appendBuffer(AppendableBuffer *ab, const void *buf, uint64_t size) {
+static void ensureBufferSpace(AppendableBuffer *ab, uint64_t size) {
   if (ab->buf == NULL) {
       ab->allocated = size*2;
       ab->buf = memalign(16, ab->allocated);
@@ -426,6 +519,15 @@ void appendBuffer(AppendableBuffer *ab, const void *buf, uint64_t size) {
       free(ab->buf);
       ab->buf = nb;
   }
+}
+
+void *reserveBuffer(AppendableBuffer *ab, uint64_t size) {
+  ensureBufferSpace(ab, size);
+  return PTROFF(ab->buf, ab->size);
+}
+
+void appendBuffer(AppendableBuffer *ab, const void *buf, uint64_t size) {
+  ensureBufferSpace(ab, size);
   memcpy(PTROFF(ab->buf, ab->size), buf, size);
   ab->size += size;
 }
@@ -439,6 +541,118 @@ static void freeBuffer(AppendableBuffer *ab) {
   }
 }
 
+// Host memory for copies of surfaces, page-locked when libcuda lets us so the
+// copies are plain DMA transfers. *pinned says which kind it is, to pass back
+// to freeHostCopyMemory. Pinned allocations need the CUDA context current.
+static void *allocHostCopyMemory(size_t size, bool *pinned) {
+    void *ptr = NULL;
+    if (cuMemHostAlloc_l != NULL && cuMemHostAlloc_l(&ptr, size, 0) == CUDA_SUCCESS) {
+        *pinned = true;
+        return ptr;
+    }
+    *pinned = false;
+    return memalign(16, size);
+}
+
+static void freeHostCopyMemory(void *ptr, bool pinned) {
+    if (ptr == NULL) {
+        return;
+    }
+    if (pinned) {
+        CHECK_CUDA_RESULT(cuMemFreeHost_l(ptr));
+    } else {
+        free(ptr);
+    }
+}
+
+// freeHostCopyMemory for callers that don't have the CUDA context current.
+static void releaseHostCopyMemory(NVDriver *drv, void *ptr, bool pinned) {
+    if (!pinned) {
+        free(ptr);
+    } else if (!CHECK_CUDA_RESULT(cu->cuCtxPushCurrent(drv->cudaContext))) {
+        freeHostCopyMemory(ptr, true);
+        CHECK_CUDA_RESULT(cu->cuCtxPopCurrent(NULL));
+    }
+}
+
+// Frees the memory behind an image buffer, unless it belongs to a surface.
+static void freeImageBufferMemory(NVDriver *drv, NVBuffer *buf) {
+    if (buf->ptr == NULL || buf->derivedSurface != NULL) {
+        return;
+    }
+    releaseHostCopyMemory(drv, buf->ptr, buf->pinned);
+    buf->ptr = NULL;
+}
+
+typedef struct {
+    NVFormat    format;
+    int         width;
+    int         height;
+    void        *ptr;
+    bool        pinned;
+} ImagePoolEntry;
+
+// Hands buf the memory of a destroyed image with the same format and size, if
+// the pool has one. The most recently returned entry is preferred, as it's the
+// likeliest to still be in cache.
+static bool takePooledImageMemory(NVDriver *drv, NVFormat format, int width, int height, NVBuffer *buf) {
+    bool found = false;
+    pthread_mutex_lock(&drv->imagePoolMutex);
+    ARRAY_FOR_EACH_REV(ImagePoolEntry*, entry, &drv->imagePool)
+        if (entry->format == format && entry->width == width && entry->height == height) {
+            buf->ptr = entry->ptr;
+            buf->pinned = entry->pinned;
+            remove_and_free_element_at(&drv->imagePool, entry_idx);
+            found = true;
+            break;
+        }
+    END_FOR_EACH
+    pthread_mutex_unlock(&drv->imagePoolMutex);
+
+    nvStatsIncrement(drv, found ? NV_STAT_IMAGE_POOL_HITS : NV_STAT_IMAGE_POOL_MISSES);
+    return found;
+}
+
+// Moves an image's memory into the pool, evicting the oldest entry when it's full.
+static void returnImageMemoryToPool(NVDriver *drv, NVImage *img) {
+    NVBuffer *buf = img->imageBuffer;
+    if (buf->ptr == NULL || buf->derivedSurface != NULL) {
+        return;
+    }
+
+    ImagePoolEntry *evicted = NULL;
+    pthread_mutex_lock(&drv->imagePoolMutex);
+    if (drv->imagePool.size >= IMAGE_POOL_MAX_ENTRIES) {
+        evicted = (ImagePoolEntry*) get_element_at(&drv->imagePool, 0);
+        remove_element_at(&drv->imagePool, 0);
+    }
+    ImagePoolEntry *entry = (ImagePoolEntry*) alloc_and_add_element(&drv->imagePool, sizeof(ImagePoolEntry));
+    entry->format = img->format;
+    entry->width = img->width;
+    entry->height = img->height;
+    entry->ptr = buf->ptr;
+    entry->pinned = buf->pinned;
+    pthread_mutex_unlock(&drv->imagePoolMutex);
+    buf->ptr = NULL;
+
+    if (evicted != NULL) {
+        releaseHostCopyMemory(drv, evicted->ptr, evicted->pinned);
+        free(evicted);
+    }
+}
+
+//expects the CUDA context to be current
+static void drainImagePool(NVDriver *drv) {
+    pthread_mutex_lock(&drv->imagePoolMutex);
+    ARRAY_FOR_EACH(ImagePoolEntry*, entry, &drv->imagePool)
+        freeHostCopyMemory(entry->ptr, entry->pinned);
+        free(entry);
+    END_FOR_EACH
+    free(drv->imagePool.buf);
+    drv->imagePool = (Array) { 0 };
+    pthread_mutex_unlock(&drv->imagePoolMutex);
+}
+
 static Object allocateObject(NVDriver *drv, ObjectType type, size_t allocatePtrSize) {
     Object newObj = (Object) calloc(1, sizeof(struct Object_t));
 
@@ -514,6 +728,19 @@ static void deleteObject(NVDriver *drv, VAGenericID id) {
     pthread_mutex_unlock(&drv->objectCreationMutex);
 }
 
+//the arrays of a VideoProc-private image, like the deinterlacer's output
+static void destroyVideoProcImage(BackingImage *img) {
+    if (img == NULL) {
+        return;
+    }
+    for (int i = 0; i < 3; i++) {
+        if (img->arrays[i] != NULL) {
+            CHECK_CUDA_RESULT(cu->cuArrayDestroy(img->arrays[i]));
+        }
+    }
+    free(img);
+}
+
 static bool destroyContext(NVDriver *drv, NVContext *nvCtx) {
     CHECK_CUDA_RESULT_RETURN(cu->cuCtxPushCurrent(drv->cudaContext), false);
 
@@ -535,8 +762,48 @@ static bool destroyContext(NVDriver *drv, NVContext *nvCtx) {
         LOG("Finished waiting for resolve thread with %d", ret);
     }
 
-    free(nvCtx->codecData);
-    nvCtx->codecData = NULL;
+    if (nvCtx->codecData != NULL) {
+        if (nvCtx->codec != NULL && nvCtx->codec->destroyContext != NULL) {
+            nvCtx->codec->destroyContext(nvCtx);
+        } else {
+            free(nvCtx->codecData);
+        }
+        nvCtx->codecData = NULL;
+    }
+
+    if (nvCtx->videoProcYBuffer != 0) {
+        CHECK_CUDA_RESULT(cu->cuMemFree(nvCtx->videoProcYBuffer));
+        nvCtx->videoProcYBuffer = 0;
+    }
+    if (nvCtx->videoProcUVBuffer != 0) {
+        CHECK_CUDA_RESULT(cu->cuMemFree(nvCtx->videoProcUVBuffer));
+        nvCtx->videoProcUVBuffer = 0;
+    }
+    if (nvCtx->videoProcArgbBuffer != 0) {
+        CHECK_CUDA_RESULT(cu->cuMemFree(nvCtx->videoProcArgbBuffer));
+        nvCtx->videoProcArgbBuffer = 0;
+    }
+    if (nvCtx->videoProcOutBuffer != 0) {
+        CHECK_CUDA_RESULT(cu->cuMemFree(nvCtx->videoProcOutBuffer));
+        nvCtx->videoProcOutBuffer = 0;
+    }
+    if (nvCtx->videoProcDeintBuffer != 0) {
+        CHECK_CUDA_RESULT(cu->cuMemFree(nvCtx->videoProcDeintBuffer));
+        nvCtx->videoProcDeintBuffer = 0;
+    }
+    destroyVideoProcImage(nvCtx->videoProcDeintImage);
+    nvCtx->videoProcDeintImage = NULL;
+    //nvRenderPicture always flushes its batch, so nothing is pending here
+    free(nvCtx->videoProcPending);
+    nvCtx->videoProcPending = NULL;
+    nvCtx->videoProcPendingCapacity = 0;
+    free(nvCtx->videoProcCpuScratch);
+    nvCtx->videoProcCpuScratch = NULL;
+    nvCtx->videoProcCpuScratchSize = 0;
+    if (nvCtx->videoProcStream != NULL) {
+        CHECK_CUDA_RESULT(cu->cuStreamDestroy(nvCtx->videoProcStream));
+        nvCtx->videoProcStream = NULL;
+    }
 
     freeBuffer(&nvCtx->sliceOffsets);
     freeBuffer(&nvCtx->bitstreamBuffer);
@@ -608,6 +875,198 @@ static bool doesGPUSupportCodec(cudaVideoCodec codec, int bitDepth, cudaVideoChr
     return (videoDecodeCaps.bIsSupported == 1);
 }
 
+// JPEG throughput mode. Decoders are created for pictures up to
+// JPEG_POOL_MAX_DIMENSION on each side and returned to the driver when their
+// context is destroyed. A new context, or a picture of a different size, then
+// only needs cuvidReconfigureDecoder instead of a new decoder.
+typedef struct {
+    CUvideodecoder          decoder;
+    cudaVideoSurfaceFormat  surfaceFormat;
+    cudaVideoChromaFormat   chromaFormat;
+    int                     bitDepth;
+    int                     surfaceCount;
+    uint32_t                maxWidth;
+    uint32_t                maxHeight;
+    uint32_t                width;
+    uint32_t                height;
+} PooledDecoder;
+
+static bool useJPEGDecoderPool(cudaVideoCodec codec, uint32_t width, uint32_t height) {
+    return codec == cudaVideoCodec_JPEG && JPEG_POOL_MAX_DIMENSION > 0 &&
+           width <= JPEG_POOL_MAX_DIMENSION && height <= JPEG_POOL_MAX_DIMENSION;
+}
+
+// Points a pooled decoder at width x height pictures, which must fit in the
+// size it was created for. Pictures still queued for the resolve thread would be
+// mapped with the new size, so callers wait for it to go idle first. Expects
+// the CUDA context to be current.
+static bool reconfigurePooledDecoder(CUvideodecoder decoder, cudaVideoChromaFormat chromaFormat, int surfaceCount,
+                                     uint32_t width, uint32_t height) {
+    uint32_t display_area_width = width;
+    uint32_t display_area_height = height;
+    switch(chromaFormat) {
+        case cudaVideoChromaFormat_422:
+            display_area_width = ROUND_UP(display_area_width, 2);
+            break;
+        case cudaVideoChromaFormat_420:
+            display_area_width = ROUND_UP(display_area_width, 2);
+            display_area_height = ROUND_UP(display_area_height, 2);
+            break;
+        default:
+            break;
+    }
+
+    CUVIDRECONFIGUREDECODERINFO info = {
+        .ulWidth             = width,
+        .ulHeight            = height,
+        .ulTargetWidth       = width,
+        .ulTargetHeight      = height,
+        .ulNumDecodeSurfaces = surfaceCount,
+        .display_area.right  = (short) display_area_width,
+        .display_area.bottom = (short) display_area_height,
+    };
+    return !CHECK_CUDA_RESULT(cv->cuvidReconfigureDecoder(decoder, &info));
+}
+
+// Takes an idle pooled decoder matching vdci's output format, or creates one at
+// the pool's maximum size, and configures it for vdci's picture size. Expects
+// the CUDA context to be current.
+static bool acquirePooledJPEGDecoder(NVDriver *drv, const CUVIDDECODECREATEINFO *vdci, PooledDecoder *out) {
+    PooledDecoder found = { 0 };
+
+    pthread_mutex_lock(&drv->jpegDecoderPoolMutex);
+    ARRAY_FOR_EACH(PooledDecoder*, entry, &drv->jpegDecoderPool)
+        if (entry->surfaceFormat == vdci->OutputFormat && entry->chromaFormat == vdci->ChromaFormat &&
+            entry->bitDepth == (int) vdci->bitDepthMinus8 + 8 && entry->surfaceCount >= (int) vdci->ulNumDecodeSurfaces &&
+            entry->maxWidth >= vdci->ulWidth && entry->maxHeight >= vdci->ulHeight) {
+            found = *entry;
+            remove_and_free_element_at(&drv->jpegDecoderPool, entry_idx);
+            break;
+        }
+    END_FOR_EACH
+    pthread_mutex_unlock(&drv->jpegDecoderPoolMutex);
+
+    if (found.decoder != NULL) {
+        nvStatsIncrement(drv, NV_STAT_JPEG_DECODER_POOL_HITS);
+        if (found.width != vdci->ulWidth || found.height != vdci->ulHeight) {
+            if (!reconfigurePooledDecoder(found.decoder, found.chromaFormat, found.surfaceCount,
+                                          (uint32_t) vdci->ulWidth, (uint32_t) vdci->ulHeight)) {
+                CHECK_CUDA_RESULT(cv->cuvidDestroyDecoder(found.decoder));
+                return false;
+            }
+            found.width = (uint32_t) vdci->ulWidth;
+            found.height = (uint32_t) vdci->ulHeight;
+        }
+        *out = found;
+        return true;
+    }
+
+    uint32_t capsWidth = 0, capsHeight = 0;
+    if (!doesGPUSupportCodec(cudaVideoCodec_JPEG, (int) vdci->bitDepthMinus8 + 8, vdci->ChromaFormat, &capsWidth, &capsHeight)) {
+        return false;
+    }
+    CUVIDDECODECREATEINFO poolVdci = *vdci;
+    poolVdci.ulMaxWidth = MAX(MIN(JPEG_POOL_MAX_DIMENSION, capsWidth), vdci->ulWidth);
+    poolVdci.ulMaxHeight = MAX(MIN(JPEG_POOL_MAX_DIMENSION, capsHeight), vdci->ulHeight);
+    if (CHECK_CUDA_RESULT(cv->cuvidCreateDecoder(&found.decoder, &poolVdci))) {
+        return false;
+    }
+    nvStatsIncrement(drv, NV_STAT_DECODER_CREATES);
+
+    found.surfaceFormat = vdci->OutputFormat;
+    found.chromaFormat = vdci->ChromaFormat;
+    found.bitDepth = (int) vdci->bitDepthMinus8 + 8;
+    found.surfaceCount = (int) vdci->ulNumDecodeSurfaces;
+    found.maxWidth = (uint32_t) poolVdci.ulMaxWidth;
+    found.maxHeight = (uint32_t) poolVdci.ulMaxHeight;
+    found.width = (uint32_t) vdci->ulWidth;
+    found.height = (uint32_t) vdci->ulHeight;
+    *out = found;
+    return true;
+}
+
+static void adoptPooledDecoder(NVContext *nvCtx, const PooledDecoder *pooled) {
+    nvCtx->decoder = pooled->decoder;
+    nvCtx->decoderPooled = true;
+    nvCtx->decoderSurfaceFormat = pooled->surfaceFormat;
+    nvCtx->decoderChromaFormat = pooled->chromaFormat;
+    nvCtx->decoderBitDepth = pooled->bitDepth;
+    nvCtx->surfaceCount = pooled->surfaceCount;
+    nvCtx->decoderMaxWidth = pooled->maxWidth;
+    nvCtx->decoderMaxHeight = pooled->maxHeight;
+    nvCtx->decoderWidth = pooled->width;
+    nvCtx->decoderHeight = pooled->height;
+}
+
+// Destroys nvCtx's decoder, or hands it back to the pool if it came from there.
+// Expects the CUDA context to be current.
+static void releaseDecoder(NVContext *nvCtx) {
+    if (nvCtx->decoder == NULL) {
+        return;
+    }
+
+    CUvideodecoder evicted = NULL;
+    if (nvCtx->decoderPooled) {
+        NVDriver *drv = nvCtx->drv;
+        pthread_mutex_lock(&drv->jpegDecoderPoolMutex);
+        if (drv->jpegDecoderPool.size >= JPEG_DECODER_POOL_CAPACITY) {
+            PooledDecoder *oldest = (PooledDecoder*) get_element_at(&drv->jpegDecoderPool, 0);
+            evicted = oldest->decoder;
+            remove_and_free_element_at(&drv->jpegDecoderPool, 0);
+        }
+        PooledDecoder *entry = (PooledDecoder*) alloc_and_add_element(&drv->jpegDecoderPool, sizeof(PooledDecoder));
+        entry->decoder = nvCtx->decoder;
+        entry->surfaceFormat = nvCtx->decoderSurfaceFormat;
+        entry->chromaFormat = nvCtx->decoderChromaFormat;
+        entry->bitDepth = nvCtx->decoderBitDepth;
+        entry->surfaceCount = nvCtx->surfaceCount;
+        entry->maxWidth = nvCtx->decoderMaxWidth;
+        entry->maxHeight = nvCtx->decoderMaxHeight;
+        entry->width = nvCtx->decoderWidth;
+        entry->height = nvCtx->decoderHeight;
+        pthread_mutex_unlock(&drv->jpegDecoderPoolMutex);
+    } else {
+        evicted = nvCtx->decoder;
+    }
+    nvCtx->decoder = NULL;
+    nvCtx->decoderPooled = false;
+
+    if (evicted != NULL) {
+        CUresult result = cv->cuvidDestroyDecoder(evicted);
+        if (result != CUDA_SUCCESS) {
+            LOG("cuvidDestroyDecoder failed: %d", result);
+        }
+    }
+}
+
+//expects the CUDA context to be current
+static void drainJPEGDecoderPool(NVDriver *drv) {
+    pthread_mutex_lock(&drv->jpegDecoderPoolMutex);
+    ARRAY_FOR_EACH(PooledDecoder*, entry, &drv->jpegDecoderPool)
+        CHECK_CUDA_RESULT(cv->cuvidDestroyDecoder(entry->decoder));
+        free(entry);
+    END_FOR_EACH
+    free(drv->jpegDecoderPool.buf);
+    drv->jpegDecoderPool = (Array) { 0 };
+    pthread_mutex_unlock(&drv->jpegDecoderPoolMutex);
+}
+
+// Blocks until the resolve thread has mapped every picture queued so far.
+static void waitForResolveIdle(NVContext *nvCtx) {
+    pthread_mutex_lock(&nvCtx->resolveMutex);
+    while (nvCtx->resolvesInFlight > 0) {
+        pthread_cond_wait(&nvCtx->resolveIdleCondition, &nvCtx->resolveMutex);
+    }
+    pthread_mutex_unlock(&nvCtx->resolveMutex);
+}
+
+static void finishQueuedResolve(NVContext *nvCtx) {
+    pthread_mutex_lock(&nvCtx->resolveMutex);
+    nvCtx->resolvesInFlight--;
+    pthread_cond_broadcast(&nvCtx->resolveIdleCondition);
+    pthread_mutex_unlock(&nvCtx->resolveMutex);
+}
+
 static void* resolveSurfaces(void *param) {
     NVContext *ctx = (NVContext*) param;
     NVDriver *drv = ctx->drv;
@@ -645,6 +1104,7 @@ static void* resolveSurfaces(void *param) {
         //LOG("Mapping surface %d", surface->pictureIdx);
         if (surface->decodeFailed || CHECK_CUDA_RESULT(cv->cuvidMapVideoFrame(ctx->decoder, surface->pictureIdx, &deviceMemory, &pitch, &procParams))) {
             setSurfaceResolving(surface, false);
+            finishQueuedResolve(ctx);
             continue;
         }
         //LOG("Mapped surface %d to %p (%d)", surface->pictureIdx, (void*)deviceMemory, pitch);
@@ -656,16 +1116,11 @@ static void* resolveSurfaces(void *param) {
         //unmap frame
 
         CHECK_CUDA_RESULT(cv->cuvidUnmapVideoFrame(ctx->decoder, deviceMemory));
+        finishQueuedResolve(ctx);
     }
 out:
     //release the decoder here to prevent multiple threads attempting it
-    if (ctx->decoder != NULL) {
-        CUresult result = cv->cuvidDestroyDecoder(ctx->decoder);
-        ctx->decoder = NULL;
-        if (result != CUDA_SUCCESS) {
-            LOG("cuvidDestroyDecoder failed: %d", result);
-        }
-    }
+    releaseDecoder(ctx);
     LOG("[RT] Resolve thread for %p exiting", ctx);
     return NULL;
 }
@@ -839,7 +1294,7 @@ static VAStatus nvGetConfigAttributes(
         NVDriver *drv = (NVDriver*) ctx->pDriverData;
         for (int i = 0; i < num_attribs; i++) {
             if (attrib_list[i].type == VAConfigAttribRTFormat) {
-                attrib_list[i].value = VA_RT_FORMAT_YUV420 | VA_RT_FORMAT_RGB32;
+                attrib_list[i].value = VA_RT_FORMAT_YUV420 | VA_RT_FORMAT_YUV422 | VA_RT_FORMAT_RGB32 | VA_RT_FORMAT_RGBP;
                 if (drv->supports16BitSurface) {
                     attrib_list[i].value |= VA_RT_FORMAT_YUV420_10;
                 }
@@ -1107,7 +1562,7 @@ static VAStatus nvQueryConfigAttributes(
         *profile = cfg->profile;
         *entrypoint = cfg->entrypoint;
         int i = 0;
-        attrib_list[i].value = VA_RT_FORMAT_YUV420 | VA_RT_FORMAT_RGB32;
+        attrib_list[i].value = VA_RT_FORMAT_YUV420 | VA_RT_FORMAT_YUV422 | VA_RT_FORMAT_RGB32 | VA_RT_FORMAT_RGBP;
         attrib_list[i].type = VAConfigAttribRTFormat;
         if (drv->supports16BitSurface) {
             attrib_list[i].value |= VA_RT_FORMAT_YUV420_10;
@@ -1504,7 +1959,10 @@ static void setSurfaceResolving(NVSurface *surface, bool resolving) {
 
     pthread_mutex_lock(&surface->mutex);
     surface->resolving = resolving ? 1 : 0;
-    if (!resolving) {
+    if (resolving) {
+        //new content is on its way, a derived image has to be refreshed on its next map
+        surface->stagingValid = false;
+    } else {
         pthread_cond_broadcast(&surface->cond);
     }
     pthread_mutex_unlock(&surface->mutex);
@@ -1548,7 +2006,7 @@ static VAStatus nvCreateSurfaces2(
     ImportedSurface imported;
     parseSurfaceImportAttributes(attrib_list, num_attribs, &imported);
     const bool importSurface = imported.valid;
-    uint32_t surfaceFourcc = importSurface ? imported.pixelFormat : 0;
+    uint32_t surfaceFourcc = importSurface || isVideoProcOutputFourcc(imported.pixelFormat) ? imported.pixelFormat : 0;
 
     cudaVideoSurfaceFormat nvFormat;
     cudaVideoChromaFormat chromaFormat;
@@ -1587,11 +2045,18 @@ static VAStatus nvCreateSurfaces2(
         bitdepth = 12;
         break;
     case VA_RT_FORMAT_RGB32:
+    case VA_RT_FORMAT_RGBP:
         nvFormat = cudaVideoSurfaceFormat_NV12;
         chromaFormat = cudaVideoChromaFormat_444;
         bitdepth = 8;
         break;
-    
+    case VA_RT_FORMAT_YUV422:
+        //only VideoProc targets (YUY2), nothing decodes into these
+        nvFormat = cudaVideoSurfaceFormat_NV12;
+        chromaFormat = cudaVideoChromaFormat_422;
+        bitdepth = 8;
+        break;
+
     default:
         LOG("Unknown format: %X", format);
         return VA_STATUS_ERROR_UNSUPPORTED_RT_FORMAT;
@@ -1693,14 +2158,109 @@ static VAStatus nvDestroySurfaces(
 
         LOG_DEBUG("Destroying surface %d (%p)", surface->pictureIdx, surface);
 
+        //images derived from the surface outlive it, but must no longer reach its staging copy
+        pthread_mutex_lock(&drv->objectCreationMutex);
+        ARRAY_FOR_EACH(Object, o, &drv->objects)
+            if (o->type == OBJECT_TYPE_IMAGE && ((NVImage*) o->obj)->derivedSurface == surface) {
+                ((NVImage*) o->obj)->derivedSurface = NULL;
+            } else if (o->type == OBJECT_TYPE_BUFFER && ((NVBuffer*) o->obj)->derivedSurface == surface) {
+                ((NVBuffer*) o->obj)->derivedSurface = NULL;
+                ((NVBuffer*) o->obj)->ptr = NULL;
+            }
+        END_FOR_EACH
+        pthread_mutex_unlock(&drv->objectCreationMutex);
+
         drv->backend->detachBackingImageFromSurface(drv, surface);
 
+        if (surface->stagingHost != NULL &&
+            !CHECK_CUDA_RESULT(cu->cuCtxPushCurrent(drv->cudaContext))) {
+            freeHostCopyMemory(surface->stagingHost, surface->stagingPinned);
+            CHECK_CUDA_RESULT(cu->cuCtxPopCurrent(NULL));
+        }
+
         deleteObject(drv, surface_list[i]);
     }
 
     return VA_STATUS_SUCCESS;
 }
 
+typedef struct {
+    NVDriver            *drv;
+    const VASurfaceID   *surfaces;
+} PreallocateSurfaces;
+
+static bool preallocateBackingImage(void *ctx, int index) {
+    PreallocateSurfaces *prealloc = (PreallocateSurfaces*) ctx;
+    NVSurface *surface = (NVSurface *) getObjectPtr(prealloc->drv, OBJECT_TYPE_SURFACE, prealloc->surfaces[index]);
+    if (surface == NULL || surface->backingImage != NULL) {
+        return false;
+    }
+    return prealloc->drv->backend->realiseSurface(prealloc->drv, surface);
+}
+
+static bool preallocateThreadBegin(void *ctx) {
+    PreallocateSurfaces *prealloc = (PreallocateSurfaces*) ctx;
+    return !CHECK_CUDA_RESULT(cu->cuCtxPushCurrent(prealloc->drv->cudaContext));
+}
+
+static void preallocateThreadEnd(void *ctx) {
+    CHECK_CUDA_RESULT(cu->cuCtxPopCurrent(NULL));
+}
+
+// Realise the backing image of every render target up front, so the RM
+// allocation and CUDA import for each surface happen here rather than on the
+// resolve thread while the first frames after a stream start are decoding.
+// Each realisation is dominated by kernel ioctls and the CUDA external-memory
+// import, neither of which serialise against each other, so the surfaces are
+// shared out between the calling thread and a few short-lived workers.
+// Surfaces that already have a backing image (or a compatible detached one
+// to reuse) are cheap. Failures are not fatal: the surface is simply realised
+// lazily again on its first resolve. Must be called with the CUDA context
+// pushed.
+static void preallocateBackingImages(NVDriver *drv, const VASurfaceID *render_targets, int num_render_targets) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    PreallocateSurfaces prealloc = {
+        .drv = drv,
+        .surfaces = render_targets,
+    };
+    PreallocateWork work = {
+        .realise = preallocateBackingImage,
+        .threadBegin = preallocateThreadBegin,
+        .threadEnd = preallocateThreadEnd,
+        .ctx = &prealloc,
+        .count = num_render_targets,
+    };
+    atomic_init(&work.next, 0);
+    atomic_init(&work.realised, 0);
+
+    const int threads = nvRunPreallocateWork(&work, nvPreallocateWorkerCount(num_render_targets));
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    const long elapsedUs = (end.tv_sec - start.tv_sec) * 1000000L + (end.tv_nsec - start.tv_nsec) / 1000L;
+    LOG("Preallocated %d/%d backing image(s) using %d thread(s) in %ldus",
+        atomic_load(&work.realised), num_render_targets, threads, elapsedUs);
+}
+
+// NVDEC can only deinterlace 4:2:0 output, and only touches pictures that
+// are flagged as interlaced when they're mapped; everything else is woven.
+static cudaVideoDeinterlaceMode decoderDeinterlaceMode(cudaVideoChromaFormat chromaFormat) {
+    return chromaFormat == cudaVideoChromaFormat_420 ? DECODER_DEINTERLACE_MODE : cudaVideoDeinterlaceMode_Weave;
+}
+
+// Tears down a context that failed before its resolve thread started. Without
+// the thread nothing else hands back the decoder.
+static void destroyUnstartedContext(NVDriver *drv, Object contextObj) {
+    NVContext *nvCtx = (NVContext*) contextObj->obj;
+    if (!CHECK_CUDA_RESULT(cu->cuCtxPushCurrent(drv->cudaContext))) {
+        releaseDecoder(nvCtx);
+        CHECK_CUDA_RESULT(cu->cuCtxPopCurrent(NULL));
+    }
+    destroyContext(drv, nvCtx);
+    deleteObject(drv, contextObj->id);
+}
+
 static VAStatus nvCreateContext(
         VADriverContextP ctx,
         VAConfigID config_id,
@@ -1808,7 +2368,7 @@ static VAStatus nvCreateContext(
         .ChromaFormat        = cfg->chromaFormat,
         .OutputFormat        = cfg->surfaceFormat,
         .bitDepthMinus8      = cfg->bitDepth - 8,
-        .DeinterlaceMode     = cudaVideoDeinterlaceMode_Weave,
+        .DeinterlaceMode     = decoderDeinterlaceMode(cfg->chromaFormat),
 
         //we only ever map one frame at a time, so we can set this to 1
         //it isn't particually efficient to do this, but it is simple
@@ -1822,9 +2382,23 @@ static VAStatus nvCreateContext(
 
     CHECK_CUDA_RESULT_RETURN(cu->cuCtxPushCurrent(drv->cudaContext), VA_STATUS_ERROR_OPERATION_FAILED);
 
-    CUvideodecoder decoder;
-    CHECK_CUDA_RESULT_RETURN(cv->cuvidCreateDecoder(&decoder, &vdci), VA_STATUS_ERROR_ALLOCATION_FAILED);
-    nvStatsIncrement(drv, NV_STAT_DECODER_CREATES);
+    //in throughput mode JPEG contexts borrow a decoder from the pool instead of creating one at their exact size
+    PooledDecoder pooled = { 0 };
+    CUvideodecoder decoder = NULL;
+    if (useJPEGDecoderPool(cfg->cudaCodec, picture_width, picture_height)) {
+        if (!acquirePooledJPEGDecoder(drv, &vdci, &pooled)) {
+            CHECK_CUDA_RESULT(cu->cuCtxPopCurrent(NULL));
+            return VA_STATUS_ERROR_ALLOCATION_FAILED;
+        }
+        decoder = pooled.decoder;
+    } else {
+        CHECK_CUDA_RESULT_RETURN(cv->cuvidCreateDecoder(&decoder, &vdci), VA_STATUS_ERROR_ALLOCATION_FAILED);
+        nvStatsIncrement(drv, NV_STAT_DECODER_CREATES);
+    }
+
+    if (PREALLOCATE_SURFACES && num_render_targets > 0) {
+        preallocateBackingImages(drv, render_targets, num_render_targets);
+    }
 
     CHECK_CUDA_RESULT_RETURN(cu->cuCtxPopCurrent(NULL), VA_STATUS_ERROR_OPERATION_FAILED);
 
@@ -1845,6 +2419,15 @@ static VAStatus nvCreateContext(
     nvCtx->decoderBitDepth = cfg->bitDepth;
     nvCtx->surfaceCount = surfaceCount;
     nvCtx->firstKeyframeValid = false;
+    if (pooled.decoder != NULL) {
+        adoptPooledDecoder(nvCtx, &pooled);
+    }
+
+    if (selectedCodec->initContext != NULL && !selectedCodec->initContext(nvCtx)) {
+        LOG("Unable to initialise codec state for context id: %d", contextObj->id);
+        destroyUnstartedContext(drv, contextObj);
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    }
     
     pthread_mutexattr_t attrib;
     pthread_mutexattr_init(&attrib);
@@ -1853,10 +2436,11 @@ static VAStatus nvCreateContext(
 
     pthread_mutex_init(&nvCtx->resolveMutex, NULL);
     pthread_cond_init(&nvCtx->resolveCondition, NULL);
+    pthread_cond_init(&nvCtx->resolveIdleCondition, NULL);
     int err = pthread_create(&nvCtx->resolveThread, NULL, &resolveSurfaces, nvCtx);
     if (err != 0) {
         LOG("Unable to create resolve thread: %d", err);
-        deleteObject(drv, contextObj->id);
+        destroyUnstartedContext(drv, contextObj);
         return VA_STATUS_ERROR_OPERATION_FAILED;
     }
     nvCtx->resolveThreadStarted = true;
@@ -1933,7 +2517,7 @@ static VAStatus recreateDecoderForSurface(NVContext *nvCtx, NVSurface *surface)
         .ChromaFormat        = surface->chromaFormat,
         .OutputFormat        = surface->format,
         .bitDepthMinus8      = surface->bitDepth - 8,
-        .DeinterlaceMode     = cudaVideoDeinterlaceMode_Weave,
+        .DeinterlaceMode     = decoderDeinterlaceMode(surface->chromaFormat),
         .ulNumOutputSurfaces = 1,
         .ulNumDecodeSurfaces = nvCtx->surfaceCount,
     };
@@ -1942,9 +2526,19 @@ static VAStatus recreateDecoderForSurface(NVContext *nvCtx, NVSurface *surface)
 
     NVDriver *drv = nvCtx->drv;
     CHECK_CUDA_RESULT_RETURN(cu->cuCtxPushCurrent(drv->cudaContext), VA_STATUS_ERROR_OPERATION_FAILED);
-    if (nvCtx->decoder != NULL) {
-        CHECK_CUDA_RESULT(cv->cuvidDestroyDecoder(nvCtx->decoder));
-        nvCtx->decoder = NULL;
+    const bool pooled = nvCtx->decoderPooled;
+    releaseDecoder(nvCtx);
+
+    if (pooled) {
+        PooledDecoder pooledDecoder;
+        const bool acquired = acquirePooledJPEGDecoder(drv, &vdci, &pooledDecoder);
+        CHECK_CUDA_RESULT_RETURN(cu->cuCtxPopCurrent(NULL), VA_STATUS_ERROR_OPERATION_FAILED);
+        if (!acquired) {
+            LOG("Unable to get a pooled JPEG decoder while matching first surface");
+            return VA_STATUS_ERROR_ALLOCATION_FAILED;
+        }
+        adoptPooledDecoder(nvCtx, &pooledDecoder);
+        return VA_STATUS_SUCCESS;
     }
 
     CUvideodecoder decoder;
@@ -2024,6 +2618,122 @@ static VAStatus nvBufferSetNumElements(
     return VA_STATUS_ERROR_UNIMPLEMENTED;
 }
 
+// Size of one plane of a surface's staging copy. Subsampled planes round up, so
+// odd sizes keep their last chroma column and row.
+static void getStagingPlaneLayout(const NVFormatInfo *fmtInfo, const NVSurface *surface, uint32_t plane, uint32_t *pitch, uint32_t *rows) {
+    const NVFormatPlane *p = &fmtInfo->plane[plane];
+    *pitch = ((surface->width + p->ss.x) >> p->ss.x) * fmtInfo->bppc * p->channelCount;
+    *rows = (surface->height + p->ss.y) >> p->ss.y;
+}
+
+// Brings a surface's staging copy up to date with its backing image, if it
+// has been written since the last refresh. The surface mutex is held across
+// the copy so a new decode into the surface can't start halfway through it.
+static bool refreshSurfaceStaging(NVDriver *drv, NVSurface *surface) {
+    waitSurfaceResolved(surface);
+
+    pthread_mutex_lock(&surface->mutex);
+    if (surface->stagingValid) {
+        pthread_mutex_unlock(&surface->mutex);
+        return true;
+    }
+
+    const BackingImage *img = surface->backingImage;
+    if (img == NULL || surface->stagingHost == NULL) {
+        pthread_mutex_unlock(&surface->mutex);
+        return false;
+    }
+
+    const NVFormatInfo *fmtInfo = &formatsInfo[img->format];
+    if (CHECK_CUDA_RESULT(cu->cuCtxPushCurrent(drv->cudaContext))) {
+        pthread_mutex_unlock(&surface->mutex);
+        return false;
+    }
+    bool ret = true;
+    size_t offset = 0;
+    for (uint32_t i = 0; ret && i < fmtInfo->numPlanes; i++) {
+        uint32_t pitch, rows;
+        getStagingPlaneLayout(fmtInfo, surface, i, &pitch, &rows);
+        CUDA_MEMCPY2D cpy = {
+            .srcMemoryType = CU_MEMORYTYPE_ARRAY,
+            .srcArray = img->arrays[i],
+            .dstMemoryType = CU_MEMORYTYPE_HOST,
+            .dstHost = (char*) surface->stagingHost + offset,
+            .dstPitch = pitch,
+            .WidthInBytes = pitch,
+            .Height = rows
+        };
+        //the host memory is pinned, so these are straight DMA transfers
+        ret = !CHECK_CUDA_RESULT(cu->cuMemcpy2DAsync(&cpy, drv->imageTransferStream));
+        offset += (size_t) pitch * rows;
+    }
+    if (CHECK_CUDA_RESULT(cu->cuStreamSynchronize(drv->imageTransferStream))) {
+        ret = false;
+    }
+    if (CHECK_CUDA_RESULT(cu->cuCtxPopCurrent(NULL))) {
+        ret = false;
+    }
+    surface->stagingValid = ret;
+    pthread_mutex_unlock(&surface->mutex);
+
+    return ret;
+}
+
+// Uploads a staging copy the client may have written through back into the
+// surface, the same way vaPutImage does. Does nothing if it hasn't been mapped
+// since the last upload.
+static bool writeBackSurfaceStaging(NVDriver *drv, NVSurface *surface) {
+    //a decode still in flight would overwrite the upload
+    waitSurfaceResolved(surface);
+
+    pthread_mutex_lock(&surface->mutex);
+    if (!surface->stagingDirty) {
+        pthread_mutex_unlock(&surface->mutex);
+        return true;
+    }
+    surface->stagingDirty = false;
+
+    const BackingImage *img = surface->backingImage;
+    if (img == NULL || surface->stagingHost == NULL) {
+        pthread_mutex_unlock(&surface->mutex);
+        return false;
+    }
+
+    const NVFormatInfo *fmtInfo = &formatsInfo[img->format];
+    if (CHECK_CUDA_RESULT(cu->cuCtxPushCurrent(drv->cudaContext))) {
+        pthread_mutex_unlock(&surface->mutex);
+        return false;
+    }
+    bool ret = true;
+    size_t offset = 0;
+    for (uint32_t i = 0; ret && i < fmtInfo->numPlanes; i++) {
+        uint32_t pitch, rows;
+        getStagingPlaneLayout(fmtInfo, surface, i, &pitch, &rows);
+        CUDA_MEMCPY2D cpy = {
+            .srcMemoryType = CU_MEMORYTYPE_HOST,
+            .srcHost = (const char*) surface->stagingHost + offset,
+            .srcPitch = pitch,
+            .dstMemoryType = CU_MEMORYTYPE_ARRAY,
+            .dstArray = img->arrays[i],
+            .WidthInBytes = pitch,
+            .Height = rows
+        };
+        ret = !CHECK_CUDA_RESULT(cu->cuMemcpy2DAsync(&cpy, drv->imageTransferStream));
+        offset += (size_t) pitch * rows;
+    }
+    if (CHECK_CUDA_RESULT(cu->cuStreamSynchronize(drv->imageTransferStream))) {
+        ret = false;
+    }
+    if (CHECK_CUDA_RESULT(cu->cuCtxPopCurrent(NULL))) {
+        ret = false;
+    }
+    //the copy and the surface hold the same pixels again
+    surface->stagingValid = ret;
+    pthread_mutex_unlock(&surface->mutex);
+
+    return ret;
+}
+
 static VAStatus nvMapBuffer(
         VADriverContextP ctx,
         VABufferID buf_id,	/* in */
@@ -2037,6 +2747,16 @@ static VAStatus nvMapBuffer(
         return VA_STATUS_ERROR_INVALID_BUFFER;
     }
 
+    if (buf->derivedSurface != NULL) {
+        if (!refreshSurfaceStaging(drv, buf->derivedSurface)) {
+            return VA_STATUS_ERROR_OPERATION_FAILED;
+        }
+        //the client may write through the mapping, it's uploaded again on unmap
+        pthread_mutex_lock(&buf->derivedSurface->mutex);
+        buf->derivedSurface->stagingDirty = true;
+        pthread_mutex_unlock(&buf->derivedSurface->mutex);
+    }
+
     *pbuf = buf->ptr;
 
     return VA_STATUS_SUCCESS;
@@ -2047,6 +2767,17 @@ static VAStatus nvUnmapBuffer(
         VABufferID buf_id	/* in */
     )
 {
+    NVDriver *drv = (NVDriver*) ctx->pDriverData;
+    NVBuffer *buf = getObjectPtr(drv, OBJECT_TYPE_BUFFER, buf_id);
+
+    if (buf == NULL) {
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+    }
+
+    if (buf->derivedSurface != NULL && !writeBackSurfaceStaging(drv, buf->derivedSurface)) {
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+    }
+
     return VA_STATUS_SUCCESS;
 }
 
@@ -2062,7 +2793,9 @@ static VAStatus nvDestroyBuffer(
         return VA_STATUS_ERROR_INVALID_BUFFER;
     }
 
-    if (buf->ptr != NULL) {
+    if (buf->bufferType == VAImageBufferType) {
+        freeImageBufferMemory(drv, buf);
+    } else if (buf->ptr != NULL) {
         free(buf->ptr);
     }
 
@@ -2071,31 +2804,67 @@ static VAStatus nvDestroyBuffer(
     return VA_STATUS_SUCCESS;
 }
 
-static uint8_t clampU8(int value) {
-    if (value < 0) {
-        return 0;
-    }
-    if (value > 255) {
-        return 255;
-    }
-    return (uint8_t) value;
-}
+typedef enum {
+    VIDEO_PROC_FILTER_NEAREST,
+    VIDEO_PROC_FILTER_BILINEAR,
+    VIDEO_PROC_FILTER_BICUBIC,
+} VideoProcFilter;
+
+//transfer functions hdrToneMapPtx can undo, in its p_transfer numbering
+typedef enum {
+    VIDEO_PROC_TRANSFER_PQ,
+    VIDEO_PROC_TRANSFER_HLG,
+} VideoProcTransfer;
+
+// HDR to SDR conversion for a blit, peaks are in cd/m2
+typedef struct {
+    bool              enabled;
+    VideoProcTransfer transfer;
+    float             sourcePeak;
+    float             targetPeak;
+    //convert BT.2020 primaries to BT.709
+    bool              gamutMap;
+} VideoProcToneMap;
+
+// Geometry of a VideoProc blit. src is the requested source rectangle. The
+// output rectangle has already been clipped to the render target, and
+// srcX/srcY is the source position that the clipped rectangle's top-left edge
+// maps to.
+typedef struct {
+    VARectangle     src;
+    float           srcX;
+    float           srcY;
+    float           scaleX;
+    float           scaleY;
+    VARectangle     dst;
+    uint32_t        targetWidth;
+    uint32_t        targetHeight;
+    VideoProcFilter filter;
+    uint32_t        background;
+    //unscaled copy from the source origin that covers the whole target
+    bool            identity;
+    VideoProcToneMap toneMap;
+} VideoProcBlit;
+
+typedef enum {
+    VIDEO_PROC_DEINTERLACE_NONE,
+    VIDEO_PROC_DEINTERLACE_BOB,
+    VIDEO_PROC_DEINTERLACE_ADAPTIVE,
+} VideoProcDeinterlaceMode;
 
 typedef struct {
-    int vToR;
-    int uToG;
-    int vToG;
-    int uToB;
-} ColorMatrix;
+    VideoProcDeinterlaceMode mode;
+    //keep the bottom field's lines and rebuild the top field's
+    bool                     bottomField;
+} VideoProcDeinterlace;
 
 typedef struct {
-    int sampleShift;
-    int yScale;
-    int yOffset;
-    int uvOffset;
-    int rounding;
-    int valueShift;
-} VideoProcSampleInfo;
+    VideoProcDeinterlace deinterlace;
+    //a VAProcFilterHighDynamicRangeToneMapping filter was given
+    bool                 toneMap;
+    //from the filter's HDR10 metadata, 0 if it had none
+    float                sourcePeak;
+} VideoProcFilters;
 
 static const ColorMatrix kLimitedRangeColorMatrices[] = {
     { 409, 100, 208, 516 },
@@ -2375,6 +3144,133 @@ static bool loadVideoProcKernel(NVDriver *drv, bool is16Bit) {
     }
 }
 
+static bool loadVideoProcTexKernel(NVDriver *drv) {
+    static bool loggedTexKernelFailure = false;
+
+    if (drv->yuvToArgbTexKernel != NULL) {
+        return true;
+    }
+    if (drv->videoProcKernelTexFailed) {
+        return false;
+    }
+
+    if (CHECK_CUDA_RESULT(drv->cu->cuModuleLoadData(&drv->videoProcModuleTex, yuvToArgbTexPtx)) ||
+        CHECK_CUDA_RESULT(drv->cu->cuModuleGetFunction(&drv->yuvToArgbTexKernel, drv->videoProcModuleTex, "yuv_to_argb_tex"))) {
+        if (drv->videoProcModuleTex != NULL) {
+            CHECK_CUDA_RESULT(drv->cu->cuModuleUnload(drv->videoProcModuleTex));
+            drv->videoProcModuleTex = NULL;
+        }
+        drv->yuvToArgbTexKernel = NULL;
+        drv->videoProcKernelTexFailed = true;
+        if (!loggedTexKernelFailure) {
+            LOG("CUDA single-pass VideoProc kernel unavailable, using staged conversion");
+            loggedTexKernelFailure = true;
+        }
+        return false;
+    }
+
+    return true;
+}
+
+static bool loadVideoProcHdrKernel(NVDriver *drv) {
+    static bool loggedHdrKernelFailure = false;
+
+    if (drv->yuvToArgbHdrKernel != NULL) {
+        return true;
+    }
+    if (drv->videoProcKernelHdrFailed) {
+        return false;
+    }
+
+    if (CHECK_CUDA_RESULT(drv->cu->cuModuleLoadData(&drv->videoProcModuleHdr, hdrToneMapPtx)) ||
+        CHECK_CUDA_RESULT(drv->cu->cuModuleGetFunction(&drv->yuvToArgbHdrKernel, drv->videoProcModuleHdr, "yuv_to_argb_hdr"))) {
+        if (drv->videoProcModuleHdr != NULL) {
+            CHECK_CUDA_RESULT(drv->cu->cuModuleUnload(drv->videoProcModuleHdr));
+            drv->videoProcModuleHdr = NULL;
+        }
+        drv->yuvToArgbHdrKernel = NULL;
+        drv->videoProcKernelHdrFailed = true;
+        if (!loggedHdrKernelFailure) {
+            LOG("CUDA HDR tone mapping kernel unavailable, converting HDR content without it");
+            loggedHdrKernelFailure = true;
+        }
+        return false;
+    }
+
+    return true;
+}
+
+static bool loadVideoProcFormatKernels(NVDriver *drv) {
+    static bool loggedFormatKernelFailure = false;
+
+    if (drv->yuvConvertKernel != NULL) {
+        return true;
+    }
+    if (drv->videoProcKernelFormatFailed) {
+        return false;
+    }
+
+    if (CHECK_CUDA_RESULT(drv->cu->cuModuleLoadData(&drv->videoProcModuleFormat, yuvFormatPtx)) ||
+        CHECK_CUDA_RESULT(drv->cu->cuModuleGetFunction(&drv->rgbaToPlanarKernel, drv->videoProcModuleFormat, "rgba_to_planar")) ||
+        CHECK_CUDA_RESULT(drv->cu->cuModuleGetFunction(&drv->yuvConvertKernel, drv->videoProcModuleFormat, "yuv420_convert"))) {
+        if (drv->videoProcModuleFormat != NULL) {
+            CHECK_CUDA_RESULT(drv->cu->cuModuleUnload(drv->videoProcModuleFormat));
+            drv->videoProcModuleFormat = NULL;
+        }
+        drv->yuvConvertKernel = NULL;
+        drv->rgbaToPlanarKernel = NULL;
+        drv->videoProcKernelFormatFailed = true;
+        if (!loggedFormatKernelFailure) {
+            LOG("CUDA VideoProc format conversion kernels unavailable");
+            loggedFormatKernelFailure = true;
+        }
+        return false;
+    }
+
+    return true;
+}
+
+static bool loadVideoProcDeinterlaceKernel(NVDriver *drv) {
+    static bool loggedDeinterlaceKernelFailure = false;
+
+    if (drv->deinterlaceKernel != NULL) {
+        return true;
+    }
+    if (drv->videoProcKernelDeintFailed) {
+        return false;
+    }
+
+    if (CHECK_CUDA_RESULT(drv->cu->cuModuleLoadData(&drv->videoProcModuleDeint, deinterlacePtx)) ||
+        CHECK_CUDA_RESULT(drv->cu->cuModuleGetFunction(&drv->deinterlaceKernel, drv->videoProcModuleDeint, "deinterlace_plane"))) {
+        if (drv->videoProcModuleDeint != NULL) {
+            CHECK_CUDA_RESULT(drv->cu->cuModuleUnload(drv->videoProcModuleDeint));
+            drv->videoProcModuleDeint = NULL;
+        }
+        drv->deinterlaceKernel = NULL;
+        drv->videoProcKernelDeintFailed = true;
+        if (!loggedDeinterlaceKernelFailure) {
+            LOG("CUDA deinterlacing kernel unavailable");
+            loggedDeinterlaceKernelFailure = true;
+        }
+        return false;
+    }
+
+    return true;
+}
+
+static bool createVideoProcTexture(NVDriver *drv, CUarray array, VideoProcFilter filter, CUtexObject *tex) {
+    CUDA_RESOURCE_DESC resDesc = {
+        .resType = CU_RESOURCE_TYPE_ARRAY,
+        .res.array.hArray = array
+    };
+    //the bicubic path is built from bilinear fetches
+    CUDA_TEXTURE_DESC texDesc = {
+        .addressMode = { CU_TR_ADDRESS_MODE_CLAMP, CU_TR_ADDRESS_MODE_CLAMP, CU_TR_ADDRESS_MODE_CLAMP },
+        .filterMode = filter == VIDEO_PROC_FILTER_NEAREST ? CU_TR_FILTER_MODE_POINT : CU_TR_FILTER_MODE_LINEAR
+    };
+    return !CHECK_CUDA_RESULT(drv->cu->cuTexObjectCreate(tex, &resDesc, &texDesc, NULL));
+}
+
 static uint32_t rgbOrderForFourcc(uint32_t fourcc) {
     switch (fourcc) {
     case VA_FOURCC_RGBA:
@@ -2393,6 +3289,25 @@ static uint32_t rgbOrderForFourcc(uint32_t fourcc) {
     }
 }
 
+// Packs a VA 0xAARRGGBB colour into the 32-bit word that lands in memory in
+// the byte order selected by rgbOrderForFourcc.
+static uint32_t packRgbForOrder(uint32_t order, uint32_t argb) {
+    const uint32_t a = (argb >> 24) & 0xff;
+    const uint32_t r = (argb >> 16) & 0xff;
+    const uint32_t g = (argb >> 8) & 0xff;
+    const uint32_t b = argb & 0xff;
+    switch (order) {
+    case 1:
+        return r | (g << 8) | (b << 16) | (a << 24);
+    case 2:
+        return a | (r << 8) | (g << 16) | (b << 24);
+    case 3:
+        return a | (b << 8) | (g << 16) | (r << 24);
+    default:
+        return b | (g << 8) | (r << 16) | (a << 24);
+    }
+}
+
 static size_t roundVideoProcBufferSize(size_t requiredSize) {
     const size_t blockSize = 1024 * 1024;
     if (requiredSize > SIZE_MAX - (blockSize - 1)) {
@@ -2401,6 +3316,14 @@ static size_t roundVideoProcBufferSize(size_t requiredSize) {
     return (requiredSize + blockSize - 1) & ~(blockSize - 1);
 }
 
+static bool ensureVideoProcStream(NVContext *nvCtx) {
+    if (nvCtx->videoProcStream != NULL) {
+        return true;
+    }
+    //a blocking stream still orders against the legacy stream the decode/export copies use
+    return !CHECK_CUDA_RESULT(nvCtx->drv->cu->cuStreamCreate(&nvCtx->videoProcStream, CU_STREAM_DEFAULT));
+}
+
 static bool ensureVideoProcBuffer(NVDriver *drv, CUdeviceptr *buffer, size_t *bufferSize, size_t requiredSize) {
     if (*bufferSize >= requiredSize && *buffer != 0) {
         return true;
@@ -2420,93 +3343,332 @@ static bool ensureVideoProcBuffer(NVDriver *drv, CUdeviceptr *buffer, size_t *bu
     return true;
 }
 
-static bool ensureCpuVideoProcBuffer(void **buffer, size_t *bufferSize, size_t requiredSize) {
-    if (*bufferSize >= requiredSize && *buffer != NULL) {
+// Linear-light BT.2020 to BT.709 primaries, row major
+static const float kBt2020ToBt709[9] = {
+     1.6605f, -0.5876f, -0.0728f,
+    -0.1246f,  1.1329f, -0.0083f,
+    -0.0182f, -0.1006f,  1.1187f
+};
+static const float kIdentityGamut[9] = {
+    1.0f, 0.0f, 0.0f,
+    0.0f, 1.0f, 0.0f,
+    0.0f, 0.0f, 1.0f
+};
+
+// Queues yuv_to_argb_hdr in place of yuv_to_argb_tex. The integer matrix and
+// sample layout are turned into floats producing R'G'B' in [0,1], so both
+// kernels agree on the colour conversion itself.
+static bool launchVideoProcHdrKernel(NVContext *nvCtx, CUtexObject yTex, CUtexObject uvTex, unsigned long long dstSurf,
+                                     CUdeviceptr dstDevice, uint32_t dstPitch, uint32_t order, const VideoProcBlit *blit,
+                                     bool is16Bit, const ColorMatrix *matrix, VideoProcSampleInfo sampleInfo) {
+    NVDriver *drv = nvCtx->drv;
+    const VideoProcToneMap *toneMap = &blit->toneMap;
+
+    uint32_t width = blit->targetWidth;
+    uint32_t height = blit->targetHeight;
+    const float norm = 1.0f / ((float) (1u << sampleInfo.valueShift) * 255.0f);
+    float codeScale = (is16Bit ? 65535.0f : 255.0f) / (float) (1u << sampleInfo.sampleShift);
+    float yOffset = (float) sampleInfo.yOffset;
+    float uvOffset = (float) sampleInfo.uvOffset;
+    float yScale = (float) sampleInfo.yScale * norm;
+    float vToR = (float) matrix->vToR * norm;
+    float uToG = -(float) matrix->uToG * norm;
+    float vToG = -(float) matrix->vToG * norm;
+    float uToB = (float) matrix->uToB * norm;
+    float srcX = blit->srcX;
+    float srcY = blit->srcY;
+    float scaleX = blit->scaleX;
+    float scaleY = blit->scaleY;
+    uint32_t dstX = (uint32_t) blit->dst.x;
+    uint32_t dstY = (uint32_t) blit->dst.y;
+    uint32_t dstWidth = blit->dst.width;
+    uint32_t dstHeight = blit->dst.height;
+    uint32_t background = packRgbForOrder(order, blit->background);
+    uint32_t transfer = (uint32_t) toneMap->transfer;
+    //PQ is absolute (up to 10000 cd/m2), HLG relative to the display's peak
+    float luminanceScale = (toneMap->transfer == VIDEO_PROC_TRANSFER_PQ ? 10000.0f : toneMap->sourcePeak) / toneMap->targetPeak;
+    const float white = toneMap->sourcePeak / toneMap->targetPeak;
+    float invWhite2 = 1.0f / (white * white);
+    uint32_t applyCurve = white > 1.0f;
+    float gamut[9];
+    memcpy(gamut, toneMap->gamutMap ? kBt2020ToBt709 : kIdentityGamut, sizeof(gamut));
+    void *args[] = {
+        &yTex,
+        &uvTex,
+        &dstSurf,
+        &dstDevice,
+        &width,
+        &height,
+        &dstPitch,
+        &order,
+        &codeScale,
+        &yOffset,
+        &uvOffset,
+        &yScale,
+        &vToR,
+        &uToG,
+        &vToG,
+        &uToB,
+        &srcX,
+        &srcY,
+        &scaleX,
+        &scaleY,
+        &dstX,
+        &dstY,
+        &dstWidth,
+        &dstHeight,
+        &background,
+        &transfer,
+        &luminanceScale,
+        &invWhite2,
+        &applyCurve,
+        &gamut[0],
+        &gamut[1],
+        &gamut[2],
+        &gamut[3],
+        &gamut[4],
+        &gamut[5],
+        &gamut[6],
+        &gamut[7],
+        &gamut[8]
+    };
+    return !CHECK_CUDA_RESULT(drv->cu->cuLaunchKernel(drv->yuvToArgbHdrKernel,
+            (width + 15) / 16, (height + 15) / 16, 1,
+            16, 16, 1, 0, nvCtx->videoProcStream, args, NULL));
+}
+
+// Keeps a queued blit's objects alive until flushVideoProcBatch has waited for
+// the stream. Returns false if they couldn't be recorded, in which case the
+// caller has to synchronise and release them itself.
+static bool deferVideoProcBlit(NVContext *nvCtx, CUtexObject yTex, CUtexObject uvTex, unsigned long long dstSurf) {
+    if (nvCtx->videoProcPendingCount == nvCtx->videoProcPendingCapacity) {
+        const uint32_t capacity = nvCtx->videoProcPendingCapacity == 0 ? 16 : nvCtx->videoProcPendingCapacity * 2;
+        VideoProcPendingBlit *pending = realloc(nvCtx->videoProcPending, capacity * sizeof(VideoProcPendingBlit));
+        if (pending == NULL) {
+            return false;
+        }
+        nvCtx->videoProcPending = pending;
+        nvCtx->videoProcPendingCapacity = capacity;
+    }
+    nvCtx->videoProcPending[nvCtx->videoProcPendingCount++] = (VideoProcPendingBlit) {
+        .yTex = yTex,
+        .uvTex = uvTex,
+        .dstSurf = dstSurf
+    };
+    return true;
+}
+
+// Waits for everything queued on the context's stream and releases the objects
+// of the deferred blits. Must be called with the CUDA context current.
+static bool flushVideoProcBatch(NVContext *nvCtx) {
+    NVDriver *drv = nvCtx->drv;
+    if (nvCtx->videoProcPendingCount == 0) {
         return true;
     }
 
-    const size_t allocSize = roundVideoProcBufferSize(requiredSize);
-    void *newBuffer = realloc(*buffer, allocSize);
-    if (newBuffer == NULL) {
+    const bool ret = !CHECK_CUDA_RESULT(drv->cu->cuStreamSynchronize(nvCtx->videoProcStream));
+    for (uint32_t i = 0; i < nvCtx->videoProcPendingCount; i++) {
+        const VideoProcPendingBlit *pending = &nvCtx->videoProcPending[i];
+        CHECK_CUDA_RESULT(drv->cu->cuTexObjectDestroy(pending->uvTex));
+        CHECK_CUDA_RESULT(drv->cu->cuTexObjectDestroy(pending->yTex));
+        if (pending->dstSurf != 0) {
+            CHECK_CUDA_RESULT(cuSurfObjectDestroy_l(pending->dstSurf));
+        }
+    }
+    nvCtx->videoProcPendingCount = 0;
+    return ret;
+}
+
+// Convert in a single pass: the kernel samples the source arrays through
+// texture objects and writes straight into the destination array through a
+// surface object (or into the external device mapping), so no scratch copies
+// of the planes or of the RGB result are needed. This is also the only CUDA
+// path that can scale, crop and place the picture. Returns false without
+// touching the destination if anything needed for that isn't available, e.g.
+// a destination array that wasn't created with surface load/store support.
+static bool convertNV12ToARGBTex(NVContext *nvCtx, BackingImage *srcImg, BackingImage *dstImg, const VideoProcBlit *blit, bool is16Bit, const ColorMatrix *matrix, VideoProcSampleInfo sampleInfo) {
+    static bool loggedSurfaceFailure = false;
+    NVDriver *drv = nvCtx->drv;
+
+    if (dstImg->externalDevicePtr == 0 && (dstImg->arrays[0] == NULL || cuSurfObjectCreate_l == NULL)) {
         return false;
     }
 
-    *buffer = newBuffer;
-    *bufferSize = allocSize;
-    return true;
-}
+    pthread_mutex_lock(&drv->exportMutex);
+    const bool kernelLoaded = loadVideoProcTexKernel(drv);
+    const bool toneMap = blit->toneMap.enabled && loadVideoProcHdrKernel(drv);
+    pthread_mutex_unlock(&drv->exportMutex);
+    if (!kernelLoaded) {
+        return false;
+    }
 
-static void writeRgbPixel(uint8_t *dst, uint32_t fourcc, uint8_t r, uint8_t g, uint8_t b) {
-    switch (fourcc) {
-    case VA_FOURCC_RGBA:
-    case VA_FOURCC_RGBX:
-        dst[0] = r;
-        dst[1] = g;
-        dst[2] = b;
-        dst[3] = 255;
-        break;
-    case VA_FOURCC_BGRA:
-    case VA_FOURCC_BGRX:
-        dst[0] = b;
-        dst[1] = g;
-        dst[2] = r;
-        dst[3] = 255;
-        break;
-    case VA_FOURCC_ARGB:
-    case VA_FOURCC_XRGB:
-        dst[0] = 255;
-        dst[1] = r;
-        dst[2] = g;
-        dst[3] = b;
-        break;
-    case VA_FOURCC_ABGR:
-    case VA_FOURCC_XBGR:
-        dst[0] = 255;
-        dst[1] = b;
-        dst[2] = g;
-        dst[3] = r;
-        break;
-    default:
-        dst[0] = b;
-        dst[1] = g;
-        dst[2] = r;
-        dst[3] = 255;
-        break;
+    CUtexObject yTex = 0;
+    CUtexObject uvTex = 0;
+    unsigned long long dstSurf = 0;
+    CUdeviceptr dstDevice = 0;
+    uint32_t dstPitch = 0;
+    bool ret = false;
+
+    if (dstImg->externalDevicePtr != 0) {
+        dstDevice = dstImg->externalDevicePtr + (CUdeviceptr) dstImg->offsets[0];
+        dstPitch = (uint32_t) dstImg->strides[0];
+    } else {
+        CUDA_RESOURCE_DESC surfDesc = {
+            .resType = CU_RESOURCE_TYPE_ARRAY,
+            .res.array.hArray = dstImg->arrays[0]
+        };
+        CUresult err = cuSurfObjectCreate_l(&dstSurf, &surfDesc);
+        if (err != CUDA_SUCCESS) {
+            if (!loggedSurfaceFailure) {
+                LOG("Unable to create surface object for VideoProc target (%d), using staged conversion", err);
+                loggedSurfaceFailure = true;
+            }
+            return false;
+        }
+    }
+
+    if (!createVideoProcTexture(drv, srcImg->arrays[0], blit->filter, &yTex) ||
+        !createVideoProcTexture(drv, srcImg->arrays[1], blit->filter, &uvTex)) {
+        goto out;
+    }
+
+    uint32_t width = blit->targetWidth;
+    uint32_t height = blit->targetHeight;
+    uint32_t order = rgbOrderForFourcc((uint32_t) dstImg->fourcc);
+    uint32_t vToR = (uint32_t) matrix->vToR;
+    uint32_t uToG = (uint32_t) matrix->uToG;
+    uint32_t vToG = (uint32_t) matrix->vToG;
+    uint32_t uToB = (uint32_t) matrix->uToB;
+    uint32_t yScale = (uint32_t) sampleInfo.yScale;
+    float sampleMax = is16Bit ? 65535.0f : 255.0f;
+    uint32_t sampleShift = (uint32_t) sampleInfo.sampleShift;
+    uint32_t yOffset = (uint32_t) sampleInfo.yOffset;
+    uint32_t uvOffset = (uint32_t) sampleInfo.uvOffset;
+    uint32_t rounding = (uint32_t) sampleInfo.rounding;
+    uint32_t valueShift = (uint32_t) sampleInfo.valueShift;
+    float srcX = blit->srcX;
+    float srcY = blit->srcY;
+    float scaleX = blit->scaleX;
+    float scaleY = blit->scaleY;
+    uint32_t dstX = (uint32_t) blit->dst.x;
+    uint32_t dstY = (uint32_t) blit->dst.y;
+    uint32_t dstWidth = blit->dst.width;
+    uint32_t dstHeight = blit->dst.height;
+    uint32_t filter = (uint32_t) blit->filter;
+    uint32_t background = packRgbForOrder(order, blit->background);
+    void *args[] = {
+        &yTex,
+        &uvTex,
+        &dstSurf,
+        &dstDevice,
+        &width,
+        &height,
+        &dstPitch,
+        &order,
+        &vToR,
+        &uToG,
+        &vToG,
+        &uToB,
+        &yScale,
+        &sampleMax,
+        &sampleShift,
+        &yOffset,
+        &uvOffset,
+        &rounding,
+        &valueShift,
+        &srcX,
+        &srcY,
+        &scaleX,
+        &scaleY,
+        &dstX,
+        &dstY,
+        &dstWidth,
+        &dstHeight,
+        &filter,
+        &background
+    };
+    if (toneMap) {
+        if (!launchVideoProcHdrKernel(nvCtx, yTex, uvTex, dstSurf, dstDevice, dstPitch, order, blit, is16Bit, matrix, sampleInfo)) {
+            goto out;
+        }
+    } else if (CHECK_CUDA_RESULT(drv->cu->cuLaunchKernel(drv->yuvToArgbTexKernel,
+            (width + 15) / 16, (height + 15) / 16, 1,
+            16, 16, 1, 0, nvCtx->videoProcStream, args, NULL))) {
+        goto out;
+    }
+    //the texture/surface objects must outlive the kernel; in a batch they're released once the whole batch is done
+    if (nvCtx->videoProcBatch && deferVideoProcBlit(nvCtx, yTex, uvTex, dstSurf)) {
+        return true;
+    }
+    ret = !CHECK_CUDA_RESULT(drv->cu->cuStreamSynchronize(nvCtx->videoProcStream));
+
+out:
+    if (uvTex != 0) {
+        CHECK_CUDA_RESULT(drv->cu->cuTexObjectDestroy(uvTex));
+    }
+    if (yTex != 0) {
+        CHECK_CUDA_RESULT(drv->cu->cuTexObjectDestroy(yTex));
+    }
+    if (dstSurf != 0) {
+        CHECK_CUDA_RESULT(cuSurfObjectDestroy_l(dstSurf));
     }
+    return ret;
 }
 
-static bool convertNV12ToARGBCuda(NVDriver *drv, BackingImage *srcImg, BackingImage *dstImg, uint32_t width, uint32_t height, bool is16Bit, const ColorMatrix *matrix, VideoProcSampleInfo sampleInfo) {
-    if (srcImg->arrays[0] == NULL || srcImg->arrays[1] == NULL) {
+static bool convertNV12ToARGBCuda(NVContext *nvCtx, BackingImage *srcImg, BackingImage *dstImg, const VideoProcBlit *blit, bool is16Bit, const ColorMatrix *matrix, VideoProcSampleInfo sampleInfo) {
+    NVDriver *drv = nvCtx->drv;
+
+    if (srcImg->arrays[0] == NULL || srcImg->arrays[1] == NULL || !ensureVideoProcStream(nvCtx)) {
+        return false;
+    }
+
+    if (convertNV12ToARGBTex(nvCtx, srcImg, dstImg, blit, is16Bit, matrix, sampleInfo)) {
+        return true;
+    }
+    if (blit->toneMap.enabled) {
+        static bool loggedToneMapFallback = false;
+        if (!loggedToneMapFallback) {
+            LOG("HDR tone mapping needs the single-pass CUDA conversion, converting without it");
+            loggedToneMapFallback = true;
+        }
+    }
+
+    //the staged kernels can only do a straight 1:1 conversion
+    if (!blit->identity) {
         return false;
     }
 
+    uint32_t width = blit->targetWidth;
+    uint32_t height = blit->targetHeight;
+
     const size_t bpp = is16Bit ? 2 : 1;
     const size_t ySize = (size_t) width * height * bpp;
     const size_t uvHeight = (height + 1) / 2;
     const size_t uvSize = (size_t) width * uvHeight * bpp;
     const size_t argbSize = (size_t) width * height * 4;
-    CUdeviceptr dstDevice = dstImg->externalDevicePtr != 0 ? dstImg->externalDevicePtr + (CUdeviceptr) dstImg->offsets[0] : drv->videoProcArgbBuffer;
-    uint32_t dstPitch = dstImg->externalDevicePtr != 0 ? (uint32_t) dstImg->strides[0] : width * 4;
+    CUstream stream = nvCtx->videoProcStream;
 
+    //the modules are shared by the whole driver, the scratch buffers belong to this context
     pthread_mutex_lock(&drv->exportMutex);
-    if (!loadVideoProcKernel(drv, is16Bit) ||
-        !ensureVideoProcBuffer(drv, &drv->videoProcYBuffer, &drv->videoProcYBufferSize, ySize) ||
-        !ensureVideoProcBuffer(drv, &drv->videoProcUVBuffer, &drv->videoProcUVBufferSize, uvSize)) {
-        goto fail;
+    const bool kernelLoaded = loadVideoProcKernel(drv, is16Bit);
+    pthread_mutex_unlock(&drv->exportMutex);
+    if (!kernelLoaded ||
+        !ensureVideoProcBuffer(drv, &nvCtx->videoProcYBuffer, &nvCtx->videoProcYBufferSize, ySize) ||
+        !ensureVideoProcBuffer(drv, &nvCtx->videoProcUVBuffer, &nvCtx->videoProcUVBufferSize, uvSize)) {
+        return false;
     }
     if (dstImg->externalDevicePtr == 0 &&
-        !ensureVideoProcBuffer(drv, &drv->videoProcArgbBuffer, &drv->videoProcArgbBufferSize, argbSize)) {
-        goto fail;
-    }
-    if (dstImg->externalDevicePtr == 0) {
-        dstDevice = drv->videoProcArgbBuffer;
+        !ensureVideoProcBuffer(drv, &nvCtx->videoProcArgbBuffer, &nvCtx->videoProcArgbBufferSize, argbSize)) {
+        return false;
     }
+    CUdeviceptr dstDevice = dstImg->externalDevicePtr != 0 ? dstImg->externalDevicePtr + (CUdeviceptr) dstImg->offsets[0] : nvCtx->videoProcArgbBuffer;
+    uint32_t dstPitch = dstImg->externalDevicePtr != 0 ? (uint32_t) dstImg->strides[0] : width * 4;
 
     CUDA_MEMCPY2D yCpy = {
         .srcMemoryType = CU_MEMORYTYPE_ARRAY,
         .srcArray = srcImg->arrays[0],
         .dstMemoryType = CU_MEMORYTYPE_DEVICE,
-        .dstDevice = drv->videoProcYBuffer,
+        .dstDevice = nvCtx->videoProcYBuffer,
         .dstPitch = width * bpp,
         .WidthInBytes = width * bpp,
         .Height = height
@@ -2515,19 +3677,18 @@ static bool convertNV12ToARGBCuda(NVDriver *drv, BackingImage *srcImg, BackingIm
         .srcMemoryType = CU_MEMORYTYPE_ARRAY,
         .srcArray = srcImg->arrays[1],
         .dstMemoryType = CU_MEMORYTYPE_DEVICE,
-        .dstDevice = drv->videoProcUVBuffer,
+        .dstDevice = nvCtx->videoProcUVBuffer,
         .dstPitch = width * bpp,
         .WidthInBytes = width * bpp,
         .Height = uvHeight
     };
-    // Queue the two input copies async on stream 0; the kernel below runs on
-    // the same stream so it observes them in order, and the frame is fully
-    // synchronised before we signal completion (cuStreamSynchronize for an
-    // external dst, or the synchronous ARGB copy-back otherwise). This drops two
-    // host-side blocking waits per converted frame.
-    if (CHECK_CUDA_RESULT(drv->cu->cuMemcpy2DAsync(&yCpy, 0)) ||
-        CHECK_CUDA_RESULT(drv->cu->cuMemcpy2DAsync(&uvCpy, 0))) {
-        goto fail;
+    // Queue everything on the context's stream: the input copies, the kernel
+    // and the ARGB copy-back run in order, and a single cuStreamSynchronize at
+    // the end completes the frame. Other VideoProc contexts use their own
+    // streams, so their conversions can overlap with this one.
+    if (CHECK_CUDA_RESULT(drv->cu->cuMemcpy2DAsync(&yCpy, stream)) ||
+        CHECK_CUDA_RESULT(drv->cu->cuMemcpy2DAsync(&uvCpy, stream))) {
+        return false;
     }
 
     uint32_t yPitch = width * bpp;
@@ -2544,8 +3705,8 @@ static bool convertNV12ToARGBCuda(NVDriver *drv, BackingImage *srcImg, BackingIm
     uint32_t rounding = (uint32_t) sampleInfo.rounding;
     uint32_t valueShift = (uint32_t) sampleInfo.valueShift;
     void *nv12Args[] = {
-        &drv->videoProcYBuffer,
-        &drv->videoProcUVBuffer,
+        &nvCtx->videoProcYBuffer,
+        &nvCtx->videoProcUVBuffer,
         &dstDevice,
         &width,
         &height,
@@ -2564,8 +3725,8 @@ static bool convertNV12ToARGBCuda(NVDriver *drv, BackingImage *srcImg, BackingIm
         &valueShift
     };
     void *p010Args[] = {
-        &drv->videoProcYBuffer,
-        &drv->videoProcUVBuffer,
+        &nvCtx->videoProcYBuffer,
+        &nvCtx->videoProcUVBuffer,
         &dstDevice,
         &width,
         &height,
@@ -2588,152 +3749,314 @@ static bool convertNV12ToARGBCuda(NVDriver *drv, BackingImage *srcImg, BackingIm
     CUfunction kernel = is16Bit ? drv->p010ToArgbKernel : drv->nv12ToArgbKernel;
     if (CHECK_CUDA_RESULT(drv->cu->cuLaunchKernel(kernel,
             (width + 15) / 16, (height + 15) / 16, 1,
-            16, 16, 1, 0, 0, args, NULL))) {
-        goto fail;
+            16, 16, 1, 0, stream, args, NULL))) {
+        return false;
     }
 
     if (dstImg->externalDevicePtr == 0) {
         CUDA_MEMCPY2D argbCpy = {
             .srcMemoryType = CU_MEMORYTYPE_DEVICE,
-            .srcDevice = drv->videoProcArgbBuffer,
+            .srcDevice = nvCtx->videoProcArgbBuffer,
             .srcPitch = width * 4,
             .dstMemoryType = CU_MEMORYTYPE_ARRAY,
             .dstArray = dstImg->arrays[0],
             .WidthInBytes = width * 4,
             .Height = height
         };
-        if (CHECK_CUDA_RESULT(drv->cu->cuMemcpy2D(&argbCpy))) {
-            goto fail;
+        if (CHECK_CUDA_RESULT(drv->cu->cuMemcpy2DAsync(&argbCpy, stream))) {
+            return false;
         }
-    } else if (CHECK_CUDA_RESULT(drv->cu->cuStreamSynchronize(0))) {
-        goto fail;
     }
 
-    pthread_mutex_unlock(&drv->exportMutex);
-    return true;
-
-fail:
-    pthread_mutex_unlock(&drv->exportMutex);
-    return false;
+    return !CHECK_CUDA_RESULT(drv->cu->cuStreamSynchronize(stream));
 }
 
-static bool convertNV12ToARGB(NVDriver *drv, BackingImage *srcImg, BackingImage *dstImg, uint32_t width, uint32_t height, const ColorMatrix *matrix, VideoProcSampleInfo sampleInfo) {
-    const bool is16Bit = srcImg->format == NV_FORMAT_P010 || srcImg->format == NV_FORMAT_P012;
-    const char *formatName = is16Bit ? "P010/P012" : "NV12";
+static void fillRgbRow(uint8_t *row, uint32_t from, uint32_t to, uint32_t packed) {
+    for (uint32_t x = from; x < to; x++) {
+        memcpy(row + (size_t) x * 4, &packed, 4);
+    }
+}
 
-    if (dstImg->externalMapping == NULL || dstImg->externalDevicePtr != 0) {
-        if (convertNV12ToARGBCuda(drv, srcImg, dstImg, width, height, is16Bit, matrix, sampleInfo)) {
-            nvStatsIncrement(drv, NV_STAT_VIDEOPROC_CUDA);
-            static bool loggedCudaVideoProc[2] = { false, false };
-            const int logIndex = is16Bit ? 1 : 0;
-            if (!loggedCudaVideoProc[logIndex]) {
-                LOG("Using CUDA %s to RGB VideoProc conversion", formatName);
-                loggedCudaVideoProc[logIndex] = true;
-            }
-            return true;
+// One CPU conversion, shared by the threads working on it. Everything but
+// nextBand is read-only once the threads have started.
+typedef struct _CpuVideoProcJob {
+    const VideoProcBlit *blit;
+    const ColorMatrix   *matrix;
+    VideoProcSampleInfo sampleInfo;
+    const uint8_t       *yPlane;
+    const uint8_t       *uvPlane;
+    size_t              srcPitch;
+    uint32_t            srcWidth;
+    uint32_t            srcHeight;
+    uint8_t             *dst;
+    size_t              dstPitch;
+    uint32_t            order;
+    uint32_t            background;
+    bool                is16Bit;
+    uint32_t            bands;
+    atomic_uint         nextBand;
+} CpuVideoProcJob;
+
+static void convertCpuVideoProcRows(const CpuVideoProcJob *job, uint32_t firstRow, uint32_t lastRow) {
+    const VideoProcBlit *blit = job->blit;
+    const uint32_t width = blit->targetWidth;
+    const uint32_t dstX0 = (uint32_t) blit->dst.x;
+    const uint32_t dstY0 = (uint32_t) blit->dst.y;
+    const uint32_t dstX1 = dstX0 + blit->dst.width;
+    //horizontally unscaled rows are one contiguous run of source pixels
+    const bool contiguous = blit->scaleX == 1.0f && blit->srcX == (float) (uint32_t) blit->srcX;
+
+    for (uint32_t y = firstRow; y < lastRow; y++) {
+        uint8_t *row = job->dst + (size_t) y * job->dstPitch;
+        if (y - dstY0 >= blit->dst.height) {
+            fillRgbRow(row, 0, width, job->background);
+            continue;
         }
-        nvStatsIncrement(drv, NV_STAT_VIDEOPROC_CUDA_FAILURES);
-        static bool loggedCudaFallback[2] = { false, false };
-        const int logIndex = is16Bit ? 1 : 0;
-        if (!loggedCudaFallback[logIndex]) {
-            LOG("CUDA %s to RGB conversion failed, falling back to CPU", formatName);
-            loggedCudaFallback[logIndex] = true;
+        fillRgbRow(row, 0, dstX0, job->background);
+        fillRgbRow(row, dstX1, width, job->background);
+
+        uint32_t sy = (uint32_t) (blit->srcY + ((float) (y - dstY0) + 0.5f) * blit->scaleY);
+        sy = MIN(sy, job->srcHeight - 1);
+        const uint8_t *yRow = job->yPlane + (size_t) sy * job->srcPitch;
+        const uint8_t *uvRow = job->uvPlane + (size_t) (sy / 2) * job->srcPitch;
+        uint8_t *out = row + (size_t) dstX0 * 4;
+        if (contiguous) {
+            nvConvertYuvRowToRgb(yRow, uvRow, (uint32_t) blit->srcX, blit->dst.width, out, job->order, job->is16Bit, job->matrix, &job->sampleInfo);
+            continue;
+        }
+        for (uint32_t x = 0; x < blit->dst.width; x++) {
+            uint32_t sx = (uint32_t) (blit->srcX + ((float) x + 0.5f) * blit->scaleX);
+            sx = MIN(sx, job->srcWidth - 1);
+            nvConvertYuvRowToRgbScalar(yRow, uvRow, sx, 1, out + (size_t) x * 4, job->order, job->is16Bit, job->matrix, &job->sampleInfo);
         }
     }
-    nvStatsIncrement(drv, NV_STAT_VIDEOPROC_CPU_FALLBACK);
-
-    const size_t bpp = is16Bit ? 2 : 1;
-    const size_t ySize = (size_t) width * height * bpp;
-    const size_t uvSize = (size_t) width * ((height + 1) / 2) * bpp;
-    const size_t argbSize = (size_t) width * height * 4;
+}
 
-    pthread_mutex_lock(&drv->exportMutex);
+static void *convertCpuVideoProcBands(void *arg) {
+    CpuVideoProcJob *job = (CpuVideoProcJob*) arg;
+    const uint32_t height = job->blit->targetHeight;
 
-    if (!ensureCpuVideoProcBuffer(&drv->cpuVideoProcYBuffer, &drv->cpuVideoProcYBufferSize, ySize) ||
-        !ensureCpuVideoProcBuffer(&drv->cpuVideoProcUVBuffer, &drv->cpuVideoProcUVBufferSize, uvSize)) {
-        goto fail;
-    }
-    if (dstImg->externalMapping == NULL &&
-        !ensureCpuVideoProcBuffer(&drv->cpuVideoProcArgbBuffer, &drv->cpuVideoProcArgbBufferSize, argbSize)) {
-        goto fail;
+    uint32_t band;
+    while ((band = atomic_fetch_add(&job->nextBand, 1)) < job->bands) {
+        const uint32_t firstRow = band * VIDEO_PROC_CPU_BAND_ROWS;
+        convertCpuVideoProcRows(job, firstRow, MIN(firstRow + VIDEO_PROC_CPU_BAND_ROWS, height));
     }
 
-    uint8_t *yPlane = drv->cpuVideoProcYBuffer;
-    uint8_t *uvPlane = drv->cpuVideoProcUVBuffer;
-    uint8_t *argb = dstImg->externalMapping == NULL ? drv->cpuVideoProcArgbBuffer : NULL;
+    return NULL;
+}
+
+// Helper thread of the CPU fallback. Joins each job published in
+// drv->cpuVideoProcJob, taking bands until none are left.
+static void *cpuVideoProcThread(void *arg) {
+    NVDriver *drv = (NVDriver*) arg;
+    uint64_t seenGeneration = 0;
 
-    if (srcImg->externalMapping != NULL) {
-        const uint8_t *srcY = (const uint8_t*) srcImg->externalMapping + srcImg->offsets[0];
-        const uint8_t *srcUV = (const uint8_t*) srcImg->externalMapping + srcImg->offsets[1];
-        for (uint32_t y = 0; y < height; y++) {
-            memcpy(yPlane + (size_t) y * width * bpp, srcY + (size_t) y * srcImg->strides[0], width * bpp);
+    pthread_mutex_lock(&drv->cpuVideoProcMutex);
+    while (true) {
+        while (!drv->cpuVideoProcExiting && drv->cpuVideoProcGeneration == seenGeneration) {
+            pthread_cond_wait(&drv->cpuVideoProcJobCond, &drv->cpuVideoProcMutex);
         }
-        for (uint32_t y = 0; y < (height + 1) / 2; y++) {
-            memcpy(uvPlane + (size_t) y * width * bpp, srcUV + (size_t) y * srcImg->strides[1], width * bpp);
+        if (drv->cpuVideoProcExiting) {
+            break;
         }
-    } else {
-        CUDA_MEMCPY2D yCpy = {
-            .srcMemoryType = CU_MEMORYTYPE_ARRAY,
+        seenGeneration = drv->cpuVideoProcGeneration;
+        //woke up after the submitter already finished the job on its own
+        CpuVideoProcJob *job = drv->cpuVideoProcJob;
+        if (job == NULL) {
+            continue;
+        }
+        drv->cpuVideoProcBusyThreads++;
+        pthread_mutex_unlock(&drv->cpuVideoProcMutex);
+
+        convertCpuVideoProcBands(job);
+
+        pthread_mutex_lock(&drv->cpuVideoProcMutex);
+        if (--drv->cpuVideoProcBusyThreads == 0) {
+            pthread_cond_broadcast(&drv->cpuVideoProcIdleCond);
+        }
+    }
+    pthread_mutex_unlock(&drv->cpuVideoProcMutex);
+
+    return NULL;
+}
+
+//expects cpuVideoProcMutex to be held
+static void startCpuVideoProcThreads(NVDriver *drv) {
+    drv->cpuVideoProcThreadsStarted = true;
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t threadCount = VIDEO_PROC_CPU_MAX_THREADS - 1;
+    if (cpus > 0 && threadCount > (uint32_t) cpus - 1) {
+        threadCount = (uint32_t) cpus - 1;
+    }
+    for (uint32_t i = 0; i < threadCount; i++) {
+        if (pthread_create(&drv->cpuVideoProcThreads[i], NULL, &cpuVideoProcThread, drv) != 0) {
+            break;
+        }
+        drv->cpuVideoProcThreadCount++;
+    }
+    LOG("Started %u CPU VideoProc threads", drv->cpuVideoProcThreadCount);
+}
+
+static void stopCpuVideoProcThreads(NVDriver *drv) {
+    pthread_mutex_lock(&drv->cpuVideoProcMutex);
+    drv->cpuVideoProcExiting = true;
+    pthread_cond_broadcast(&drv->cpuVideoProcJobCond);
+    pthread_mutex_unlock(&drv->cpuVideoProcMutex);
+
+    for (uint32_t i = 0; i < drv->cpuVideoProcThreadCount; i++) {
+        pthread_join(drv->cpuVideoProcThreads[i], NULL);
+    }
+    drv->cpuVideoProcThreadCount = 0;
+}
+
+// Splits the conversion into bands of rows and works through them on the
+// calling thread and the driver's persistent helper threads. If another
+// conversion has the helpers, this one runs on the calling thread alone
+// rather than waiting for them.
+static void runCpuVideoProcJob(NVDriver *drv, CpuVideoProcJob *job) {
+    job->bands = (job->blit->targetHeight + VIDEO_PROC_CPU_BAND_ROWS - 1) / VIDEO_PROC_CPU_BAND_ROWS;
+    atomic_init(&job->nextBand, 0);
+
+    if (job->bands < 2 || pthread_mutex_trylock(&drv->cpuVideoProcSubmitMutex) != 0) {
+        convertCpuVideoProcBands(job);
+        return;
+    }
+
+    pthread_mutex_lock(&drv->cpuVideoProcMutex);
+    if (!drv->cpuVideoProcThreadsStarted) {
+        startCpuVideoProcThreads(drv);
+    }
+    drv->cpuVideoProcJob = job;
+    drv->cpuVideoProcGeneration++;
+    pthread_cond_broadcast(&drv->cpuVideoProcJobCond);
+    pthread_mutex_unlock(&drv->cpuVideoProcMutex);
+
+    convertCpuVideoProcBands(job);
+
+    //no more helpers may join, then wait for the ones still converting a band
+    pthread_mutex_lock(&drv->cpuVideoProcMutex);
+    drv->cpuVideoProcJob = NULL;
+    while (drv->cpuVideoProcBusyThreads > 0) {
+        pthread_cond_wait(&drv->cpuVideoProcIdleCond, &drv->cpuVideoProcMutex);
+    }
+    pthread_mutex_unlock(&drv->cpuVideoProcMutex);
+
+    pthread_mutex_unlock(&drv->cpuVideoProcSubmitMutex);
+}
+
+static bool convertNV12ToARGB(NVContext *nvCtx, BackingImage *srcImg, BackingImage *dstImg, const VideoProcBlit *blit, const ColorMatrix *matrix, VideoProcSampleInfo sampleInfo) {
+    NVDriver *drv = nvCtx->drv;
+    const bool is16Bit = srcImg->format == NV_FORMAT_P010 || srcImg->format == NV_FORMAT_P012;
+    const char *formatName = is16Bit ? "P010/P012" : "NV12";
+
+    if (dstImg->externalMapping == NULL || dstImg->externalDevicePtr != 0) {
+        if (convertNV12ToARGBCuda(nvCtx, srcImg, dstImg, blit, is16Bit, matrix, sampleInfo)) {
+            nvStatsIncrement(drv, NV_STAT_VIDEOPROC_CUDA);
+            static bool loggedCudaVideoProc[2] = { false, false };
+            const int logIndex = is16Bit ? 1 : 0;
+            if (!loggedCudaVideoProc[logIndex]) {
+                LOG("Using CUDA %s to RGB VideoProc conversion", formatName);
+                loggedCudaVideoProc[logIndex] = true;
+            }
+            return true;
+        }
+        nvStatsIncrement(drv, NV_STAT_VIDEOPROC_CUDA_FAILURES);
+        static bool loggedCudaFallback[2] = { false, false };
+        const int logIndex = is16Bit ? 1 : 0;
+        if (!loggedCudaFallback[logIndex]) {
+            LOG("CUDA %s to RGB conversion failed, falling back to CPU", formatName);
+            loggedCudaFallback[logIndex] = true;
+        }
+    }
+    nvStatsIncrement(drv, NV_STAT_VIDEOPROC_CPU_FALLBACK);
+
+    //the CPU path always uses nearest sampling, so it reads the whole source
+    const uint32_t srcWidth = srcImg->width;
+    const uint32_t srcHeight = srcImg->height;
+    const uint32_t width = blit->targetWidth;
+    const uint32_t height = blit->targetHeight;
+    const size_t bpp = is16Bit ? 2 : 1;
+    const size_t ySize = (size_t) srcWidth * srcHeight * bpp;
+    const size_t uvSize = (size_t) srcWidth * ((srcHeight + 1) / 2) * bpp;
+    const size_t argbSize = dstImg->externalMapping == NULL ? (size_t) width * height * 4 : 0;
+
+    //the scratch buffer belongs to the context, so concurrent conversions on other contexts don't serialise on a lock
+    const size_t scratchSize = ySize + uvSize + argbSize;
+    if (nvCtx->videoProcCpuScratchSize < scratchSize) {
+        uint8_t *grown = realloc(nvCtx->videoProcCpuScratch, scratchSize);
+        if (grown == NULL) {
+            return false;
+        }
+        nvCtx->videoProcCpuScratch = grown;
+        nvCtx->videoProcCpuScratchSize = scratchSize;
+    }
+    uint8_t *scratch = nvCtx->videoProcCpuScratch;
+    uint8_t *yPlane = scratch;
+    uint8_t *uvPlane = scratch + ySize;
+    uint8_t *argb = dstImg->externalMapping == NULL ? scratch + ySize + uvSize : NULL;
+
+    if (srcImg->externalMapping != NULL) {
+        const uint8_t *srcY = (const uint8_t*) srcImg->externalMapping + srcImg->offsets[0];
+        const uint8_t *srcUV = (const uint8_t*) srcImg->externalMapping + srcImg->offsets[1];
+        for (uint32_t y = 0; y < srcHeight; y++) {
+            memcpy(yPlane + (size_t) y * srcWidth * bpp, srcY + (size_t) y * srcImg->strides[0], srcWidth * bpp);
+        }
+        for (uint32_t y = 0; y < (srcHeight + 1) / 2; y++) {
+            memcpy(uvPlane + (size_t) y * srcWidth * bpp, srcUV + (size_t) y * srcImg->strides[1], srcWidth * bpp);
+        }
+    } else {
+        CUDA_MEMCPY2D yCpy = {
+            .srcMemoryType = CU_MEMORYTYPE_ARRAY,
             .srcArray = srcImg->arrays[0],
             .dstMemoryType = CU_MEMORYTYPE_HOST,
             .dstHost = yPlane,
-            .dstPitch = width * bpp,
-            .WidthInBytes = width * bpp,
-            .Height = height
+            .dstPitch = srcWidth * bpp,
+            .WidthInBytes = srcWidth * bpp,
+            .Height = srcHeight
         };
         CUDA_MEMCPY2D uvCpy = {
             .srcMemoryType = CU_MEMORYTYPE_ARRAY,
             .srcArray = srcImg->arrays[1],
             .dstMemoryType = CU_MEMORYTYPE_HOST,
             .dstHost = uvPlane,
-            .dstPitch = width * bpp,
-            .WidthInBytes = width * bpp,
-            .Height = (height + 1) / 2
+            .dstPitch = srcWidth * bpp,
+            .WidthInBytes = srcWidth * bpp,
+            .Height = (srcHeight + 1) / 2
         };
 
         if (CHECK_CUDA_RESULT(drv->cu->cuMemcpy2D(&yCpy)) ||
             CHECK_CUDA_RESULT(drv->cu->cuMemcpy2D(&uvCpy))) {
-            goto fail;
+            return false;
         }
     }
 
-    for (uint32_t y = 0; y < height; y++) {
-        for (uint32_t x = 0; x < width; x++) {
-            int yy, u, v;
-            if (is16Bit) {
-                const uint16_t *yPlane16 = (const uint16_t*) yPlane;
-                const uint16_t *uvPlane16 = (const uint16_t*) uvPlane;
-                yy = yPlane16[(size_t) y * width + x] >> sampleInfo.sampleShift;
-                const size_t uvIndex = (size_t) (y / 2) * width + (x & ~1u);
-                u = uvPlane16[uvIndex] >> sampleInfo.sampleShift;
-                v = uvPlane16[uvIndex + 1] >> sampleInfo.sampleShift;
-            } else {
-                yy = yPlane[(size_t) y * width + x];
-                const size_t uvIndex = (size_t) (y / 2) * width + (x & ~1u);
-                u = uvPlane[uvIndex];
-                v = uvPlane[uvIndex + 1];
-            }
-            const int c = yy > sampleInfo.yOffset ? yy - sampleInfo.yOffset : 0;
-            const int d = u - sampleInfo.uvOffset;
-            const int e = v - sampleInfo.uvOffset;
-            const uint8_t r = clampU8((sampleInfo.yScale * c + matrix->vToR * e + sampleInfo.rounding) >> sampleInfo.valueShift);
-            const uint8_t g = clampU8((sampleInfo.yScale * c - matrix->uToG * d - matrix->vToG * e + sampleInfo.rounding) >> sampleInfo.valueShift);
-            const uint8_t b = clampU8((sampleInfo.yScale * c + matrix->uToB * d + sampleInfo.rounding) >> sampleInfo.valueShift);
-            if (dstImg->externalMapping != NULL) {
-                uint8_t *row = (uint8_t*) dstImg->externalMapping + dstImg->offsets[0] + (size_t) y * dstImg->strides[0];
-                writeRgbPixel(row + (size_t) x * 4, (uint32_t) dstImg->fourcc, r, g, b);
-            } else {
-                const size_t out = ((size_t) y * width + x) * 4;
-                argb[out + 0] = b;
-                argb[out + 1] = g;
-                argb[out + 2] = r;
-                argb[out + 3] = 255;
-            }
-        }
-    }
+    static bool loggedCpuImplementation = false;
+    if (!loggedCpuImplementation) {
+        LOG("CPU VideoProc conversion using %s", nvConvertYuvRowToRgbImplementation());
+        loggedCpuImplementation = true;
+    }
+
+    //the scratch buffer is uploaded to the target array as BGRA
+    const uint32_t order = dstImg->externalMapping != NULL ? rgbOrderForFourcc((uint32_t) dstImg->fourcc) : 0;
+    CpuVideoProcJob job = {
+        .blit = blit,
+        .matrix = matrix,
+        .sampleInfo = sampleInfo,
+        .yPlane = yPlane,
+        .uvPlane = uvPlane,
+        .srcPitch = (size_t) srcWidth * bpp,
+        .srcWidth = srcWidth,
+        .srcHeight = srcHeight,
+        .dst = argb != NULL ? argb : (uint8_t*) dstImg->externalMapping + dstImg->offsets[0],
+        .dstPitch = argb != NULL ? (size_t) width * 4 : (size_t) dstImg->strides[0],
+        .order = order,
+        .background = packRgbForOrder(order, blit->background),
+        .is16Bit = is16Bit
+    };
+    runCpuVideoProcJob(drv, &job);
 
-    if (dstImg->externalMapping != NULL) {
-        pthread_mutex_unlock(&drv->exportMutex);
+    if (argb == NULL) {
         return true;
     }
 
@@ -2746,25 +4069,538 @@ static bool convertNV12ToARGB(NVDriver *drv, BackingImage *srcImg, BackingImage
         .WidthInBytes = width * 4,
         .Height = height
     };
-    bool failed = CHECK_CUDA_RESULT(drv->cu->cuMemcpy2D(&argbCpy));
+    return !CHECK_CUDA_RESULT(drv->cu->cuMemcpy2D(&argbCpy));
+}
+
+typedef struct {
+    CUmemorytype    type;
+    CUarray         array;
+    CUdeviceptr     device;
+    void            *host;
+    size_t          pitch;
+} VideoProcPlane;
+
+// Where one plane of a backing image can be copied from or to: its CUDA
+// array, or failing that the external device or CPU mapping.
+static bool videoProcPlaneForImage(const BackingImage *img, uint32_t plane, VideoProcPlane *out) {
+    *out = (VideoProcPlane) { 0 };
+    if (img->arrays[plane] != NULL) {
+        out->type = CU_MEMORYTYPE_ARRAY;
+        out->array = img->arrays[plane];
+    } else if (img->externalDevicePtr != 0) {
+        out->type = CU_MEMORYTYPE_DEVICE;
+        out->device = img->externalDevicePtr + (CUdeviceptr) img->offsets[plane];
+        out->pitch = (size_t) img->strides[plane];
+    } else if (img->externalMapping != NULL) {
+        out->type = CU_MEMORYTYPE_HOST;
+        out->host = (uint8_t*) img->externalMapping + img->offsets[plane];
+        out->pitch = (size_t) img->strides[plane];
+    } else {
+        return false;
+    }
+    return true;
+}
+
+typedef struct {
+    CUdeviceptr ptr[3];
+    uint32_t    pitch[3];
+    bool        direct;
+} VideoProcOutput;
+
+// Picks where a format kernel writes each plane of dstImg: straight into its
+// device mapping when it has one, otherwise into the context's scratch buffer
+// from where finishVideoProcOutput copies the planes into place.
+static bool beginVideoProcOutput(NVContext *nvCtx, const BackingImage *dstImg, uint32_t width, uint32_t height, VideoProcOutput *out) {
+    const NVFormatInfo *fmtInfo = &formatsInfo[dstImg->format];
+    size_t offsets[3] = { 0 };
+    size_t size = 0;
+
+    *out = (VideoProcOutput) { .direct = dstImg->externalDevicePtr != 0 };
+    for (uint32_t i = 0; i < fmtInfo->numPlanes; i++) {
+        const NVFormatPlane *p = &fmtInfo->plane[i];
+        out->pitch[i] = out->direct ? (uint32_t) dstImg->strides[i] : ((width + p->ss.x) >> p->ss.x) * fmtInfo->bppc * p->channelCount;
+        offsets[i] = size;
+        size += (size_t) out->pitch[i] * ((height + p->ss.y) >> p->ss.y);
+    }
+
+    if (!out->direct && !ensureVideoProcBuffer(nvCtx->drv, &nvCtx->videoProcOutBuffer, &nvCtx->videoProcOutBufferSize, size)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < fmtInfo->numPlanes; i++) {
+        out->ptr[i] = out->direct ? dstImg->externalDevicePtr + (CUdeviceptr) dstImg->offsets[i] : nvCtx->videoProcOutBuffer + offsets[i];
+    }
+    return true;
+}
+
+static bool finishVideoProcOutput(NVContext *nvCtx, const BackingImage *dstImg, uint32_t width, uint32_t height, const VideoProcOutput *out) {
+    NVDriver *drv = nvCtx->drv;
+    const NVFormatInfo *fmtInfo = &formatsInfo[dstImg->format];
+
+    for (uint32_t i = 0; !out->direct && i < fmtInfo->numPlanes; i++) {
+        VideoProcPlane dst;
+        if (!videoProcPlaneForImage(dstImg, i, &dst)) {
+            return false;
+        }
+        CUDA_MEMCPY2D cpy = {
+            .srcMemoryType = CU_MEMORYTYPE_DEVICE,
+            .srcDevice = out->ptr[i],
+            .srcPitch = out->pitch[i],
+            .dstMemoryType = dst.type,
+            .dstArray = dst.array,
+            .dstDevice = dst.device,
+            .dstHost = dst.host,
+            .dstPitch = dst.pitch,
+            .WidthInBytes = out->pitch[i],
+            .Height = (height + fmtInfo->plane[i].ss.y) >> fmtInfo->plane[i].ss.y
+        };
+        if (CHECK_CUDA_RESULT(drv->cu->cuMemcpy2DAsync(&cpy, nvCtx->videoProcStream))) {
+            return false;
+        }
+    }
+
+    return !CHECK_CUDA_RESULT(drv->cu->cuStreamSynchronize(nvCtx->videoProcStream));
+}
+
+// Queues a copy of one plane of img into linear device memory with the given
+// pitch, which is also the number of bytes copied per row.
+static bool stageVideoProcPlane(NVContext *nvCtx, const BackingImage *img, uint32_t plane, CUdeviceptr dst, uint32_t pitch, uint32_t rows) {
+    VideoProcPlane src;
+    if (!videoProcPlaneForImage(img, plane, &src)) {
+        return false;
+    }
+    CUDA_MEMCPY2D cpy = {
+        .srcMemoryType = src.type,
+        .srcArray = src.array,
+        .srcDevice = src.device,
+        .srcHost = src.host,
+        .srcPitch = src.pitch,
+        .dstMemoryType = CU_MEMORYTYPE_DEVICE,
+        .dstDevice = dst,
+        .dstPitch = pitch,
+        .WidthInBytes = pitch,
+        .Height = rows
+    };
+    return !CHECK_CUDA_RESULT(nvCtx->drv->cu->cuMemcpy2DAsync(&cpy, nvCtx->videoProcStream));
+}
 
+static int videoProcYuvLayout(NVFormat format) {
+    switch (format) {
+    case NV_FORMAT_NV12:
+    case NV_FORMAT_P010:
+    case NV_FORMAT_P012:
+    case NV_FORMAT_P016:
+        return 0;
+    case NV_FORMAT_I420:
+        return 1;
+    case NV_FORMAT_YUY2:
+        return 2;
+    default:
+        return -1;
+    }
+}
+
+// Converts a 4:2:0 semi-planar source to another YUV layout or sample size
+// without touching the colour values, so it only handles 1:1 blits. The
+// source planes are staged into linear scratch memory for the kernel.
+static bool convertVideoProcYuv(NVContext *nvCtx, BackingImage *srcImg, BackingImage *dstImg, const VideoProcBlit *blit) {
+    NVDriver *drv = nvCtx->drv;
+    const NVFormatInfo *srcInfo = &formatsInfo[srcImg->format];
+    const NVFormatInfo *dstInfo = &formatsInfo[dstImg->format];
+
+    if (!ensureVideoProcStream(nvCtx)) {
+        return false;
+    }
+    pthread_mutex_lock(&drv->exportMutex);
+    const bool kernelLoaded = loadVideoProcFormatKernels(drv);
     pthread_mutex_unlock(&drv->exportMutex);
-    return !failed;
+    if (!kernelLoaded) {
+        return false;
+    }
 
-fail:
+    uint32_t width = blit->targetWidth;
+    uint32_t height = blit->targetHeight;
+    //odd sizes keep their last chroma column and row, the kernel works on whole 2x2 blocks
+    uint32_t chromaWidth = (width + 1) / 2;
+    uint32_t chromaHeight = (height + 1) / 2;
+    //the chroma rows are as wide in bytes as the luma rows
+    uint32_t srcPitch = chromaWidth * 2 * srcInfo->bppc;
+    if (!ensureVideoProcBuffer(drv, &nvCtx->videoProcYBuffer, &nvCtx->videoProcYBufferSize, (size_t) srcPitch * chromaHeight * 2) ||
+        !ensureVideoProcBuffer(drv, &nvCtx->videoProcUVBuffer, &nvCtx->videoProcUVBufferSize, (size_t) srcPitch * chromaHeight)) {
+        return false;
+    }
+
+    if (!stageVideoProcPlane(nvCtx, srcImg, 0, nvCtx->videoProcYBuffer, srcPitch, chromaHeight * 2) ||
+        !stageVideoProcPlane(nvCtx, srcImg, 1, nvCtx->videoProcUVBuffer, srcPitch, chromaHeight)) {
+        return false;
+    }
+
+    //room for the whole blocks the kernel writes, only the surface's own rows are copied out
+    VideoProcOutput out;
+    if (!beginVideoProcOutput(nvCtx, dstImg, chromaWidth * 2, chromaHeight * 2, &out)) {
+        return false;
+    }
+
+    uint32_t src16 = srcInfo->bppc == 2;
+    uint32_t dst16 = dstInfo->bppc == 2;
+    uint32_t layout = (uint32_t) videoProcYuvLayout(dstImg->format);
+    void *args[] = {
+        &nvCtx->videoProcYBuffer,
+        &nvCtx->videoProcUVBuffer,
+        &out.ptr[0],
+        &out.ptr[1],
+        &out.ptr[2],
+        &chromaWidth,
+        &chromaHeight,
+        &srcPitch,
+        &srcPitch,
+        &out.pitch[0],
+        &out.pitch[1],
+        &out.pitch[2],
+        &src16,
+        &dst16,
+        &layout
+    };
+    if (CHECK_CUDA_RESULT(drv->cu->cuLaunchKernel(drv->yuvConvertKernel,
+            (chromaWidth + 15) / 16, (chromaHeight + 15) / 16, 1,
+            16, 16, 1, 0, nvCtx->videoProcStream, args, NULL))) {
+        return false;
+    }
+
+    return finishVideoProcOutput(nvCtx, dstImg, width, height, &out);
+}
+
+// Planar RGB is produced by the packed conversion into scratch memory, so it
+// scales, crops and fills the background like any RGB target, followed by a
+// kernel splitting the channels into the three planes.
+static bool convertNV12ToPlanarRgb(NVContext *nvCtx, BackingImage *srcImg, BackingImage *dstImg, const VideoProcBlit *blit, bool is16Bit, const ColorMatrix *matrix, VideoProcSampleInfo sampleInfo) {
+    NVDriver *drv = nvCtx->drv;
+
+    if (!ensureVideoProcStream(nvCtx)) {
+        return false;
+    }
+    pthread_mutex_lock(&drv->exportMutex);
+    const bool kernelLoaded = loadVideoProcFormatKernels(drv);
     pthread_mutex_unlock(&drv->exportMutex);
-    return false;
+    if (!kernelLoaded) {
+        return false;
+    }
+
+    uint32_t width = blit->targetWidth;
+    uint32_t height = blit->targetHeight;
+    uint32_t rgbaPitch = width * 4;
+    if (!ensureVideoProcBuffer(drv, &nvCtx->videoProcArgbBuffer, &nvCtx->videoProcArgbBufferSize, (size_t) rgbaPitch * height)) {
+        return false;
+    }
+
+    BackingImage rgba = {
+        .width = width,
+        .height = height,
+        .format = NV_FORMAT_ARGB,
+        .fourcc = VA_FOURCC_RGBA,
+        .strides = { (int) rgbaPitch },
+        .externalDevicePtr = nvCtx->videoProcArgbBuffer
+    };
+    if (!convertNV12ToARGBCuda(nvCtx, srcImg, &rgba, blit, is16Bit, matrix, sampleInfo)) {
+        return false;
+    }
+
+    VideoProcOutput out;
+    if (!beginVideoProcOutput(nvCtx, dstImg, width, height, &out)) {
+        return false;
+    }
+
+    void *args[] = {
+        &nvCtx->videoProcArgbBuffer,
+        &out.ptr[0],
+        &out.ptr[1],
+        &out.ptr[2],
+        &width,
+        &height,
+        &rgbaPitch,
+        &out.pitch[0],
+        &out.pitch[1],
+        &out.pitch[2]
+    };
+    if (CHECK_CUDA_RESULT(drv->cu->cuLaunchKernel(drv->rgbaToPlanarKernel,
+            (width + 15) / 16, (height + 15) / 16, 1,
+            16, 16, 1, 0, nvCtx->videoProcStream, args, NULL))) {
+        return false;
+    }
+
+    return finishVideoProcOutput(nvCtx, dstImg, width, height, &out);
 }
 
-static bool copySurfaceBackingImage(NVDriver *drv, NVSurface *src, NVSurface *dst, const VAProcPipelineParameterBuffer *pipeline) {
-    if (src == NULL || dst == NULL || pipeline == NULL) {
-        // The destination (render target) was marked resolving in nvBeginPicture;
-        // clear it so a later vaSyncSurface doesn't block forever on a blit we
-        // never performed.
-        setSurfaceResolving(dst, false);
+// (Re)creates the context's deinterlacer output to match srcImg. It is a
+// plain set of CUDA arrays so it can stand in for the source surface in every
+// later step of the pipeline.
+static bool ensureVideoProcDeinterlaceImage(NVContext *nvCtx, const BackingImage *srcImg) {
+    BackingImage *img = nvCtx->videoProcDeintImage;
+    if (img != NULL && img->format == srcImg->format && img->width == srcImg->width && img->height == srcImg->height) {
+        return true;
+    }
+    destroyVideoProcImage(img);
+    nvCtx->videoProcDeintImage = NULL;
+
+    img = calloc(1, sizeof(BackingImage));
+    if (img == NULL) {
         return false;
     }
+    const NVFormatInfo *fmtInfo = &formatsInfo[srcImg->format];
+    img->format = srcImg->format;
+    img->fourcc = (int) fmtInfo->vaFormat.fourcc;
+    img->width = srcImg->width;
+    img->height = srcImg->height;
+    for (int i = 0; i < 4; i++) {
+        img->fds[i] = -1;
+    }
+    for (uint32_t i = 0; i < fmtInfo->numPlanes; i++) {
+        const NVFormatPlane *p = &fmtInfo->plane[i];
+        CUDA_ARRAY3D_DESCRIPTOR desc = {
+            .Width = img->width >> p->ss.x,
+            .Height = img->height >> p->ss.y,
+            .Depth = 0,
+            .Format = fmtInfo->bppc == 1 ? CU_AD_FORMAT_UNSIGNED_INT8 : CU_AD_FORMAT_UNSIGNED_INT16,
+            .NumChannels = p->channelCount,
+            .Flags = 0
+        };
+        if (CHECK_CUDA_RESULT(nvCtx->drv->cu->cuArray3DCreate(&img->arrays[i], &desc))) {
+            destroyVideoProcImage(img);
+            return false;
+        }
+    }
 
+    nvCtx->videoProcDeintImage = img;
+    return true;
+}
+
+// Deinterlaces a 4:2:0 semi-planar source into the context's own image and
+// returns that, to be used as the source by the rest of the pipeline. The
+// kept field's lines are copied through, the other field's are rebuilt by the
+// kernel (see deinterlacePtx). Returns srcImg untouched for formats the
+// kernel can't handle, and NULL on failure.
+static BackingImage *deinterlaceVideoProcSource(NVContext *nvCtx, BackingImage *srcImg, BackingImage *refImg, const VideoProcDeinterlace *deint) {
+    NVDriver *drv = nvCtx->drv;
+
+    if (videoProcYuvLayout(srcImg->format) != 0) {
+        static bool loggedUnsupportedFormat = false;
+        if (!loggedUnsupportedFormat) {
+            LOG("Deinterlacing not supported for VideoProc source format %d, passing it through", srcImg->format);
+            loggedUnsupportedFormat = true;
+        }
+        return srcImg;
+    }
+    if (!ensureVideoProcStream(nvCtx)) {
+        return NULL;
+    }
+    pthread_mutex_lock(&drv->exportMutex);
+    const bool kernelLoaded = loadVideoProcDeinterlaceKernel(drv);
+    pthread_mutex_unlock(&drv->exportMutex);
+    if (!kernelLoaded || !ensureVideoProcDeinterlaceImage(nvCtx, srcImg)) {
+        return NULL;
+    }
+
+    //motion adaptive needs a previous frame of the same shape, without one it's bob
+    if (deint->mode != VIDEO_PROC_DEINTERLACE_ADAPTIVE || refImg == NULL || refImg->format != srcImg->format ||
+        refImg->width != srcImg->width || refImg->height != srcImg->height) {
+        refImg = NULL;
+    }
+
+    BackingImage *outImg = nvCtx->videoProcDeintImage;
+    const NVFormatInfo *fmtInfo = &formatsInfo[srcImg->format];
+    //both planes have as many samples per row as the luma plane has pixels
+    uint32_t width = srcImg->width;
+    uint32_t pitch = width * fmtInfo->bppc;
+    //4:2:0 surfaces are created with an even height (nvCreateSurfaces2), so this
+    //matches the chroma arrays, which are all height >> 1 rows
+    const uint32_t rows[2] = { srcImg->height, srcImg->height / 2 };
+    const size_t planeOffsets[2] = { 0, (size_t) pitch * rows[0] };
+    const size_t frameSize = (size_t) pitch * (rows[0] + rows[1]);
+
+    //current frame, reference frame and output, one after another
+    if (!ensureVideoProcBuffer(drv, &nvCtx->videoProcDeintBuffer, &nvCtx->videoProcDeintBufferSize, frameSize * 3)) {
+        return NULL;
+    }
+    const CUdeviceptr curFrame = nvCtx->videoProcDeintBuffer;
+    const CUdeviceptr refFrame = nvCtx->videoProcDeintBuffer + frameSize;
+    const CUdeviceptr outFrame = nvCtx->videoProcDeintBuffer + 2 * frameSize;
+
+    uint32_t is16Bit = fmtInfo->bppc == 2;
+    uint32_t parity = deint->bottomField ? 1 : 0;
+    uint32_t threshold = VIDEO_PROC_DEINTERLACE_MOTION_THRESHOLD << (is16Bit ? 8 : 0);
+    for (uint32_t i = 0; i < 2; i++) {
+        if (!stageVideoProcPlane(nvCtx, srcImg, i, curFrame + planeOffsets[i], pitch, rows[i]) ||
+            (refImg != NULL && !stageVideoProcPlane(nvCtx, refImg, i, refFrame + planeOffsets[i], pitch, rows[i]))) {
+            return NULL;
+        }
+
+        CUdeviceptr cur = curFrame + planeOffsets[i];
+        CUdeviceptr ref = refImg != NULL ? refFrame + planeOffsets[i] : 0;
+        CUdeviceptr out = outFrame + planeOffsets[i];
+        uint32_t height = rows[i];
+        void *args[] = {
+            &cur,
+            &ref,
+            &out,
+            &width,
+            &height,
+            &pitch,
+            &is16Bit,
+            &parity,
+            &threshold
+        };
+        if (CHECK_CUDA_RESULT(drv->cu->cuLaunchKernel(drv->deinterlaceKernel,
+                (width + 15) / 16, (height + 15) / 16, 1,
+                16, 16, 1, 0, nvCtx->videoProcStream, args, NULL))) {
+            return NULL;
+        }
+
+        CUDA_MEMCPY2D cpy = {
+            .srcMemoryType = CU_MEMORYTYPE_DEVICE,
+            .srcDevice = out,
+            .srcPitch = pitch,
+            .dstMemoryType = CU_MEMORYTYPE_ARRAY,
+            .dstArray = outImg->arrays[i],
+            .WidthInBytes = pitch,
+            .Height = height
+        };
+        if (CHECK_CUDA_RESULT(drv->cu->cuMemcpy2DAsync(&cpy, nvCtx->videoProcStream))) {
+            return NULL;
+        }
+    }
+
+    //later steps may run on other streams or the CPU
+    if (CHECK_CUDA_RESULT(drv->cu->cuStreamSynchronize(nvCtx->videoProcStream))) {
+        return NULL;
+    }
+    nvBackingImageCopyColorMetadata(outImg, srcImg);
+    return outImg;
+}
+
+// Brightest light level the HDR10 metadata describes, in cd/m2, or 0 if it doesn't say
+static float hdr10PeakLuminance(const VAHdrMetaData *data) {
+    if (data->metadata_type != VAProcHighDynamicRangeMetadataHDR10 || data->metadata == NULL ||
+        data->metadata_size < sizeof(VAHdrMetaDataHDR10)) {
+        return 0.0f;
+    }
+    const VAHdrMetaDataHDR10 *hdr10 = (const VAHdrMetaDataHDR10*) data->metadata;
+    if (hdr10->max_content_light_level != 0) {
+        return hdr10->max_content_light_level;
+    }
+    //mastering luminance is in units of 0.0001 cd/m2
+    return hdr10->max_display_mastering_luminance / 10000.0f;
+}
+
+// Picks the deinterlacing and tone mapping settings out of the pipeline's
+// filter buffers. Any other filter, or a deinterlacing algorithm we don't
+// implement, fails the whole pipeline.
+static bool parseVideoProcFilters(NVDriver *drv, const VABufferID *filters, unsigned int numFilters, VideoProcFilters *out) {
+    *out = (VideoProcFilters) { .deinterlace.mode = VIDEO_PROC_DEINTERLACE_NONE };
+    VideoProcDeinterlace *deint = &out->deinterlace;
+
+    for (unsigned int i = 0; i < numFilters; i++) {
+        NVBuffer *buf = (NVBuffer*) getObjectPtr(drv, OBJECT_TYPE_BUFFER, filters[i]);
+        if (buf == NULL || buf->ptr == NULL || buf->bufferType != VAProcFilterParameterBufferType) {
+            LOG("Invalid VideoProc filter buffer: %d", filters[i]);
+            return false;
+        }
+
+        const VAProcFilterParameterBufferBase *base = (const VAProcFilterParameterBufferBase*) buf->ptr;
+        if (base->type == VAProcFilterHighDynamicRangeToneMapping) {
+            const VAProcFilterParameterBufferHDRToneMapping *params = (const VAProcFilterParameterBufferHDRToneMapping*) buf->ptr;
+            out->toneMap = true;
+            out->sourcePeak = hdr10PeakLuminance(&params->data);
+            continue;
+        }
+        if (base->type != VAProcFilterDeinterlacing) {
+            LOG("Unsupported VideoProc filter: %d", base->type);
+            return false;
+        }
+
+        const VAProcFilterParameterBufferDeinterlacing *params = (const VAProcFilterParameterBufferDeinterlacing*) buf->ptr;
+        switch (params->algorithm) {
+        case VAProcDeinterlacingBob:
+            deint->mode = VIDEO_PROC_DEINTERLACE_BOB;
+            break;
+        case VAProcDeinterlacingMotionAdaptive:
+            deint->mode = VIDEO_PROC_DEINTERLACE_ADAPTIVE;
+            break;
+        default:
+            LOG("Unsupported deinterlacing algorithm: %d", params->algorithm);
+            return false;
+        }
+        deint->bottomField = (params->flags & VA_DEINTERLACING_BOTTOM_FIELD) != 0;
+    }
+
+    return true;
+}
+
+// Decides whether a blit needs HDR to SDR conversion. That's the case for PQ
+// and HLG sources, either flagged in the input colour properties or implied by
+// a tone mapping filter, unless the output asks to keep the HDR transfer. The
+// target peak comes from the output HDR metadata, or NVD_TONEMAP_PEAK.
+static void setupVideoProcToneMap(const NVSurface *src, const VAProcPipelineParameterBuffer *pipeline, const VideoProcFilters *filters, VideoProcToneMap *toneMap) {
+    *toneMap = (VideoProcToneMap) { .enabled = false };
+
+    const uint8_t inputTransfer = pipeline->input_color_properties.transfer_characteristics;
+    const uint8_t outputTransfer = pipeline->output_color_properties.transfer_characteristics;
+    if (outputTransfer == VIDEO_PROC_TRANSFER_CHARACTERISTICS_PQ || outputTransfer == VIDEO_PROC_TRANSFER_CHARACTERISTICS_HLG) {
+        return;
+    }
+    if (inputTransfer == VIDEO_PROC_TRANSFER_CHARACTERISTICS_HLG) {
+        toneMap->transfer = VIDEO_PROC_TRANSFER_HLG;
+    } else if (inputTransfer == VIDEO_PROC_TRANSFER_CHARACTERISTICS_PQ || filters->toneMap) {
+        //HDR10 metadata without a transfer function means PQ
+        toneMap->transfer = VIDEO_PROC_TRANSFER_PQ;
+    } else {
+        return;
+    }
+
+    toneMap->enabled = true;
+    toneMap->sourcePeak = filters->sourcePeak > 0.0f ? filters->sourcePeak : VIDEO_PROC_HDR_DEFAULT_PEAK;
+    toneMap->targetPeak = TONEMAP_PEAK;
+    if (pipeline->output_hdr_metadata != NULL) {
+        const float outputPeak = hdr10PeakLuminance(pipeline->output_hdr_metadata);
+        if (outputPeak > 0.0f) {
+            toneMap->targetPeak = outputPeak;
+        }
+    }
+
+    //HDR content is BT.2020 unless it says otherwise, the output is BT.709 unless it asks for BT.2020
+    const uint8_t inputPrimaries = pipeline->input_color_properties.colour_primaries;
+    const bool sourceBt2020 = inputPrimaries == VIDEO_PROC_PRIMARIES_BT2020 ||
+                              (inputPrimaries == 0 && effectiveSurfaceColorStandard(src, pipeline) != VAProcColorStandardBT709);
+    const bool targetBt2020 = pipeline->output_color_standard == VAProcColorStandardBT2020 ||
+                              (pipeline->output_color_standard == VAProcColorStandardExplicit &&
+                               pipeline->output_color_properties.colour_primaries == VIDEO_PROC_PRIMARIES_BT2020);
+    toneMap->gamutMap = sourceBt2020 && !targetBt2020;
+
+    LOG_DEBUG("VideoProc tone mapping: transfer=%s source_peak=%.0f target_peak=%.0f gamut_map=%d",
+        toneMap->transfer == VIDEO_PROC_TRANSFER_PQ ? "PQ" : "HLG", toneMap->sourcePeak, toneMap->targetPeak, toneMap->gamutMap);
+}
+
+static VideoProcFilter videoProcFilterForFlags(uint32_t filterFlags) {
+#ifdef VA_FILTER_INTERPOLATION_MASK
+    switch (filterFlags & VA_FILTER_INTERPOLATION_MASK) {
+    case VA_FILTER_INTERPOLATION_NEAREST_NEIGHBOR:
+        return VIDEO_PROC_FILTER_NEAREST;
+    case VA_FILTER_INTERPOLATION_BILINEAR:
+        return VIDEO_PROC_FILTER_BILINEAR;
+    case VA_FILTER_INTERPOLATION_ADVANCED:
+        return VIDEO_PROC_FILTER_BICUBIC;
+    default:
+        break;
+    }
+#endif
+    if ((filterFlags & VA_FILTER_SCALING_MASK) == VA_FILTER_SCALING_HQ) {
+        return VIDEO_PROC_FILTER_BICUBIC;
+    }
+    return VIDEO_PROC_FILTER_BILINEAR;
+}
+
+// Works out which part of the source lands where in the render target. The
+// source rectangle has to lie inside the source surface, the output rectangle
+// is clipped to the target (and may end up empty, leaving only background).
+static bool setupVideoProcBlit(const NVSurface *src, const NVSurface *dst, const VAProcPipelineParameterBuffer *pipeline, VideoProcBlit *blit) {
     VARectangle srcRegion = { 0, 0, src->width, src->height };
     VARectangle dstRegion = { 0, 0, dst->width, dst->height };
     if (pipeline->surface_region != NULL) {
@@ -2774,19 +4610,82 @@ static bool copySurfaceBackingImage(NVDriver *drv, NVSurface *src, NVSurface *ds
         dstRegion = *pipeline->output_region;
     }
 
-    if (srcRegion.x != 0 || srcRegion.y != 0 || dstRegion.x != 0 || dstRegion.y != 0 ||
-        srcRegion.width != dstRegion.width || srcRegion.height != dstRegion.height) {
-        LOG("Unsupported VideoProc blit: src=%dx%d+%d+%d dst=%dx%d+%d+%d",
-            srcRegion.width, srcRegion.height, srcRegion.x, srcRegion.y,
+    if (srcRegion.x < 0 || srcRegion.y < 0 || srcRegion.width == 0 || srcRegion.height == 0 ||
+        (uint32_t) srcRegion.x + srcRegion.width > src->width || (uint32_t) srcRegion.y + srcRegion.height > src->height ||
+        dstRegion.width == 0 || dstRegion.height == 0) {
+        LOG("Invalid VideoProc blit: src=%dx%d+%d+%d (of %ux%u) dst=%dx%d+%d+%d",
+            srcRegion.width, srcRegion.height, srcRegion.x, srcRegion.y, src->width, src->height,
             dstRegion.width, dstRegion.height, dstRegion.x, dstRegion.y);
+        return false;
+    }
+
+    blit->src = srcRegion;
+    blit->scaleX = (float) srcRegion.width / dstRegion.width;
+    blit->scaleY = (float) srcRegion.height / dstRegion.height;
+    blit->targetWidth = dst->width;
+    blit->targetHeight = dst->height;
+    blit->background = pipeline->output_background_color;
+
+    const int64_t x0 = MAX((int64_t) dstRegion.x, 0);
+    const int64_t y0 = MAX((int64_t) dstRegion.y, 0);
+    const int64_t x1 = MIN((int64_t) dstRegion.x + dstRegion.width, (int64_t) dst->width);
+    const int64_t y1 = MIN((int64_t) dstRegion.y + dstRegion.height, (int64_t) dst->height);
+    if (x1 <= x0 || y1 <= y0) {
+        blit->dst = (VARectangle) { 0, 0, 0, 0 };
+    } else {
+        blit->dst = (VARectangle) { (int16_t) x0, (int16_t) y0, (uint16_t) (x1 - x0), (uint16_t) (y1 - y0) };
+    }
+    blit->srcX = srcRegion.x + (float) (x0 - dstRegion.x) * blit->scaleX;
+    blit->srcY = srcRegion.y + (float) (y0 - dstRegion.y) * blit->scaleY;
+
+    const bool unscaled = srcRegion.width == dstRegion.width && srcRegion.height == dstRegion.height;
+    //filtering an unscaled blit can only blur it
+    blit->filter = unscaled ? VIDEO_PROC_FILTER_NEAREST : videoProcFilterForFlags(pipeline->filter_flags);
+    blit->identity = unscaled && srcRegion.x == 0 && srcRegion.y == 0 &&
+                     dstRegion.x == 0 && dstRegion.y == 0 &&
+                     dstRegion.width == dst->width && dstRegion.height == dst->height;
+    blit->toneMap = (VideoProcToneMap) { .enabled = false };
+
+    return true;
+}
+
+static bool copySurfaceBackingImage(NVContext *nvCtx, NVSurface *src, NVSurface *dst, const VAProcPipelineParameterBuffer *pipeline) {
+    NVDriver *drv = nvCtx->drv;
+
+    if (src == NULL || dst == NULL || pipeline == NULL) {
+        // The destination (render target) was marked resolving in nvBeginPicture;
+        // clear it so a later vaSyncSurface doesn't block forever on a blit we
+        // never performed.
+        setSurfaceResolving(dst, false);
+        return false;
+    }
+
+    VideoProcBlit blit;
+    VideoProcFilters filters;
+    if (!setupVideoProcBlit(src, dst, pipeline, &blit) ||
+        !parseVideoProcFilters(drv, pipeline->filters, pipeline->num_filters, &filters)) {
         setSurfaceResolving(dst, false);
         return false;
     }
+    setupVideoProcToneMap(src, pipeline, &filters, &blit.toneMap);
+    const VideoProcDeinterlace deint = filters.deinterlace;
+
+    //motion adaptive deinterlacing compares against the previous frame
+    NVSurface *ref = NULL;
+    if (deint.mode == VIDEO_PROC_DEINTERLACE_ADAPTIVE && pipeline->num_forward_references > 0 && pipeline->forward_references != NULL) {
+        ref = (NVSurface*) getObjectPtr(drv, OBJECT_TYPE_SURFACE, pipeline->forward_references[0]);
+    }
 
     waitSurfaceResolved(src);
+    if (ref != NULL) {
+        waitSurfaceResolved(ref);
+    }
 
     CHECK_CUDA_RESULT_RETURN(cu->cuCtxPushCurrent(drv->cudaContext), (setSurfaceResolving(dst, false), false));
     bool realised = drv->backend->realiseSurface(drv, src) && drv->backend->realiseSurface(drv, dst);
+    if (realised && ref != NULL && !drv->backend->realiseSurface(drv, ref)) {
+        ref = NULL;
+    }
     if (!realised) {
         CHECK_CUDA_RESULT(cu->cuCtxPopCurrent(NULL));
         setSurfaceResolving(dst, false);
@@ -2796,17 +4695,31 @@ static bool copySurfaceBackingImage(NVDriver *drv, NVSurface *src, NVSurface *ds
     BackingImage *srcImg = src->backingImage;
     BackingImage *dstImg = dst->backingImage;
     nvSurfaceCopyColorMetadataFromBackingImage(src, srcImg);
-    if (srcImg != NULL && dstImg != NULL && (srcImg->format == NV_FORMAT_NV12 || srcImg->format == NV_FORMAT_P010 || srcImg->format == NV_FORMAT_P012) && dstImg->format == NV_FORMAT_ARGB) {
+
+    //from here on the deinterlaced frame stands in for the source
+    bool deinterlaced = false;
+    if (deint.mode != VIDEO_PROC_DEINTERLACE_NONE && srcImg != NULL) {
+        BackingImage *deintImg = deinterlaceVideoProcSource(nvCtx, srcImg, ref != NULL ? ref->backingImage : NULL, &deint);
+        if (deintImg == NULL) {
+            CHECK_CUDA_RESULT(cu->cuCtxPopCurrent(NULL));
+            setSurfaceResolving(dst, false);
+            return false;
+        }
+        deinterlaced = deintImg != srcImg;
+        srcImg = deintImg;
+    }
+    if (srcImg != NULL && dstImg != NULL && (srcImg->format == NV_FORMAT_NV12 || srcImg->format == NV_FORMAT_P010 || srcImg->format == NV_FORMAT_P012) &&
+        (dstImg->format == NV_FORMAT_ARGB || dstImg->format == NV_FORMAT_RGBP)) {
         const VAProcColorStandardType colorStandard = effectiveSurfaceColorStandard(src, pipeline);
         const bool fullRange = effectiveSurfaceColorRangeFull(src, pipeline);
-        const ColorMatrix *matrix = colorMatrixForStandard(colorStandard, srcRegion.width, fullRange);
+        const ColorMatrix *matrix = colorMatrixForStandard(colorStandard, blit.src.width, fullRange);
         const VideoProcSampleInfo sampleInfo = videoProcSampleInfoForFormat(srcImg->format, fullRange);
         char srcFourcc[5];
         char dstFourcc[5];
         LOG_DEBUG("VideoProc color matrix: src=%s dst=%s size=%ux%u surface_color_standard=%s(%d) input_matrix_coefficients=%u input_range=%s(%u) decoded_color_standard=%s(%d) decoded_full_range=%d output_color_standard=%s(%d) effective_color_standard=%s(%d) effective_range=%s matrix=%s coeffs=%d,%d,%d,%d sample_shift=%d y_scale=%d y_offset=%d uv_offset=%d value_shift=%d",
             fourccString(formatsInfo[srcImg->format].vaFormat.fourcc, srcFourcc),
             fourccString(formatsInfo[dstImg->format].vaFormat.fourcc, dstFourcc),
-            srcRegion.width, srcRegion.height,
+            blit.src.width, blit.src.height,
             nvColorStandardName(pipeline->surface_color_standard), pipeline->surface_color_standard,
             pipeline->input_color_properties.matrix_coefficients,
             sourceRangeName(pipeline->input_color_properties.color_range), pipeline->input_color_properties.color_range,
@@ -2816,7 +4729,33 @@ static bool copySurfaceBackingImage(NVDriver *drv, NVSurface *src, NVSurface *ds
             effectiveRangeName(fullRange),
             colorMatrixName(matrix), matrix->vToR, matrix->uToG, matrix->vToG, matrix->uToB,
             sampleInfo.sampleShift, sampleInfo.yScale, sampleInfo.yOffset, sampleInfo.uvOffset, sampleInfo.valueShift);
-        bool ret = convertNV12ToARGB(drv, srcImg, dstImg, srcRegion.width, srcRegion.height, matrix, sampleInfo);
+        bool ret;
+        if (dstImg->format == NV_FORMAT_RGBP) {
+            //there's no CPU fallback for planar RGB
+            const bool is16Bit = srcImg->format != NV_FORMAT_NV12;
+            ret = convertNV12ToPlanarRgb(nvCtx, srcImg, dstImg, &blit, is16Bit, matrix, sampleInfo);
+            nvStatsIncrement(drv, ret ? NV_STAT_VIDEOPROC_CUDA : NV_STAT_VIDEOPROC_CUDA_FAILURES);
+        } else {
+            ret = convertNV12ToARGB(nvCtx, srcImg, dstImg, &blit, matrix, sampleInfo);
+        }
+        bool popFailed = CHECK_CUDA_RESULT(cu->cuCtxPopCurrent(NULL));
+        if (!ret || popFailed) {
+            setSurfaceResolving(dst, false);
+            return false;
+        }
+        goto done;
+    }
+
+    if (srcImg != NULL && dstImg != NULL && srcImg->format != dstImg->format &&
+        videoProcYuvLayout(srcImg->format) == 0 && videoProcYuvLayout(dstImg->format) >= 0) {
+        bool ret = false;
+        if (!blit.identity) {
+            LOG("Unsupported VideoProc blit: scaling or placing %ux%u -> %ux%u with a YUV format conversion",
+                blit.src.width, blit.src.height, blit.dst.width, blit.dst.height);
+        } else {
+            ret = convertVideoProcYuv(nvCtx, srcImg, dstImg, &blit);
+            nvStatsIncrement(drv, ret ? NV_STAT_VIDEOPROC_CUDA : NV_STAT_VIDEOPROC_CUDA_FAILURES);
+        }
         bool popFailed = CHECK_CUDA_RESULT(cu->cuCtxPopCurrent(NULL));
         if (!ret || popFailed) {
             setSurfaceResolving(dst, false);
@@ -2834,17 +4773,34 @@ static bool copySurfaceBackingImage(NVDriver *drv, NVSurface *src, NVSurface *ds
         return false;
     }
 
+    //same-format copies can crop and place the picture, but not scale it or fill the background
+    if (blit.scaleX != 1.0f || blit.scaleY != 1.0f) {
+        LOG("Unsupported VideoProc blit: scaling %ux%u -> %ux%u without a format conversion",
+            blit.src.width, blit.src.height, blit.dst.width, blit.dst.height);
+        CHECK_CUDA_RESULT(cu->cuCtxPopCurrent(NULL));
+        setSurfaceResolving(dst, false);
+        return false;
+    }
+
     const NVFormatInfo *fmtInfo = &formatsInfo[srcImg->format];
+    const uint32_t srcX = (uint32_t) blit.srcX;
+    const uint32_t srcY = (uint32_t) blit.srcY;
 
-    for (uint32_t i = 0; i < fmtInfo->numPlanes; i++) {
+    //an output rectangle clipped away entirely leaves nothing to copy
+    for (uint32_t i = 0; blit.dst.width != 0 && i < fmtInfo->numPlanes; i++) {
         const NVFormatPlane *p = &fmtInfo->plane[i];
+        const uint32_t bytesPerPixel = fmtInfo->bppc * p->channelCount;
         CUDA_MEMCPY2D cpy = {
+            .srcXInBytes = (srcX >> p->ss.x) * bytesPerPixel,
+            .srcY = srcY >> p->ss.y,
             .srcMemoryType = CU_MEMORYTYPE_ARRAY,
             .srcArray = srcImg->arrays[i],
+            .dstXInBytes = ((uint32_t) blit.dst.x >> p->ss.x) * bytesPerPixel,
+            .dstY = (uint32_t) blit.dst.y >> p->ss.y,
             .dstMemoryType = CU_MEMORYTYPE_ARRAY,
             .dstArray = dstImg->arrays[i],
-            .WidthInBytes = ((uint32_t) srcRegion.width >> p->ss.x) * fmtInfo->bppc * p->channelCount,
-            .Height = (uint32_t) srcRegion.height >> p->ss.y
+            .WidthInBytes = ((uint32_t) blit.dst.width >> p->ss.x) * bytesPerPixel,
+            .Height = (uint32_t) blit.dst.height >> p->ss.y
         };
 
         if (i == fmtInfo->numPlanes - 1) {
@@ -2858,7 +4814,7 @@ static bool copySurfaceBackingImage(NVDriver *drv, NVSurface *src, NVSurface *ds
 done:
     pthread_mutex_lock(&dst->mutex);
     dst->context = src->context;
-    dst->progressiveFrame = src->progressiveFrame;
+    dst->progressiveFrame = deinterlaced ? 1 : src->progressiveFrame;
     dst->topFieldFirst = src->topFieldFirst;
     dst->secondField = src->secondField;
     dst->decodeFailed = src->decodeFailed;
@@ -2866,8 +4822,12 @@ done:
     pthread_mutex_unlock(&dst->mutex);
 
     // Clears both the surface and its backing-image resolving flags and wakes
-    // any waiter (vaSyncSurface / a later blit that reuses this surface).
-    setSurfaceResolving(dst, false);
+    // any waiter (vaSyncSurface / a later blit that reuses this surface). In a
+    // batch the blit may still be queued, nvRenderPicture clears them once the
+    // batch has been flushed.
+    if (!nvCtx->videoProcBatch) {
+        setSurfaceResolving(dst, false);
+    }
 
     return true;
 }
@@ -2910,6 +4870,25 @@ static VAStatus nvBeginPicture(
         return decoderStatus;
     }
 
+    //a pooled JPEG decoder follows the picture size, so one context can decode images of any size back to back
+    if (nvCtx->decoderPooled && (surface->width != nvCtx->decoderWidth || surface->height != nvCtx->decoderHeight)) {
+        if (surface->width > nvCtx->decoderMaxWidth || surface->height > nvCtx->decoderMaxHeight) {
+            LOG("JPEG picture %ux%u is larger than the pooled decoder (%ux%u)",
+                surface->width, surface->height, nvCtx->decoderMaxWidth, nvCtx->decoderMaxHeight);
+            return VA_STATUS_ERROR_RESOLUTION_NOT_SUPPORTED;
+        }
+        waitForResolveIdle(nvCtx);
+        CHECK_CUDA_RESULT_RETURN(cu->cuCtxPushCurrent(drv->cudaContext), VA_STATUS_ERROR_OPERATION_FAILED);
+        const bool resized = reconfigurePooledDecoder(nvCtx->decoder, nvCtx->decoderChromaFormat, nvCtx->surfaceCount,
+                                                      surface->width, surface->height);
+        CHECK_CUDA_RESULT_RETURN(cu->cuCtxPopCurrent(NULL), VA_STATUS_ERROR_OPERATION_FAILED);
+        if (!resized) {
+            return VA_STATUS_ERROR_OPERATION_FAILED;
+        }
+        nvCtx->decoderWidth = surface->width;
+        nvCtx->decoderHeight = surface->height;
+    }
+
     //if this surface hasn't been used before, give it a new picture index
     if (surface->pictureIdx == -1) {
         if (nvCtx->currentPictureId == nvCtx->surfaceCount) {
@@ -2949,6 +4928,10 @@ static VAStatus nvRenderPicture(
 
     if (nvCtx->entrypoint == VAEntrypointVideoProc) {
         bool processed = false;
+        VAStatus status = VA_STATUS_SUCCESS;
+        // With several pipelines the texture-path kernels are only queued, and
+        // all of them are waited for with a single stream sync at the end.
+        nvCtx->videoProcBatch = num_buffers > 1;
         for (int i = 0; i < num_buffers; i++) {
             NVBuffer *buf = (NVBuffer*) getObjectPtr(drv, OBJECT_TYPE_BUFFER, buffers[i]);
             if (buf == NULL || buf->ptr == NULL || buf->bufferType != VAProcPipelineParameterBufferType) {
@@ -2962,18 +4945,33 @@ static VAStatus nvRenderPicture(
             NVSurface *src = (NVSurface*) getObjectPtr(drv, OBJECT_TYPE_SURFACE, pipeline->surface);
             // copySurfaceBackingImage always clears the render target's resolving
             // flag, on both success and every failure path.
-            if (!copySurfaceBackingImage(drv, src, nvCtx->renderTarget, pipeline)) {
-                return VA_STATUS_ERROR_OPERATION_FAILED;
+            if (!copySurfaceBackingImage(nvCtx, src, nvCtx->renderTarget, pipeline)) {
+                status = VA_STATUS_ERROR_OPERATION_FAILED;
+                break;
+            }
+        }
+
+        const bool batched = nvCtx->videoProcBatch;
+        nvCtx->videoProcBatch = false;
+        if (nvCtx->videoProcPendingCount > 0) {
+            if (CHECK_CUDA_RESULT(cu->cuCtxPushCurrent(drv->cudaContext))) {
+                status = VA_STATUS_ERROR_OPERATION_FAILED;
+            } else {
+                if (!flushVideoProcBatch(nvCtx)) {
+                    status = VA_STATUS_ERROR_OPERATION_FAILED;
+                }
+                CHECK_CUDA_RESULT(cu->cuCtxPopCurrent(NULL));
             }
         }
 
         // If no pipeline buffer touched the render target, it was still marked
         // resolving in nvBeginPicture; clear it so vaSyncSurface can't hang.
-        if (!processed) {
+        // A batch leaves it marked until everything it queued has finished.
+        if (!processed || batched) {
             setSurfaceResolving(nvCtx->renderTarget, false);
         }
 
-        return VA_STATUS_SUCCESS;
+        return status;
     }
 
     CUVIDPICPARAMS *picParams = &nvCtx->pPicParams;
@@ -3044,6 +5042,7 @@ static VAStatus nvEndPicture(
 
     //TODO check we're not overflowing the queue
     pthread_mutex_lock(&nvCtx->resolveMutex);
+    nvCtx->resolvesInFlight++;
     nvCtx->surfaceQueue[nvCtx->surfaceQueueWriteIdx++] = surface;
     if (nvCtx->surfaceQueueWriteIdx >= SURFACE_QUEUE_SIZE) {
         nvCtx->surfaceQueueWriteIdx = 0;
@@ -3170,7 +5169,7 @@ static VAStatus nvCreateImage(
     img->format = nvFormat;
 
     //allocate buffer to hold image when we copy down from the GPU
-    //TODO could probably put these in a pool, they appear to be allocated, used, then freed
+    //clients tend to create and destroy an image per frame, so the memory comes from a pool when possible
     Object imageBufferObject = allocateObject(drv, OBJECT_TYPE_BUFFER, sizeof(NVBuffer));
     NVBuffer *imageBuffer = (NVBuffer*) imageBufferObject->obj;
     imageBuffer->bufferType = VAImageBufferType;
@@ -3179,7 +5178,12 @@ static VAStatus nvCreateImage(
         imageBuffer->size += ((width * height) >> (p[i].ss.x + p[i].ss.y)) * fmtInfo->bppc * p[i].channelCount;
     }
     imageBuffer->elements = 1;
-    imageBuffer->ptr = memalign(16, imageBuffer->size);
+    if (!takePooledImageMemory(drv, nvFormat, width, height, imageBuffer)) {
+        //pinned, so vaGetImage can DMA straight into it
+        CHECK_CUDA_RESULT_RETURN(cu->cuCtxPushCurrent(drv->cudaContext), VA_STATUS_ERROR_OPERATION_FAILED);
+        imageBuffer->ptr = allocHostCopyMemory(imageBuffer->size, &imageBuffer->pinned);
+        CHECK_CUDA_RESULT_RETURN(cu->cuCtxPopCurrent(NULL), VA_STATUS_ERROR_OPERATION_FAILED);
+    }
 
     img->imageBuffer = imageBuffer;
 
@@ -3200,9 +5204,9 @@ static VAStatus nvCreateImage(
      * An array indicating the scanline pitch in bytes for each plane.
      * Each plane may have a different pitch. Maximum 3 planes for planar formats
      */
-    image->pitches[0] = width * fmtInfo->bppc;
-    image->pitches[1] = width * fmtInfo->bppc;
-    image->pitches[2] = width * fmtInfo->bppc;
+    for (uint32_t i = 0; i < 3; i++) {
+        image->pitches[i] = (width >> p[i].ss.x) * fmtInfo->bppc * p[i].channelCount;
+    }
     /*
      * An array indicating the byte offset from the beginning of the image data
      * to the start of each plane.
@@ -3214,15 +5218,132 @@ static VAStatus nvCreateImage(
     return VA_STATUS_SUCCESS;
 }
 
+// Makes sure a surface has a staging copy, the tightly packed host copy handed
+// out by vaDeriveImage and vaLockSurface, and returns its plane layout. The copy
+// is allocated once and shared by every user; its contents are brought up to
+// date separately, by refreshSurfaceStaging. The caller becomes one of the
+// copy's users until it calls releaseSurfaceStaging.
+static VAStatus acquireSurfaceStaging(NVDriver *drv, NVSurface *surface, uint32_t pitches[3], uint32_t offsets[3]) {
+    //the backing image has to exist to know the copy's layout
+    waitSurfaceResolved(surface);
+    CHECK_CUDA_RESULT_RETURN(cu->cuCtxPushCurrent(drv->cudaContext), VA_STATUS_ERROR_OPERATION_FAILED);
+    if (!drv->backend->realiseSurface(drv, surface)) {
+        CHECK_CUDA_RESULT(cu->cuCtxPopCurrent(NULL));
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    }
+
+    //only the 4:2:0 semi-planar formats decoders produce are supported, for anything else clients use vaGetImage
+    const NVFormat format = surface->backingImage->format;
+    if (format != NV_FORMAT_NV12 && format != NV_FORMAT_P010 && format != NV_FORMAT_P012 && format != NV_FORMAT_P016) {
+        CHECK_CUDA_RESULT(cu->cuCtxPopCurrent(NULL));
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+    }
+
+    const NVFormatInfo *fmtInfo = &formatsInfo[format];
+    size_t size = 0;
+    for (uint32_t i = 0; i < fmtInfo->numPlanes; i++) {
+        uint32_t rows;
+        getStagingPlaneLayout(fmtInfo, surface, i, &pitches[i], &rows);
+        offsets[i] = (uint32_t) size;
+        size += (size_t) pitches[i] * rows;
+    }
+
+    pthread_mutex_lock(&surface->mutex);
+    if (surface->stagingHost != NULL && surface->stagingSize != size) {
+        //an outstanding derived image or lock still points at the old memory
+        if (surface->stagingUsers > 0) {
+            pthread_mutex_unlock(&surface->mutex);
+            CHECK_CUDA_RESULT(cu->cuCtxPopCurrent(NULL));
+            return VA_STATUS_ERROR_SURFACE_BUSY;
+        }
+        freeHostCopyMemory(surface->stagingHost, surface->stagingPinned);
+        surface->stagingHost = NULL;
+        surface->stagingSize = 0;
+    }
+    if (surface->stagingHost == NULL) {
+        surface->stagingHost = allocHostCopyMemory(size, &surface->stagingPinned);
+        if (surface->stagingHost == NULL) {
+            pthread_mutex_unlock(&surface->mutex);
+            CHECK_CUDA_RESULT(cu->cuCtxPopCurrent(NULL));
+            return VA_STATUS_ERROR_ALLOCATION_FAILED;
+        }
+        surface->stagingSize = size;
+        surface->stagingValid = false;
+    }
+    surface->stagingUsers++;
+    pthread_mutex_unlock(&surface->mutex);
+    CHECK_CUDA_RESULT(cu->cuCtxPopCurrent(NULL));
+
+    return VA_STATUS_SUCCESS;
+}
+
+// Ends a use started by acquireSurfaceStaging, uploading anything written
+// through the copy in the meantime.
+static void releaseSurfaceStaging(NVDriver *drv, NVSurface *surface) {
+    writeBackSurfaceStaging(drv, surface);
+
+    pthread_mutex_lock(&surface->mutex);
+    surface->stagingUsers--;
+    pthread_mutex_unlock(&surface->mutex);
+}
+
 static VAStatus nvDeriveImage(
         VADriverContextP ctx,
         VASurfaceID surface,
         VAImage *image     /* out */
     )
 {
-    //LOG("In %s", __func__);
-    //FAILED because we don't support it
-    return VA_STATUS_ERROR_OPERATION_FAILED;
+    NVDriver *drv = (NVDriver*) ctx->pDriverData;
+    NVSurface *surfaceObj = (NVSurface*) getObjectPtr(drv, OBJECT_TYPE_SURFACE, surface);
+
+    if (surfaceObj == NULL) {
+        return VA_STATUS_ERROR_INVALID_SURFACE;
+    }
+
+    uint32_t pitches[3] = { 0 };
+    uint32_t offsets[3] = { 0 };
+    VAStatus status = acquireSurfaceStaging(drv, surfaceObj, pitches, offsets);
+    if (status != VA_STATUS_SUCCESS) {
+        return status;
+    }
+
+    const NVFormat format = surfaceObj->backingImage->format;
+    const NVFormatInfo *fmtInfo = &formatsInfo[format];
+    const uint32_t width = surfaceObj->width;
+    const uint32_t height = surfaceObj->height;
+    const size_t size = surfaceObj->stagingSize;
+
+    Object imageObj = allocateObject(drv, OBJECT_TYPE_IMAGE, sizeof(NVImage));
+    NVImage *img = (NVImage*) imageObj->obj;
+    img->width = width;
+    img->height = height;
+    img->format = format;
+    img->derivedSurface = surfaceObj;
+
+    //the copy itself is made lazily, when the client maps the buffer
+    Object imageBufferObject = allocateObject(drv, OBJECT_TYPE_BUFFER, sizeof(NVBuffer));
+    NVBuffer *imageBuffer = (NVBuffer*) imageBufferObject->obj;
+    imageBuffer->bufferType = VAImageBufferType;
+    imageBuffer->size = size;
+    imageBuffer->elements = 1;
+    imageBuffer->ptr = surfaceObj->stagingHost;
+    imageBuffer->derivedSurface = surfaceObj;
+    img->imageBuffer = imageBuffer;
+
+    memset(image, 0, sizeof(VAImage));
+    image->image_id = imageObj->id;
+    image->format = fmtInfo->vaFormat;
+    image->buf = imageBufferObject->id;
+    image->width = width;
+    image->height = height;
+    image->data_size = size;
+    image->num_planes = fmtInfo->numPlanes;
+    for (uint32_t i = 0; i < 3; i++) {
+        image->pitches[i] = pitches[i];
+        image->offsets[i] = offsets[i];
+    }
+
+    return VA_STATUS_SUCCESS;
 }
 
 static VAStatus nvDestroyImage(
@@ -3237,12 +5358,15 @@ static VAStatus nvDestroyImage(
         return VA_STATUS_ERROR_INVALID_IMAGE;
     }
 
+    //writes through a derived image still mapped when it's destroyed aren't lost either
+    if (img->derivedSurface != NULL) {
+        releaseSurfaceStaging(drv, img->derivedSurface);
+    }
+
     Object imageBufferObj = getObjectByPtr(drv, OBJECT_TYPE_BUFFER, img->imageBuffer);
 
     if (imageBufferObj != NULL) {
-        if (img->imageBuffer->ptr != NULL) {
-            free(img->imageBuffer->ptr);
-        }
+        returnImageMemoryToPool(drv, img);
 
         deleteObject(drv, imageBufferObj->id);
     }
@@ -3267,6 +5391,57 @@ static VAStatus nvSetImagePalette(
     return VA_STATUS_ERROR_UNIMPLEMENTED;
 }
 
+// Byte geometry of one plane of a region copy between a surface and an image.
+// imageOffset points at the region's first byte in the image buffer.
+typedef struct {
+    size_t   imageOffset;
+    uint32_t imagePitch;
+    uint32_t surfaceXInBytes;
+    uint32_t surfaceY;
+    uint32_t widthInBytes;
+    uint32_t rows;
+} ImagePlaneRegion;
+
+// The region is width x height pixels at (imageX, imageY) in the image and at
+// (surfaceX, surfaceY) in the surface, and must already lie within both.
+static void getImagePlaneRegion(const NVImage *img, uint32_t imageX, uint32_t imageY,
+                                const NVSurface *surface, uint32_t surfaceX, uint32_t surfaceY,
+                                uint32_t width, uint32_t height, uint32_t plane, ImagePlaneRegion *r) {
+    const NVFormatInfo *fmtInfo = &formatsInfo[img->format];
+    const NVFormatPlane *p = &fmtInfo->plane[plane];
+    const uint32_t bytesPerPixel = fmtInfo->bppc * p->channelCount;
+
+    //same layout as nvCreateImage gives the image
+    r->imageOffset = 0;
+    for (uint32_t i = 0; i < plane; i++) {
+        const NVFormatPlane *prev = &fmtInfo->plane[i];
+        r->imageOffset += (size_t) ((img->width * img->height) >> (prev->ss.x + prev->ss.y)) * fmtInfo->bppc * prev->channelCount;
+    }
+    r->imagePitch = (img->width >> p->ss.x) * bytesPerPixel;
+
+    //subsampled planes round the region outwards so odd edges keep their chroma, then clip it to both planes
+    const uint32_t imagePlaneX = imageX >> p->ss.x;
+    const uint32_t imagePlaneY = imageY >> p->ss.y;
+    const uint32_t surfacePlaneX = surfaceX >> p->ss.x;
+    const uint32_t surfacePlaneY = surfaceY >> p->ss.y;
+    uint32_t cols = ((surfaceX + width + (1u << p->ss.x) - 1) >> p->ss.x) - surfacePlaneX;
+    uint32_t rows = ((surfaceY + height + (1u << p->ss.y) - 1) >> p->ss.y) - surfacePlaneY;
+    const uint32_t surfaceCols = (surface->width >> p->ss.x) - surfacePlaneX;
+    const uint32_t surfaceRows = (surface->height >> p->ss.y) - surfacePlaneY;
+    const uint32_t imageCols = (img->width >> p->ss.x) - imagePlaneX;
+    const uint32_t imageRows = (img->height >> p->ss.y) - imagePlaneY;
+    cols = cols > surfaceCols ? surfaceCols : cols;
+    rows = rows > surfaceRows ? surfaceRows : rows;
+    cols = cols > imageCols ? imageCols : cols;
+    rows = rows > imageRows ? imageRows : rows;
+
+    r->imageOffset += (size_t) imagePlaneY * r->imagePitch + imagePlaneX * bytesPerPixel;
+    r->surfaceXInBytes = surfacePlaneX * bytesPerPixel;
+    r->surfaceY = surfacePlaneY;
+    r->widthInBytes = cols * bytesPerPixel;
+    r->rows = rows;
+}
+
 static VAStatus nvGetImage(
         VADriverContextP ctx,
         VASurfaceID surface,
@@ -3292,42 +5467,66 @@ static VAStatus nvGetImage(
 
     NVContext *context = (NVContext*) surfaceObj->context;
     const NVFormatInfo *fmtInfo = &formatsInfo[imageObj->format];
-    uint32_t offset = 0;
 
     if (context == NULL) {
         return VA_STATUS_ERROR_INVALID_CONTEXT;
     }
 
+    //the region is read into the top left of the image, so it has to fit in both
+    if (x < 0 || y < 0 || width == 0 || height == 0 ||
+        (uint64_t) x + width > surfaceObj->width || (uint64_t) y + height > surfaceObj->height ||
+        width > imageObj->width || height > imageObj->height) {
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+    }
+
     //wait for the surface to be decoded
     nvSyncSurface(ctx, surface);
 
+    //planes are copied as they are, so the image has to have the surface's layout, there's no conversion here
+    if (surfaceObj->backingImage == NULL) {
+        return VA_STATUS_ERROR_INVALID_SURFACE;
+    }
+    if (surfaceObj->backingImage->format != imageObj->format) {
+        return VA_STATUS_ERROR_INVALID_IMAGE_FORMAT;
+    }
+
+    //queue every plane on the transfer stream and wait once, instead of a blocking copy per plane
+    VAStatus status = VA_STATUS_SUCCESS;
     CHECK_CUDA_RESULT_RETURN(cu->cuCtxPushCurrent(drv->cudaContext), VA_STATUS_ERROR_OPERATION_FAILED);
     for (uint32_t i = 0; i < fmtInfo->numPlanes; i++) {
-        const NVFormatPlane *p = &fmtInfo->plane[i];
+        ImagePlaneRegion region;
+        getImagePlaneRegion(imageObj, 0, 0, surfaceObj, x, y, width, height, i, &region);
+        if (region.widthInBytes == 0 || region.rows == 0) {
+            continue;
+        }
         CUDA_MEMCPY2D memcpy2d = {
-        .srcXInBytes = 0, .srcY = 0,
+        .srcXInBytes = region.surfaceXInBytes, .srcY = region.surfaceY,
         .srcMemoryType = CU_MEMORYTYPE_ARRAY,
         .srcArray = surfaceObj->backingImage->arrays[i],
 
         .dstXInBytes = 0, .dstY = 0,
         .dstMemoryType = CU_MEMORYTYPE_HOST,
-        .dstHost = (char *)imageObj->imageBuffer->ptr + offset,
-        .dstPitch = width * fmtInfo->bppc,
+        .dstHost = (char *)imageObj->imageBuffer->ptr + region.imageOffset,
+        .dstPitch = region.imagePitch,
 
-        .WidthInBytes = (width >> p->ss.x) * fmtInfo->bppc * p->channelCount,
-        .Height = height >> p->ss.y
+        .WidthInBytes = region.widthInBytes,
+        .Height = region.rows
         };
 
-        CUresult result = cu->cuMemcpy2D(&memcpy2d);
+        CUresult result = cu->cuMemcpy2DAsync(&memcpy2d, drv->imageTransferStream);
         if (result != CUDA_SUCCESS) {
-            LOG("cuMemcpy2D failed: %d", result);
-            return VA_STATUS_ERROR_DECODING_ERROR;
+            LOG("cuMemcpy2DAsync failed: %d", result);
+            status = VA_STATUS_ERROR_DECODING_ERROR;
+            break;
         }
-        offset += ((width * height) >> (p->ss.x + p->ss.y)) * fmtInfo->bppc * p->channelCount;
+    }
+    //even after a failure, the planes already queued must land before the client sees the buffer again
+    if (CHECK_CUDA_RESULT(cu->cuStreamSynchronize(drv->imageTransferStream)) && status == VA_STATUS_SUCCESS) {
+        status = VA_STATUS_ERROR_DECODING_ERROR;
     }
     CHECK_CUDA_RESULT_RETURN(cu->cuCtxPopCurrent(NULL), VA_STATUS_ERROR_OPERATION_FAILED);
 
-    return VA_STATUS_SUCCESS;
+    return status;
 }
 
 static VAStatus nvPutImage(
@@ -3344,8 +5543,85 @@ static VAStatus nvPutImage(
         unsigned int dest_height
     )
 {
-    LOG("In %s", __func__);
-    return VA_STATUS_SUCCESS;
+    NVDriver *drv = (NVDriver*) ctx->pDriverData;
+
+    NVSurface *surfaceObj = (NVSurface*) getObjectPtr(drv, OBJECT_TYPE_SURFACE, surface);
+    NVImage *imageObj = (NVImage*) getObjectPtr(drv, OBJECT_TYPE_IMAGE, image);
+
+    if (surfaceObj == NULL) {
+        return VA_STATUS_ERROR_INVALID_SURFACE;
+    }
+
+    if (imageObj == NULL || imageObj->imageBuffer->ptr == NULL) {
+        return VA_STATUS_ERROR_INVALID_IMAGE;
+    }
+
+    //the rectangle is placed as is, there's no scaler on this path
+    if (src_width != dest_width || src_height != dest_height) {
+        LOG("vaPutImage can't scale %ux%u to %ux%u", src_width, src_height, dest_width, dest_height);
+        return VA_STATUS_ERROR_UNIMPLEMENTED;
+    }
+
+    if (src_x < 0 || src_y < 0 || dest_x < 0 || dest_y < 0 || src_width == 0 || src_height == 0 ||
+        (uint64_t) src_x + src_width > imageObj->width || (uint64_t) src_y + src_height > imageObj->height ||
+        (uint64_t) dest_x + dest_width > surfaceObj->width || (uint64_t) dest_y + dest_height > surfaceObj->height) {
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+    }
+
+    //don't let a resolve still in flight overwrite the upload
+    waitSurfaceResolved(surfaceObj);
+
+    CHECK_CUDA_RESULT_RETURN(cu->cuCtxPushCurrent(drv->cudaContext), VA_STATUS_ERROR_OPERATION_FAILED);
+    if (!drv->backend->realiseSurface(drv, surfaceObj)) {
+        CHECK_CUDA_RESULT(cu->cuCtxPopCurrent(NULL));
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    }
+
+    if (surfaceObj->backingImage->format != imageObj->format) {
+        CHECK_CUDA_RESULT(cu->cuCtxPopCurrent(NULL));
+        return VA_STATUS_ERROR_INVALID_IMAGE_FORMAT;
+    }
+
+    //same as vaGetImage, every plane is queued on the transfer stream and waited for once
+    const NVFormatInfo *fmtInfo = &formatsInfo[imageObj->format];
+    VAStatus status = VA_STATUS_SUCCESS;
+    pthread_mutex_lock(&surfaceObj->mutex);
+    for (uint32_t i = 0; i < fmtInfo->numPlanes; i++) {
+        ImagePlaneRegion region;
+        getImagePlaneRegion(imageObj, src_x, src_y, surfaceObj, dest_x, dest_y, src_width, src_height, i, &region);
+        if (region.widthInBytes == 0 || region.rows == 0) {
+            continue;
+        }
+        CUDA_MEMCPY2D memcpy2d = {
+            .srcMemoryType = CU_MEMORYTYPE_HOST,
+            .srcHost = (const char *)imageObj->imageBuffer->ptr + region.imageOffset,
+            .srcPitch = region.imagePitch,
+
+            .dstXInBytes = region.surfaceXInBytes, .dstY = region.surfaceY,
+            .dstMemoryType = CU_MEMORYTYPE_ARRAY,
+            .dstArray = surfaceObj->backingImage->arrays[i],
+
+            .WidthInBytes = region.widthInBytes,
+            .Height = region.rows
+        };
+
+        CUresult result = cu->cuMemcpy2DAsync(&memcpy2d, drv->imageTransferStream);
+        if (result != CUDA_SUCCESS) {
+            LOG("cuMemcpy2DAsync failed: %d", result);
+            status = VA_STATUS_ERROR_OPERATION_FAILED;
+            break;
+        }
+    }
+    //the client is free to reuse the image as soon as we return
+    if (CHECK_CUDA_RESULT(cu->cuStreamSynchronize(drv->imageTransferStream)) && status == VA_STATUS_SUCCESS) {
+        status = VA_STATUS_ERROR_OPERATION_FAILED;
+    }
+    //the surface's contents changed under any image derived from it
+    surfaceObj->stagingValid = false;
+    pthread_mutex_unlock(&surfaceObj->mutex);
+    CHECK_CUDA_RESULT_RETURN(cu->cuCtxPopCurrent(NULL), VA_STATUS_ERROR_OPERATION_FAILED);
+
+    return status;
 }
 
 static VAStatus nvQuerySubpictureFormats(
@@ -3477,6 +5753,49 @@ static VAStatus nvSetDisplayAttributes(
     return VA_STATUS_ERROR_UNIMPLEMENTED;
 }
 
+//what VideoProc can read and write; the source is always a decoder output
+static const uint32_t videoProcInputPixelFormats[] = {
+    VA_FOURCC_NV12,
+    VA_FOURCC_P010,
+    VA_FOURCC_P012
+};
+
+static const uint32_t videoProcOutputPixelFormats[] = {
+    VA_FOURCC_NV12,
+    VA_FOURCC_P010,
+    VA_FOURCC_I420,
+    VA_FOURCC_YUY2,
+    VA_FOURCC_RGBP,
+    VA_FOURCC_ARGB,
+    VA_FOURCC_XRGB,
+    VA_FOURCC_ABGR,
+    VA_FOURCC_XBGR,
+    VA_FOURCC_RGBA,
+    VA_FOURCC_RGBX,
+    VA_FOURCC_BGRA,
+    VA_FOURCC_BGRX
+};
+
+static bool videoProcPixelFormatAvailable(const NVDriver *drv, uint32_t fourcc) {
+    return drv->supports16BitSurface || (fourcc != VA_FOURCC_P010 && fourcc != VA_FOURCC_P012);
+}
+
+// Fills a caller-owned pixel format array as far as it goes and reports how
+// many formats there are, so a caller can size the array with a first call.
+static void fillVideoProcPixelFormats(const NVDriver *drv, const uint32_t *formats, uint32_t count, uint32_t *list, uint32_t *listCount) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (!videoProcPixelFormatAvailable(drv, formats[i])) {
+            continue;
+        }
+        if (list != NULL && n < *listCount) {
+            list[n] = formats[i];
+        }
+        n++;
+    }
+    *listCount = n;
+}
+
 static VAStatus nvQuerySurfaceAttributes(
         VADriverContextP    ctx,
 	    VAConfigID          config,
@@ -3493,7 +5812,12 @@ static VAStatus nvQuerySurfaceAttributes(
 
     if (cfg->entrypoint == VAEntrypointVideoProc) {
         if (num_attribs != NULL) {
-            *num_attribs = drv->supports16BitSurface ? 14 : 13;
+            *num_attribs = 4;
+            for (uint32_t i = 0; i < ARRAY_SIZE(videoProcOutputPixelFormats); i++) {
+                if (videoProcPixelFormatAvailable(drv, videoProcOutputPixelFormats[i])) {
+                    (*num_attribs)++;
+                }
+            }
         }
 
         if (attrib_list != NULL) {
@@ -3518,35 +5842,14 @@ static VAStatus nvQuerySurfaceAttributes(
             attrib_list[3].value.value.i = 16384;
 
             int attrib_idx = 4;
-            attrib_list[attrib_idx].type = VASurfaceAttribPixelFormat;
-            attrib_list[attrib_idx].flags = 0;
-            attrib_list[attrib_idx].value.type = VAGenericValueTypeInteger;
-            attrib_list[attrib_idx].value.value.i = VA_FOURCC_NV12;
-            attrib_idx++;
-
-            if (drv->supports16BitSurface) {
-                attrib_list[attrib_idx].type = VASurfaceAttribPixelFormat;
-                attrib_list[attrib_idx].flags = 0;
-                attrib_list[attrib_idx].value.type = VAGenericValueTypeInteger;
-                attrib_list[attrib_idx].value.value.i = VA_FOURCC_P010;
-                attrib_idx++;
-            }
-
-            const uint32_t rgbFormats[] = {
-                VA_FOURCC_ARGB,
-                VA_FOURCC_XRGB,
-                VA_FOURCC_ABGR,
-                VA_FOURCC_XBGR,
-                VA_FOURCC_RGBA,
-                VA_FOURCC_RGBX,
-                VA_FOURCC_BGRA,
-                VA_FOURCC_BGRX
-            };
-            for (uint32_t i = 0; i < ARRAY_SIZE(rgbFormats); i++) {
+            for (uint32_t i = 0; i < ARRAY_SIZE(videoProcOutputPixelFormats); i++) {
+                if (!videoProcPixelFormatAvailable(drv, videoProcOutputPixelFormats[i])) {
+                    continue;
+                }
                 attrib_list[attrib_idx].type = VASurfaceAttribPixelFormat;
                 attrib_list[attrib_idx].flags = 0;
                 attrib_list[attrib_idx].value.type = VAGenericValueTypeInteger;
-                attrib_list[attrib_idx].value.value.i = (int) rgbFormats[i];
+                attrib_list[attrib_idx].value.value.i = (int) videoProcOutputPixelFormats[i];
                 attrib_idx++;
             }
         }
@@ -3724,8 +6027,59 @@ static VAStatus nvLockSurface(
                        */
 )
 {
-    LOG("In %s", __func__);
-    return VA_STATUS_ERROR_UNIMPLEMENTED;
+    NVDriver *drv = (NVDriver*) ctx->pDriverData;
+    NVSurface *surfaceObj = (NVSurface*) getObjectPtr(drv, OBJECT_TYPE_SURFACE, surface);
+
+    if (surfaceObj == NULL) {
+        return VA_STATUS_ERROR_INVALID_SURFACE;
+    }
+
+    pthread_mutex_lock(&surfaceObj->mutex);
+    const bool alreadyLocked = surfaceObj->locked;
+    surfaceObj->locked = true;
+    pthread_mutex_unlock(&surfaceObj->mutex);
+    if (alreadyLocked) {
+        return VA_STATUS_ERROR_SURFACE_BUSY;
+    }
+
+    //the mapping is the same staging copy vaDeriveImage hands out, so it's only
+    //recopied when the surface has been written since the last lock or map
+    uint32_t pitches[3] = { 0 };
+    uint32_t offsets[3] = { 0 };
+    VAStatus status = acquireSurfaceStaging(drv, surfaceObj, pitches, offsets);
+    if (status == VA_STATUS_SUCCESS && buffer != NULL && !refreshSurfaceStaging(drv, surfaceObj)) {
+        releaseSurfaceStaging(drv, surfaceObj);
+        status = VA_STATUS_ERROR_OPERATION_FAILED;
+    }
+    if (status != VA_STATUS_SUCCESS) {
+        pthread_mutex_lock(&surfaceObj->mutex);
+        surfaceObj->locked = false;
+        pthread_mutex_unlock(&surfaceObj->mutex);
+        return status;
+    }
+
+    //interleaved chroma, V follows U by one sample
+    const NVFormatInfo *fmtInfo = &formatsInfo[surfaceObj->backingImage->format];
+    *fourcc = fmtInfo->vaFormat.fourcc;
+    *luma_stride = pitches[0];
+    *chroma_u_stride = pitches[1];
+    *chroma_v_stride = pitches[1];
+    *luma_offset = offsets[0];
+    *chroma_u_offset = offsets[1];
+    *chroma_v_offset = offsets[1] + fmtInfo->bppc;
+    //there's no buffer object name to give out, the memory only exists in this process
+    if (buffer_name != NULL) {
+        *buffer_name = 0;
+    }
+    //like a derived image, CPU writes through the mapping are uploaded to the surface on unlock
+    if (buffer != NULL) {
+        pthread_mutex_lock(&surfaceObj->mutex);
+        surfaceObj->stagingDirty = true;
+        pthread_mutex_unlock(&surfaceObj->mutex);
+        *buffer = surfaceObj->stagingHost;
+    }
+
+    return VA_STATUS_SUCCESS;
 }
 
 static VAStatus nvUnlockSurface(
@@ -3733,8 +6087,24 @@ static VAStatus nvUnlockSurface(
                 VASurfaceID surface
         )
 {
-    LOG("In %s", __func__);
-    return VA_STATUS_ERROR_UNIMPLEMENTED;
+    NVDriver *drv = (NVDriver*) ctx->pDriverData;
+    NVSurface *surfaceObj = (NVSurface*) getObjectPtr(drv, OBJECT_TYPE_SURFACE, surface);
+
+    if (surfaceObj == NULL) {
+        return VA_STATUS_ERROR_INVALID_SURFACE;
+    }
+
+    //the staging copy stays allocated and valid for the next lock
+    pthread_mutex_lock(&surfaceObj->mutex);
+    const bool wasLocked = surfaceObj->locked;
+    surfaceObj->locked = false;
+    pthread_mutex_unlock(&surfaceObj->mutex);
+    if (!wasLocked) {
+        return VA_STATUS_ERROR_INVALID_SURFACE;
+    }
+
+    releaseSurfaceStaging(drv, surfaceObj);
+    return VA_STATUS_SUCCESS;
 }
 
 static VAStatus nvCreateMFContext(
@@ -3802,6 +6172,156 @@ static VAStatus nvQueryProcessingRate(
     return VA_STATUS_ERROR_UNIMPLEMENTED;
 }
 
+static VAProcColorStandardType videoProcInputColorStandards[] = {
+    VAProcColorStandardBT601,
+    VAProcColorStandardBT709,
+    VAProcColorStandardBT470M,
+    VAProcColorStandardBT470BG,
+    VAProcColorStandardSMPTE170M,
+    VAProcColorStandardSMPTE240M,
+    VAProcColorStandardBT2020,
+};
+
+static VAProcColorStandardType videoProcOutputColorStandards[] = {
+    VAProcColorStandardSRGB,
+};
+
+static NVContext *getVideoProcContext(NVDriver *drv, VAContextID context) {
+    NVContext *nvCtx = (NVContext*) getObjectPtr(drv, OBJECT_TYPE_CONTEXT, context);
+    if (nvCtx == NULL || nvCtx->entrypoint != VAEntrypointVideoProc) {
+        return NULL;
+    }
+    return nvCtx;
+}
+
+static VAStatus nvQueryVideoProcFilters(
+        VADriverContextP    ctx,
+        VAContextID         context,
+        VAProcFilterType   *filters,
+        unsigned int       *num_filters
+    )
+{
+    NVDriver *drv = (NVDriver*) ctx->pDriverData;
+
+    if (getVideoProcContext(drv, context) == NULL) {
+        return VA_STATUS_ERROR_INVALID_CONTEXT;
+    }
+    if (num_filters == NULL) {
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+    }
+
+    //scaling, cropping and colour conversion are part of the pipeline itself, not filters
+    static const VAProcFilterType supportedFilters[] = { VAProcFilterDeinterlacing, VAProcFilterHighDynamicRangeToneMapping };
+    if (*num_filters < ARRAY_SIZE(supportedFilters)) {
+        *num_filters = ARRAY_SIZE(supportedFilters);
+        return VA_STATUS_ERROR_MAX_NUM_EXCEEDED;
+    }
+    if (filters == NULL) {
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+    }
+    memcpy(filters, supportedFilters, sizeof(supportedFilters));
+    *num_filters = ARRAY_SIZE(supportedFilters);
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus nvQueryVideoProcFilterCaps(
+        VADriverContextP    ctx,
+        VAContextID         context,
+        VAProcFilterType    type,
+        void               *filter_caps,
+        unsigned int       *num_filter_caps
+    )
+{
+    NVDriver *drv = (NVDriver*) ctx->pDriverData;
+
+    if (getVideoProcContext(drv, context) == NULL) {
+        return VA_STATUS_ERROR_INVALID_CONTEXT;
+    }
+    if (type != VAProcFilterDeinterlacing && type != VAProcFilterHighDynamicRangeToneMapping) {
+        return VA_STATUS_ERROR_UNSUPPORTED_FILTER;
+    }
+    if (num_filter_caps == NULL) {
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+    }
+
+    if (type == VAProcFilterHighDynamicRangeToneMapping) {
+        if (*num_filter_caps < 1) {
+            *num_filter_caps = 1;
+            return VA_STATUS_ERROR_MAX_NUM_EXCEEDED;
+        }
+        if (filter_caps == NULL) {
+            return VA_STATUS_ERROR_INVALID_PARAMETER;
+        }
+        VAProcFilterCapHighDynamicRange *caps = (VAProcFilterCapHighDynamicRange*) filter_caps;
+        caps[0].metadata_type = VAProcHighDynamicRangeMetadataHDR10;
+        caps[0].caps_flag = VA_TONE_MAPPING_HDR_TO_SDR;
+        *num_filter_caps = 1;
+        return VA_STATUS_SUCCESS;
+    }
+
+    static const VAProcDeinterlacingType algorithms[] = { VAProcDeinterlacingBob, VAProcDeinterlacingMotionAdaptive };
+    if (*num_filter_caps < ARRAY_SIZE(algorithms)) {
+        *num_filter_caps = ARRAY_SIZE(algorithms);
+        return VA_STATUS_ERROR_MAX_NUM_EXCEEDED;
+    }
+    if (filter_caps == NULL) {
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+    }
+    VAProcFilterCapDeinterlacing *caps = (VAProcFilterCapDeinterlacing*) filter_caps;
+    for (uint32_t i = 0; i < ARRAY_SIZE(algorithms); i++) {
+        caps[i].type = algorithms[i];
+    }
+    *num_filter_caps = ARRAY_SIZE(algorithms);
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus nvQueryVideoProcPipelineCaps(
+        VADriverContextP    ctx,
+        VAContextID         context,
+        VABufferID         *filters,
+        unsigned int        num_filters,
+        VAProcPipelineCaps *pipeline_caps
+    )
+{
+    NVDriver *drv = (NVDriver*) ctx->pDriverData;
+
+    if (getVideoProcContext(drv, context) == NULL) {
+        return VA_STATUS_ERROR_INVALID_CONTEXT;
+    }
+    if (pipeline_caps == NULL) {
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+    }
+    VideoProcFilters parsedFilters;
+    if (!parseVideoProcFilters(drv, filters, num_filters, &parsedFilters)) {
+        return VA_STATUS_ERROR_UNSUPPORTED_FILTER;
+    }
+
+    pipeline_caps->pipeline_flags = 0;
+    pipeline_caps->filter_flags = 0;
+    pipeline_caps->num_forward_references = parsedFilters.deinterlace.mode == VIDEO_PROC_DEINTERLACE_ADAPTIVE ? 1 : 0;
+    pipeline_caps->num_backward_references = 0;
+    pipeline_caps->input_color_standards = videoProcInputColorStandards;
+    pipeline_caps->num_input_color_standards = ARRAY_SIZE(videoProcInputColorStandards);
+    pipeline_caps->output_color_standards = videoProcOutputColorStandards;
+    pipeline_caps->num_output_color_standards = ARRAY_SIZE(videoProcOutputColorStandards);
+    pipeline_caps->rotation_flags = 1 << VA_ROTATION_NONE;
+    pipeline_caps->blend_flags = 0;
+    fillVideoProcPixelFormats(drv, videoProcInputPixelFormats, ARRAY_SIZE(videoProcInputPixelFormats),
+                              pipeline_caps->input_pixel_format, &pipeline_caps->num_input_pixel_formats);
+    fillVideoProcPixelFormats(drv, videoProcOutputPixelFormats, ARRAY_SIZE(videoProcOutputPixelFormats),
+                              pipeline_caps->output_pixel_format, &pipeline_caps->num_output_pixel_formats);
+    pipeline_caps->min_input_width = 1;
+    pipeline_caps->min_input_height = 1;
+    pipeline_caps->max_input_width = 16384;
+    pipeline_caps->max_input_height = 16384;
+    pipeline_caps->min_output_width = 1;
+    pipeline_caps->min_output_height = 1;
+    pipeline_caps->max_output_width = 16384;
+    pipeline_caps->max_output_height = 16384;
+
+    return VA_STATUS_SUCCESS;
+}
+
 static VAStatus nvExportSurfaceHandle(
             VADriverContextP    ctx,
             VASurfaceID         surface_id,     /* in */
@@ -3860,6 +6380,9 @@ static VAStatus nvTerminate( VADriverContextP ctx )
     drv->backend->destroyAllBackingImage(drv);
 
     deleteAllObjects(drv);
+    drainImagePool(drv);
+    drainJPEGDecoderPool(drv);
+    stopCpuVideoProcThreads(drv);
 
     if (drv->videoProcModule != NULL) {
         CHECK_CUDA_RESULT(cu->cuModuleUnload(drv->videoProcModule));
@@ -3871,27 +6394,32 @@ static VAStatus nvTerminate( VADriverContextP ctx )
         drv->videoProcModuleP010 = NULL;
         drv->p010ToArgbKernel = NULL;
     }
-    if (drv->videoProcYBuffer != 0) {
-        CHECK_CUDA_RESULT(cu->cuMemFree(drv->videoProcYBuffer));
-        drv->videoProcYBuffer = 0;
+    if (drv->videoProcModuleTex != NULL) {
+        CHECK_CUDA_RESULT(cu->cuModuleUnload(drv->videoProcModuleTex));
+        drv->videoProcModuleTex = NULL;
+        drv->yuvToArgbTexKernel = NULL;
+    }
+    if (drv->videoProcModuleFormat != NULL) {
+        CHECK_CUDA_RESULT(cu->cuModuleUnload(drv->videoProcModuleFormat));
+        drv->videoProcModuleFormat = NULL;
+        drv->yuvConvertKernel = NULL;
+        drv->rgbaToPlanarKernel = NULL;
     }
-    if (drv->videoProcUVBuffer != 0) {
-        CHECK_CUDA_RESULT(cu->cuMemFree(drv->videoProcUVBuffer));
-        drv->videoProcUVBuffer = 0;
+    if (drv->videoProcModuleDeint != NULL) {
+        CHECK_CUDA_RESULT(cu->cuModuleUnload(drv->videoProcModuleDeint));
+        drv->videoProcModuleDeint = NULL;
+        drv->deinterlaceKernel = NULL;
     }
-    if (drv->videoProcArgbBuffer != 0) {
-        CHECK_CUDA_RESULT(cu->cuMemFree(drv->videoProcArgbBuffer));
-        drv->videoProcArgbBuffer = 0;
+    if (drv->videoProcModuleHdr != NULL) {
+        CHECK_CUDA_RESULT(cu->cuModuleUnload(drv->videoProcModuleHdr));
+        drv->videoProcModuleHdr = NULL;
+        drv->yuvToArgbHdrKernel = NULL;
+    }
+
+    if (drv->imageTransferStream != NULL) {
+        CHECK_CUDA_RESULT(cu->cuStreamDestroy(drv->imageTransferStream));
+        drv->imageTransferStream = NULL;
     }
-    free(drv->cpuVideoProcYBuffer);
-    free(drv->cpuVideoProcUVBuffer);
-    free(drv->cpuVideoProcArgbBuffer);
-    drv->cpuVideoProcYBuffer = NULL;
-    drv->cpuVideoProcUVBuffer = NULL;
-    drv->cpuVideoProcArgbBuffer = NULL;
-    drv->cpuVideoProcYBufferSize = 0;
-    drv->cpuVideoProcUVBufferSize = 0;
-    drv->cpuVideoProcArgbBufferSize = 0;
 
     drv->backend->releaseExporter(drv);
 
@@ -3974,6 +6502,13 @@ static const struct VADriverVTable vtable = {
     VTABLE(ExportSurfaceHandle),
 };
 
+static const struct VADriverVTableVPP vtable_vpp = {
+    .version = VA_DRIVER_VTABLE_VPP_VERSION,
+    VTABLE(QueryVideoProcFilters),
+    VTABLE(QueryVideoProcFilterCaps),
+    VTABLE(QueryVideoProcPipelineCaps),
+};
+
 __attribute__((visibility("default")))
 VAStatus __vaDriverInit_1_0(VADriverContextP ctx);
 
@@ -4025,6 +6560,7 @@ VAStatus __vaDriverInit_1_0(VADriverContextP ctx) {
         parseEnvU64("NVD_MAX_DETACHED_BACKING_IMAGE_BYTES", defaultMaxDetachedBackingImageBytes(drv->cudaGpuId));
     drv->maxDetachedBackingImages =
         (uint32_t) parseEnvU64("NVD_MAX_DETACHED_BACKING_IMAGES", DEFAULT_MAX_DETACHED_BACKING_IMAGES);
+    drv->detachedBackingImageBudgetBytes = drv->maxDetachedBackingImageBytes;
 
     nvStatsInit(drv);
 
@@ -4054,6 +6590,12 @@ VAStatus __vaDriverInit_1_0(VADriverContextP ctx) {
     pthread_mutexattr_settype(&attrib, PTHREAD_MUTEX_RECURSIVE);
     pthread_mutex_init(&drv->objectCreationMutex, &attrib);
     pthread_mutex_init(&drv->imagesMutex, &attrib);
+    pthread_mutex_init(&drv->imagePoolMutex, NULL);
+    pthread_mutex_init(&drv->jpegDecoderPoolMutex, NULL);
+    pthread_mutex_init(&drv->cpuVideoProcMutex, NULL);
+    pthread_cond_init(&drv->cpuVideoProcJobCond, NULL);
+    pthread_cond_init(&drv->cpuVideoProcIdleCond, NULL);
+    pthread_mutex_init(&drv->cpuVideoProcSubmitMutex, NULL);
     pthread_mutex_init(&drv->exportMutex, NULL);
 
     if (!drv->backend->initExporter(drv)) {
@@ -4068,6 +6610,11 @@ VAStatus __vaDriverInit_1_0(VADriverContextP ctx) {
         return VA_STATUS_ERROR_OPERATION_FAILED;
     }
 
+    //image readbacks and uploads go through their own stream, it's a blocking one so they still wait for work on the default stream
+    if (CHECK_CUDA_RESULT(cu->cuStreamCreate(&drv->imageTransferStream, CU_STREAM_DEFAULT))) {
+        drv->imageTransferStream = NULL;
+    }
+
     //CHECK_CUDA_RESULT_RETURN(cv->cuvidCtxLockCreate(&drv->vidLock, drv->cudaContext), VA_STATUS_ERROR_OPERATION_FAILED);
 
     nvQueryConfigProfiles2(ctx, drv->profiles, &drv->profileCount);
@@ -4079,5 +6626,6 @@ VAStatus __vaDriverInit_1_0(VADriverContextP ctx) {
     }
 
     *ctx->vtable = vtable;
+    *ctx->vtable_vpp = vtable_vpp;
     return VA_STATUS_SUCCESS;
 }
@@ -22,6 +22,8 @@
 #define SURFACE_QUEUE_SIZE 16
 #define MAX_IMAGE_COUNT 64
 #define MAX_PROFILES 32
+//upper bound on the threads (including the caller) used by the CPU VideoProc fallback
+#define VIDEO_PROC_CPU_MAX_THREADS 8
 
 typedef struct {
     void        *buf;
@@ -45,6 +47,8 @@ typedef struct Object_t
     void            *obj;
 } *Object;
 
+struct _NVSurface;
+
 typedef struct
 {
     unsigned int    elements;
@@ -52,12 +56,16 @@ typedef struct
     VABufferType    bufferType;
     void            *ptr;
     size_t          offset;
+    //set for the buffer of a derived image, ptr is then the surface's staging copy
+    struct _NVSurface *derivedSurface;
+    //ptr came from allocHostCopyMemory and is page-locked
+    bool            pinned;
 } NVBuffer;
 
 struct _NVContext;
 struct _BackingImage;
 
-typedef struct
+typedef struct _NVSurface
 {
     uint32_t                width;
     uint32_t                height;
@@ -78,6 +86,17 @@ typedef struct
     pthread_mutex_t         mutex;
     pthread_cond_t          cond;
     bool                    decodeFailed;
+    //pinned host copy handed out by vaDeriveImage and vaLockSurface, refreshed on map or lock when stale
+    void                    *stagingHost;
+    size_t                  stagingSize;
+    bool                    stagingPinned;
+    bool                    stagingValid;
+    //mapped for writing since it was last uploaded, written back to the surface on unmap
+    bool                    stagingDirty;
+    //derived images and locks pointing at stagingHost, it can't be reallocated while there are any
+    int                     stagingUsers;
+    //between vaLockSurface and vaUnlockSurface
+    bool                    locked;
 } NVSurface;
 
 typedef enum
@@ -89,7 +108,10 @@ typedef enum
     NV_FORMAT_P016,
     NV_FORMAT_444P,
     NV_FORMAT_Q416,
-    NV_FORMAT_ARGB
+    NV_FORMAT_ARGB,
+    NV_FORMAT_I420,
+    NV_FORMAT_YUY2,
+    NV_FORMAT_RGBP
 } NVFormat;
 
 typedef struct
@@ -98,6 +120,8 @@ typedef struct
     uint32_t    height;
     NVFormat    format;
     NVBuffer    *imageBuffer;
+    //set for a derived image, whose buffer is the surface's staging copy
+    struct _NVSurface *derivedSurface;
 } NVImage;
 
 typedef struct {
@@ -160,6 +184,7 @@ typedef struct _NVDriver
     CudaFunctions           *cu;
     CuvidFunctions          *cv;
     CUcontext               cudaContext;
+    CUstream                imageTransferStream;
     CUvideoctxlock          vidLock;
     Array/*<Object>*/       objects;
     pthread_mutex_t         objectCreationMutex;
@@ -172,9 +197,34 @@ typedef struct _NVDriver
     pthread_mutex_t         exportMutex;
     pthread_mutex_t         imagesMutex;
     Array/*<NVEGLImage>*/   images;
+    //host memory of destroyed VAImages, kept for the next vaCreateImage of the same format and size
+    Array/*<ImagePoolEntry>*/ imagePool;
+    pthread_mutex_t         imagePoolMutex;
+    //idle decoders of the JPEG throughput mode
+    Array/*<PooledDecoder>*/ jpegDecoderPool;
+    pthread_mutex_t         jpegDecoderPoolMutex;
+    //persistent helper threads of the CPU VideoProc fallback, started on its first use
+    pthread_mutex_t         cpuVideoProcMutex;
+    pthread_cond_t          cpuVideoProcJobCond;
+    pthread_cond_t          cpuVideoProcIdleCond;
+    //held by the conversion currently using the helper threads
+    pthread_mutex_t         cpuVideoProcSubmitMutex;
+    pthread_t               cpuVideoProcThreads[VIDEO_PROC_CPU_MAX_THREADS - 1];
+    uint32_t                cpuVideoProcThreadCount;
+    bool                    cpuVideoProcThreadsStarted;
+    bool                    cpuVideoProcExiting;
+    struct _CpuVideoProcJob *cpuVideoProcJob;
+    uint64_t                cpuVideoProcGeneration;
+    uint32_t                cpuVideoProcBusyThreads;
     const NVBackend         *backend;
     //fields for direct backend
     NVDriverContext         driverContext;
+    Array/*<BackingImage>*/ reapImages;
+    pthread_mutex_t         reapMutex;
+    pthread_cond_t          reapCond;
+    pthread_t               reapThread;
+    bool                    reapThreadStarted;
+    bool                    reapThreadExiting;
     //fields for egl backend
     EGLDeviceEXT            eglDevice;
     EGLDisplay              eglDisplay;
@@ -190,28 +240,39 @@ typedef struct _NVDriver
     CUmodule                videoProcModuleP010;
     bool                    videoProcKernelP010Failed;
     bool                    videoProcKernelFailed;
-    CUdeviceptr             videoProcYBuffer;
-    CUdeviceptr             videoProcUVBuffer;
-    CUdeviceptr             videoProcArgbBuffer;
-    size_t                  videoProcYBufferSize;
-    size_t                  videoProcUVBufferSize;
-    size_t                  videoProcArgbBufferSize;
-    void                    *cpuVideoProcYBuffer;
-    void                    *cpuVideoProcUVBuffer;
-    void                    *cpuVideoProcArgbBuffer;
-    size_t                  cpuVideoProcYBufferSize;
-    size_t                  cpuVideoProcUVBufferSize;
-    size_t                  cpuVideoProcArgbBufferSize;
+    CUmodule                videoProcModuleTex;
+    CUfunction              yuvToArgbTexKernel;
+    bool                    videoProcKernelTexFailed;
+    CUmodule                videoProcModuleFormat;
+    CUfunction              yuvConvertKernel;
+    CUfunction              rgbaToPlanarKernel;
+    bool                    videoProcKernelFormatFailed;
+    CUmodule                videoProcModuleDeint;
+    CUfunction              deinterlaceKernel;
+    bool                    videoProcKernelDeintFailed;
+    CUmodule                videoProcModuleHdr;
+    CUfunction              yuvToArgbHdrKernel;
+    bool                    videoProcKernelHdrFailed;
     bool                    statsEnabled;
     uint64_t                statsLogInterval;
     atomic_uint_fast64_t    stats[NV_STAT_COUNT];
     uint64_t                maxDetachedBackingImageBytes;
     uint32_t                maxDetachedBackingImages;
     uint64_t                detachedBackingImageSerial;
+    uint64_t                detachedBackingImageBudgetBytes;
+    uint64_t                vramPressureCheckTimeNs;
+    bool                    vramPressureCheckDisabled;
 } NVDriver;
 
 struct _NVCodec;
 
+//objects a queued VideoProc kernel uses, released once the stream has been synchronised
+typedef struct {
+    CUtexObject         yTex;
+    CUtexObject         uvTex;
+    unsigned long long  dstSurf;
+} VideoProcPendingBlit;
+
 typedef struct _NVContext
 {
     NVDriver            *drv;
@@ -238,6 +299,12 @@ typedef struct _NVContext
     cudaVideoSurfaceFormat decoderSurfaceFormat;
     cudaVideoChromaFormat decoderChromaFormat;
     int                 decoderBitDepth;
+    //JPEG throughput mode: the decoder belongs to drv->jpegDecoderPool and is reconfigured per picture size
+    bool                decoderPooled;
+    uint32_t            decoderMaxWidth;
+    uint32_t            decoderMaxHeight;
+    uint32_t            decoderWidth;
+    uint32_t            decoderHeight;
     int                 currentPictureId;
     pthread_t           resolveThread;
     bool                resolveThreadStarted;
@@ -246,10 +313,34 @@ typedef struct _NVContext
     NVSurface*          surfaceQueue[SURFACE_QUEUE_SIZE];
     int                 surfaceQueueReadIdx;
     int                 surfaceQueueWriteIdx;
+    //pictures queued for the resolve thread and not yet mapped, guarded by resolveMutex
+    int                 resolvesInFlight;
+    pthread_cond_t      resolveIdleCondition;
     volatile bool       exiting;
     pthread_mutex_t     surfaceCreationMutex;
     int                 surfaceCount;
     bool                firstKeyframeValid;
+    //VideoProc only: the stream conversions run on, and the staged path's scratch buffers
+    CUstream            videoProcStream;
+    CUdeviceptr         videoProcYBuffer;
+    CUdeviceptr         videoProcUVBuffer;
+    CUdeviceptr         videoProcArgbBuffer;
+    size_t              videoProcYBufferSize;
+    size_t              videoProcUVBufferSize;
+    size_t              videoProcArgbBufferSize;
+    CUdeviceptr         videoProcOutBuffer;
+    size_t              videoProcOutBufferSize;
+    CUdeviceptr         videoProcDeintBuffer;
+    size_t              videoProcDeintBufferSize;
+    BackingImage        *videoProcDeintImage;
+    //set while nvRenderPicture runs several pipelines, whose texture-path kernels then share one stream sync
+    bool                videoProcBatch;
+    VideoProcPendingBlit *videoProcPending;
+    uint32_t            videoProcPendingCount;
+    uint32_t            videoProcPendingCapacity;
+    //host copy of the source planes (and the RGB output) for the CPU fallback, grown as needed
+    uint8_t             *videoProcCpuScratch;
+    size_t              videoProcCpuScratchSize;
 } NVContext;
 
 typedef struct
@@ -265,6 +356,10 @@ typedef struct
 typedef void (*HandlerFunc)(NVContext*, NVBuffer* , CUVIDPICPARAMS*);
 typedef cudaVideoCodec (*ComputeCudaCodec)(VAProfile);
 typedef void (*CodecBeginPictureFunc)(NVContext*);
+//sets up per-context state in codecData, returns false if it couldn't be allocated
+typedef bool (*CodecContextInitFunc)(NVContext*);
+//releases codecData and anything it owns. Optional, without it codecData is just freed
+typedef void (*CodecContextDestroyFunc)(NVContext*);
 
 // Internals exposed for the stats subsystem (src/stats.c).
 pid_t nv_gettid(void);
@@ -278,6 +373,8 @@ struct _NVCodec {
     int                 supportedProfileCount;
     const VAProfile     *supportedProfiles;
     CodecBeginPictureFunc beginPicture;
+    CodecContextInitFunc initContext;
+    CodecContextDestroyFunc destroyContext;
 };
 
 typedef struct _NVCodec NVCodec;
@@ -296,6 +393,8 @@ typedef struct
 extern const NVFormatInfo formatsInfo[];
 
 void appendBuffer(AppendableBuffer *ab, const void *buf, uint64_t size);
+//makes room for size more bytes and returns where they start, the caller adds what it wrote to ab->size
+void *reserveBuffer(AppendableBuffer *ab, uint64_t size);
 int pictureIdxFromSurfaceId(NVDriver *ctx, VASurfaceID surf);
 NVSurface* nvSurfaceFromSurfaceId(NVDriver *drv, VASurfaceID surf);
 const char *nvColorStandardName(VAProcColorStandardType colorStandard);
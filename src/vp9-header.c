@@ -0,0 +1,229 @@
+#include "vp9-header.h"
+
+#include <string.h>
+
+typedef struct {
+    const uint8_t *data;
+    uint32_t      size;
+    uint32_t      bitPos;
+    bool          overrun;
+} VP9BitReader;
+
+static uint32_t vp9ReadBits(VP9BitReader *br, int count) {
+    uint32_t value = 0;
+    for (int i = 0; i < count; i++) {
+        uint32_t byte = br->bitPos >> 3;
+        if (byte >= br->size) {
+            br->overrun = true;
+            return 0;
+        }
+        value = (value << 1) | ((br->data[byte] >> (7 - (br->bitPos & 7))) & 1);
+        br->bitPos++;
+    }
+    return value;
+}
+
+static bool vp9ReadBit(VP9BitReader *br) {
+    return vp9ReadBits(br, 1) != 0;
+}
+
+//su(n) in the spec, the magnitude is followed by the sign
+static int vp9ReadSigned(VP9BitReader *br, int count) {
+    int value = (int) vp9ReadBits(br, count);
+    return vp9ReadBit(br) ? -value : value;
+}
+
+static bool vp9ReadSyncCode(VP9BitReader *br) {
+    return vp9ReadBits(br, 24) == 0x498342;
+}
+
+static void vp9ReadColorConfig(VP9BitReader *br, VP9HeaderState *state, int profile) {
+    if (profile >= 2) {
+        vp9ReadBit(br); //ten_or_twelve_bit
+    }
+    state->colorSpace = (uint8_t) vp9ReadBits(br, 3);
+    if (state->colorSpace != VP9_CS_SRGB) {
+        state->colorRangeFull = vp9ReadBit(br);
+        if (profile == 1 || profile == 3) {
+            vp9ReadBits(br, 3); //subsampling_x, subsampling_y, reserved_zero
+        }
+    } else {
+        state->colorRangeFull = true;
+        if (profile == 1 || profile == 3) {
+            vp9ReadBit(br); //reserved_zero
+        }
+    }
+}
+
+static void vp9SkipFrameSize(VP9BitReader *br) {
+    vp9ReadBits(br, 32); //frame_width_minus_1, frame_height_minus_1
+}
+
+static void vp9SkipRenderSize(VP9BitReader *br) {
+    if (vp9ReadBit(br)) {
+        vp9ReadBits(br, 32); //render_width_minus_1, render_height_minus_1
+    }
+}
+
+void vp9SetupPastIndependence(VP9HeaderState *state) {
+    memset(state->segmentFeatureEnabled, 0, sizeof(state->segmentFeatureEnabled));
+    memset(state->segmentFeatureData, 0, sizeof(state->segmentFeatureData));
+    state->segmentationAbsDelta = false;
+    state->lfRefDeltas[0] = 1;
+    state->lfRefDeltas[1] = 0;
+    state->lfRefDeltas[2] = -1;
+    state->lfRefDeltas[3] = -1;
+    state->lfModeDeltas[0] = 0;
+    state->lfModeDeltas[1] = 0;
+}
+
+static void vp9ReadLoopFilterParams(VP9BitReader *br, VP9HeaderState *state) {
+    vp9ReadBits(br, 9); //filter_level, sharpness_level
+    state->lfModeRefDeltaEnabled = vp9ReadBit(br);
+    if (state->lfModeRefDeltaEnabled && vp9ReadBit(br)) {
+        for (int i = 0; i < VP9_MAX_REF_FRAMES; i++) {
+            if (vp9ReadBit(br)) {
+                state->lfRefDeltas[i] = (int8_t) vp9ReadSigned(br, 6);
+            }
+        }
+        for (int i = 0; i < VP9_MAX_MODE_LF_DELTAS; i++) {
+            if (vp9ReadBit(br)) {
+                state->lfModeDeltas[i] = (int8_t) vp9ReadSigned(br, 6);
+            }
+        }
+    }
+}
+
+static int8_t vp9ReadDeltaQ(VP9BitReader *br) {
+    return vp9ReadBit(br) ? (int8_t) vp9ReadSigned(br, 4) : 0;
+}
+
+static void vp9ReadQuantizationParams(VP9BitReader *br, VP9HeaderState *state) {
+    state->baseQIdx = (uint8_t) vp9ReadBits(br, 8);
+    state->deltaQYDc = vp9ReadDeltaQ(br);
+    state->deltaQUvDc = vp9ReadDeltaQ(br);
+    state->deltaQUvAc = vp9ReadDeltaQ(br);
+}
+
+static void vp9ReadSegmentationParams(VP9BitReader *br, VP9HeaderState *state) {
+    static const int featureBits[VP9_SEG_LVL_MAX] = { 8, 6, 2, 0 };
+    static const bool featureSigned[VP9_SEG_LVL_MAX] = { true, true, false, false };
+
+    if (!vp9ReadBit(br)) { //segmentation_enabled
+        return;
+    }
+    //the tree and prediction probabilities are in VA-API's picture parameters
+    if (vp9ReadBit(br)) { //segmentation_update_map
+        for (int i = 0; i < 7; i++) {
+            if (vp9ReadBit(br)) {
+                vp9ReadBits(br, 8);
+            }
+        }
+        if (vp9ReadBit(br)) { //segmentation_temporal_update
+            for (int i = 0; i < 3; i++) {
+                if (vp9ReadBit(br)) {
+                    vp9ReadBits(br, 8);
+                }
+            }
+        }
+    }
+    if (vp9ReadBit(br)) { //segmentation_update_data
+        state->segmentationAbsDelta = vp9ReadBit(br);
+        for (int i = 0; i < VP9_MAX_SEGMENTS; i++) {
+            for (int j = 0; j < VP9_SEG_LVL_MAX; j++) {
+                int value = 0;
+                bool enabled = vp9ReadBit(br);
+                if (enabled && featureBits[j] > 0) {
+                    value = (int) vp9ReadBits(br, featureBits[j]);
+                    if (featureSigned[j] && vp9ReadBit(br)) {
+                        value = -value;
+                    }
+                }
+                state->segmentFeatureEnabled[i][j] = enabled;
+                state->segmentFeatureData[i][j] = (int16_t) value;
+            }
+        }
+    }
+}
+
+bool parseVP9UncompressedHeader(VP9HeaderState *state, const uint8_t *data, uint32_t size) {
+    VP9BitReader br = { .data = data, .size = size };
+    VP9HeaderState next = *state;
+
+    if (vp9ReadBits(&br, 2) != 2) { //frame_marker
+        return false;
+    }
+    int profile = (int) vp9ReadBits(&br, 1);
+    profile |= (int) vp9ReadBits(&br, 1) << 1;
+    if (profile == 3 && vp9ReadBit(&br)) { //reserved_zero
+        return false;
+    }
+    if (vp9ReadBit(&br)) { //show_existing_frame
+        return false;
+    }
+    const int frameType = (int) vp9ReadBits(&br, 1);
+    const bool showFrame = vp9ReadBit(&br);
+    const bool errorResilient = vp9ReadBit(&br);
+
+    bool intraOnly = false;
+    if (frameType == VP9_KEY_FRAME) {
+        if (!vp9ReadSyncCode(&br)) {
+            return false;
+        }
+        vp9ReadColorConfig(&br, &next, profile);
+        vp9SkipFrameSize(&br);
+        vp9SkipRenderSize(&br);
+    } else {
+        intraOnly = showFrame ? false : vp9ReadBit(&br);
+        if (!errorResilient) {
+            vp9ReadBits(&br, 2); //reset_frame_context
+        }
+        if (intraOnly) {
+            if (!vp9ReadSyncCode(&br)) {
+                return false;
+            }
+            if (profile > 0) {
+                vp9ReadColorConfig(&br, &next, profile);
+            } else {
+                next.colorSpace = VP9_CS_BT_601;
+                next.colorRangeFull = false;
+            }
+            vp9ReadBits(&br, 8); //refresh_frame_flags
+            vp9SkipFrameSize(&br);
+            vp9SkipRenderSize(&br);
+        } else {
+            vp9ReadBits(&br, 8); //refresh_frame_flags
+            vp9ReadBits(&br, VP9_REFS_PER_FRAME * 4); //ref_frame_idx, ref_frame_sign_bias
+            bool foundRef = false;
+            for (int i = 0; i < VP9_REFS_PER_FRAME && !foundRef; i++) {
+                foundRef = vp9ReadBit(&br);
+            }
+            if (!foundRef) {
+                vp9SkipFrameSize(&br);
+            }
+            vp9SkipRenderSize(&br);
+            vp9ReadBit(&br); //allow_high_precision_mv
+            if (!vp9ReadBit(&br)) { //is_filter_switchable
+                vp9ReadBits(&br, 2); //raw_interpolation_filter
+            }
+        }
+    }
+
+    if (!errorResilient) {
+        vp9ReadBits(&br, 2); //refresh_frame_context, frame_parallel_decoding_mode
+    }
+    vp9ReadBits(&br, 2); //frame_context_idx
+
+    if (frameType == VP9_KEY_FRAME || intraOnly || errorResilient) {
+        vp9SetupPastIndependence(&next);
+    }
+    vp9ReadLoopFilterParams(&br, &next);
+    vp9ReadQuantizationParams(&br, &next);
+    vp9ReadSegmentationParams(&br, &next);
+
+    if (br.overrun) {
+        return false;
+    }
+    *state = next;
+    return true;
+}
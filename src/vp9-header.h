@@ -0,0 +1,58 @@
+#ifndef VP9_HEADER_H
+#define VP9_HEADER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define VP9_MAX_SEGMENTS        8
+#define VP9_SEG_LVL_MAX         4
+#define VP9_MAX_REF_FRAMES      4
+#define VP9_MAX_MODE_LF_DELTAS  2
+#define VP9_REFS_PER_FRAME      3
+
+enum {
+    VP9_KEY_FRAME = 0,
+    VP9_NON_KEY_FRAME = 1,
+};
+
+enum {
+    VP9_CS_UNKNOWN = 0,
+    VP9_CS_BT_601 = 1,
+    VP9_CS_BT_709 = 2,
+    VP9_CS_SMPTE_170 = 3,
+    VP9_CS_SMPTE_240 = 4,
+    VP9_CS_BT_2020 = 5,
+    VP9_CS_RESERVED_2 = 6,
+    VP9_CS_SRGB = 7,
+};
+
+//the parts of the uncompressed header that VA-API doesn't pass on, but NVDEC requires
+typedef struct {
+    //carried over from previous frames unless the header updates them
+    uint8_t colorSpace;
+    bool    colorRangeFull;
+    bool    segmentationAbsDelta;
+    bool    segmentFeatureEnabled[VP9_MAX_SEGMENTS][VP9_SEG_LVL_MAX];
+    int16_t segmentFeatureData[VP9_MAX_SEGMENTS][VP9_SEG_LVL_MAX];
+    int8_t  lfRefDeltas[VP9_MAX_REF_FRAMES];
+    int8_t  lfModeDeltas[VP9_MAX_MODE_LF_DELTAS];
+
+    //specific to the last parsed frame
+    bool    lfModeRefDeltaEnabled;
+    uint8_t baseQIdx;
+    int8_t  deltaQYDc;
+    int8_t  deltaQUvDc;
+    int8_t  deltaQUvAc;
+} VP9HeaderState;
+
+// Resets the state a key, intra-only or error resilient frame doesn't inherit.
+void vp9SetupPastIndependence(VP9HeaderState *state);
+
+// Parses the uncompressed header of a VP9 frame up to the segmentation params,
+// which is everything parseExtraInfo needs. state holds what the previous frames
+// of the stream left behind, and is only updated if the whole header could be
+// read. Returns false for truncated or invalid headers, and for
+// show_existing_frame headers which carry nothing to decode.
+bool parseVP9UncompressedHeader(VP9HeaderState *state, const uint8_t *data, uint32_t size);
+
+#endif // VP9_HEADER_H
@@ -1,8 +1,7 @@
 #include "vabackend.h"
+#include "vp9-header.h"
 
-//squash a compile warning, we know this is an unstable API
-#define GST_USE_UNSTABLE_API
-#include <gst/codecparsers/gstvp9parser.h>
+#include <stdlib.h>
 
 static void copyVP9PicParam(NVContext *ctx, NVBuffer* buffer, CUVIDPICPARAMS *picParams)
 {
@@ -68,75 +67,76 @@ static void copyVP9PicParam(NVContext *ctx, NVBuffer* buffer, CUVIDPICPARAMS *pi
     }
 }
 
-static GstVp9Parser *parser;
+typedef struct {
+    VP9HeaderState header;
+} VP9Context;
 
-static VAProcColorStandardType vp9ColorStandard(GstVp9ColorSpace colorSpace) {
+static bool initVP9Context(NVContext *ctx) {
+    VP9Context *vp9Ctx = calloc(1, sizeof(VP9Context));
+    if (vp9Ctx == NULL) {
+        return false;
+    }
+    vp9SetupPastIndependence(&vp9Ctx->header);
+    ctx->codecData = vp9Ctx;
+    return true;
+}
+
+static VAProcColorStandardType vp9ColorStandard(uint8_t colorSpace) {
     switch (colorSpace) {
-    case GST_VP9_CS_BT_601:
+    case VP9_CS_BT_601:
         return VAProcColorStandardBT601;
-    case GST_VP9_CS_BT_709:
+    case VP9_CS_BT_709:
         return VAProcColorStandardBT709;
-    case GST_VP9_CS_SMPTE_170:
+    case VP9_CS_SMPTE_170:
         return VAProcColorStandardSMPTE170M;
-    case GST_VP9_CS_SMPTE_240:
+    case VP9_CS_SMPTE_240:
         return VAProcColorStandardSMPTE240M;
-    case GST_VP9_CS_BT_2020:
+    case VP9_CS_BT_2020:
         return VAProcColorStandardBT2020;
-    case GST_VP9_CS_UNKNOWN:
-    case GST_VP9_CS_RESERVED_2:
-    case GST_VP9_CS_SRGB:
+    case VP9_CS_UNKNOWN:
+    case VP9_CS_RESERVED_2:
+    case VP9_CS_SRGB:
     default:
         return VAProcColorStandardNone;
     }
 }
 
 static void parseExtraInfo(NVContext *ctx, void *buf, uint32_t size, CUVIDPICPARAMS *picParams) {
-    //TODO a bit of a hack as we don't have per decoder init/deinit functions atm
-    if (parser == NULL) {
-        parser = gst_vp9_parser_new ();
-    }
+    VP9HeaderState *hdr = &((VP9Context*) ctx->codecData)->header;
 
     //parse all the extra information that VA-API doesn't support, but NVDEC requires
-    GstVp9FrameHdr hdr;
-    GstVp9ParserResult res = gst_vp9_parser_parse_frame_header(parser, &hdr, buf, size);
-
-    if (res == GST_VP9_PARSER_OK) {
-        for (int i = 0; i < 8; i++) {
-            picParams->CodecSpecific.vp9.segmentFeatureEnable[i][0] = hdr.segmentation.data[i].alternate_quantizer_enabled;
-            picParams->CodecSpecific.vp9.segmentFeatureEnable[i][1] = hdr.segmentation.data[i].alternate_loop_filter_enabled;
-            picParams->CodecSpecific.vp9.segmentFeatureEnable[i][2] = hdr.segmentation.data[i].reference_frame_enabled;
-            picParams->CodecSpecific.vp9.segmentFeatureEnable[i][3] = hdr.segmentation.data[i].reference_skip;
-
-            picParams->CodecSpecific.vp9.segmentFeatureData[i][0] = hdr.segmentation.data[i].alternate_quantizer;
-            picParams->CodecSpecific.vp9.segmentFeatureData[i][1] = hdr.segmentation.data[i].alternate_loop_filter;
-            picParams->CodecSpecific.vp9.segmentFeatureData[i][2] = hdr.segmentation.data[i].reference_frame;
+    if (parseVP9UncompressedHeader(hdr, buf, size)) {
+        for (int i = 0; i < VP9_MAX_SEGMENTS; i++) {
+            for (int j = 0; j < VP9_SEG_LVL_MAX; j++) {
+                picParams->CodecSpecific.vp9.segmentFeatureEnable[i][j] = hdr->segmentFeatureEnabled[i][j];
+            }
+            picParams->CodecSpecific.vp9.segmentFeatureData[i][0] = hdr->segmentFeatureData[i][0];
+            picParams->CodecSpecific.vp9.segmentFeatureData[i][1] = hdr->segmentFeatureData[i][1];
+            picParams->CodecSpecific.vp9.segmentFeatureData[i][2] = hdr->segmentFeatureData[i][2];
             picParams->CodecSpecific.vp9.segmentFeatureData[i][3] = 0;
         }
 
-        picParams->CodecSpecific.vp9.segmentFeatureMode = hdr.segmentation.abs_delta;
+        picParams->CodecSpecific.vp9.segmentFeatureMode = hdr->segmentationAbsDelta;
 
-        picParams->CodecSpecific.vp9.modeRefLfEnabled = hdr.loopfilter.mode_ref_delta_enabled;
-        for (int i = 0; i < 2; i++)
-            picParams->CodecSpecific.vp9.mbModeLfDelta[i] = hdr.loopfilter.mode_deltas[i];
+        picParams->CodecSpecific.vp9.modeRefLfEnabled = hdr->lfModeRefDeltaEnabled;
+        for (int i = 0; i < VP9_MAX_MODE_LF_DELTAS; i++)
+            picParams->CodecSpecific.vp9.mbModeLfDelta[i] = hdr->lfModeDeltas[i];
 
-        for (int i = 0; i < 4; i++)
-            picParams->CodecSpecific.vp9.mbRefLfDelta[i] = hdr.loopfilter.ref_deltas[i];
+        for (int i = 0; i < VP9_MAX_REF_FRAMES; i++)
+            picParams->CodecSpecific.vp9.mbRefLfDelta[i] = hdr->lfRefDeltas[i];
 
-        picParams->CodecSpecific.vp9.qpYAc = hdr.quant_indices.y_ac_qi;
-        picParams->CodecSpecific.vp9.qpYDc = hdr.quant_indices.y_dc_delta;
-        picParams->CodecSpecific.vp9.qpChDc = hdr.quant_indices.uv_dc_delta;
-        picParams->CodecSpecific.vp9.qpChAc = hdr.quant_indices.uv_ac_delta;
+        picParams->CodecSpecific.vp9.qpYAc = hdr->baseQIdx;
+        picParams->CodecSpecific.vp9.qpYDc = hdr->deltaQYDc;
+        picParams->CodecSpecific.vp9.qpChDc = hdr->deltaQUvDc;
+        picParams->CodecSpecific.vp9.qpChAc = hdr->deltaQUvAc;
 
-        picParams->CodecSpecific.vp9.colorSpace = parser->color_space;
-        VAProcColorStandardType colorStandard = vp9ColorStandard((GstVp9ColorSpace) parser->color_space);
-        bool colorRangeFull = parser->color_range == GST_VP9_CR_FULL;
-        nvSurfaceSetColorMetadata(ctx->renderTarget, colorStandard, colorRangeFull);
+        picParams->CodecSpecific.vp9.colorSpace = hdr->colorSpace;
+        VAProcColorStandardType colorStandard = vp9ColorStandard(hdr->colorSpace);
+        nvSurfaceSetColorMetadata(ctx->renderTarget, colorStandard, hdr->colorRangeFull);
         LOG_DEBUG("VP9 color metadata: color_space=%u color_standard=%s(%d) full_range=%d render=%p",
-            parser->color_space, nvColorStandardName(colorStandard), colorStandard, colorRangeFull,
+            hdr->colorSpace, nvColorStandardName(colorStandard), colorStandard, hdr->colorRangeFull,
             ctx->renderTarget);
     }
-
-    //gst_vp9_parser_free(parser);
 }
 
 static void copyVP9SliceParam(NVContext *ctx, NVBuffer* buffer, CUVIDPICPARAMS *picParams)
@@ -192,4 +192,5 @@ const DECLARE_CODEC(vp9Codec) = {
     },
     .supportedProfileCount = ARRAY_SIZE(vp9SupportedProfiles),
     .supportedProfiles = vp9SupportedProfiles,
+    .initContext = initVP9Context,
 };
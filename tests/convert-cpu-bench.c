@@ -0,0 +1,66 @@
+// Measures the throughput of the row conversion used by the CPU VideoProc
+// fallback, for every implementation the CPU supports down to the scalar
+// reference.
+
+#include "convert-cpu.h"
+#include "test-common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_WIDTH  1920
+#define BENCH_HEIGHT 1080
+#define BENCH_FRAMES 50
+
+static void runBenchmark(const char *name, ConvertYuvRowToRgbFunc convert, bool is16Bit,
+                         const void *yPlane, const void *uvPlane, uint8_t *dst) {
+    static const ColorMatrix matrix = { 459, 55, 136, 541 };
+    const VideoProcSampleInfo sampleInfo = is16Bit ? (VideoProcSampleInfo) { 6, 298, 64, 512, 512, 10 }
+                                                   : (VideoProcSampleInfo) { 0, 298, 16, 128, 128, 8 };
+    const size_t bytesPerSample = is16Bit ? 2 : 1;
+
+    struct timespec start;
+    benchStart(&start);
+    for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+        for (uint32_t y = 0; y < BENCH_HEIGHT; y++) {
+            const unsigned char *yRow = (const unsigned char*) yPlane + (size_t) y * BENCH_WIDTH * bytesPerSample;
+            const unsigned char *uvRow = (const unsigned char*) uvPlane + (size_t) (y / 2) * BENCH_WIDTH * bytesPerSample;
+            convert(yRow, uvRow, 0, BENCH_WIDTH, dst + (size_t) y * BENCH_WIDTH * 4, 0, is16Bit, &matrix, &sampleInfo);
+        }
+    }
+    const double seconds = elapsedSeconds(&start);
+    printf("%-8s %2d-bit: %8.2f frames/s, %8.1f Mpixel/s\n", name, is16Bit ? 10 : 8,
+           BENCH_FRAMES / seconds, (double) BENCH_WIDTH * BENCH_HEIGHT * BENCH_FRAMES / seconds / 1e6);
+}
+
+int main(void) {
+    const size_t planeSamples = (size_t) BENCH_WIDTH * BENCH_HEIGHT;
+    uint16_t *yPlane = malloc(planeSamples * 2);
+    uint16_t *uvPlane = malloc(planeSamples);
+    uint8_t *dst = malloc(planeSamples * 4);
+    if (yPlane == NULL || uvPlane == NULL || dst == NULL) {
+        return 1;
+    }
+    for (size_t i = 0; i < planeSamples; i++) {
+        yPlane[i] = (uint16_t) (i * 2654435761u >> 16);
+    }
+    for (size_t i = 0; i < planeSamples / 2; i++) {
+        uvPlane[i] = (uint16_t) (i * 40503u);
+    }
+    //fault the output in up front so the first run isn't charged for it
+    memset(dst, 0, planeSamples * 4);
+
+    const ConvertYuvRowToRgbImpl *impls;
+    const int implCount = nvConvertYuvRowToRgbImplementations(&impls);
+    for (int is16Bit = 0; is16Bit < 2; is16Bit++) {
+        for (int i = 0; i < implCount; i++) {
+            runBenchmark(impls[i].name, impls[i].convert, is16Bit, yPlane, uvPlane, dst);
+        }
+    }
+
+    free(yPlane);
+    free(uvPlane);
+    free(dst);
+    return 0;
+}
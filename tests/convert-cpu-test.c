@@ -0,0 +1,91 @@
+// Checks every SIMD row conversion the CPU supports, not only the one
+// nvConvertYuvRowToRgb dispatches to, against the scalar reference, over
+// random samples, every output order and sample layout, and unaligned start
+// columns and lengths. Needs no GPU.
+
+#include "convert-cpu.h"
+#include "test-common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_ROW_WIDTH 131
+
+static const ColorMatrix testMatrices[] = {
+    { 409, 100, 208, 516 },
+    { 459,  55, 136, 541 },
+    { 359,  88, 183, 454 },
+    { 403,  48, 120, 475 },
+};
+
+// Same layouts videoProcSampleInfoForFormat produces for NV12, P010 and P012.
+static VideoProcSampleInfo testSampleInfo(int bits, bool fullRange) {
+    const int yScale = fullRange ? 256 : 298;
+    switch (bits) {
+    case 10:
+        return (VideoProcSampleInfo) { 6, yScale, fullRange ? 0 : 64, 512, 512, 10 };
+    case 12:
+        return (VideoProcSampleInfo) { 4, yScale, fullRange ? 0 : 256, 2048, 2048, 12 };
+    default:
+        return (VideoProcSampleInfo) { 0, yScale, fullRange ? 0 : 16, 128, 128, 8 };
+    }
+}
+
+static void fillRow(void *row, uint32_t samples, bool is16Bit, uint32_t *state) {
+    for (uint32_t i = 0; i < samples; i++) {
+        if (is16Bit) {
+            ((uint16_t*) row)[i] = (uint16_t) nextRandom(state);
+        } else {
+            ((uint8_t*) row)[i] = (uint8_t) nextRandom(state);
+        }
+    }
+}
+
+int main(void) {
+    static const int depths[] = { 8, 10, 12 };
+    uint16_t yRow[TEST_ROW_WIDTH], uvRow[TEST_ROW_WIDTH + 1];
+    uint8_t expected[TEST_ROW_WIDTH * 4], actual[TEST_ROW_WIDTH * 4];
+    uint32_t state = 0x2545f491;
+
+    const ConvertYuvRowToRgbImpl *impls;
+    //the last one is the scalar reference itself
+    const int implCount = nvConvertYuvRowToRgbImplementations(&impls) - 1;
+    if (implCount == 0) {
+        printf("No SIMD implementation is built for or supported by this CPU\n");
+    }
+    for (int i = 0; i < implCount; i++) {
+        printf("Testing the %s implementation%s\n", impls[i].name, i == 0 ? " (dispatched)" : "");
+    }
+
+    for (int iteration = 0; iteration < 200; iteration++) {
+        for (size_t d = 0; d < sizeof(depths) / sizeof(depths[0]); d++) {
+            const bool is16Bit = depths[d] > 8;
+            fillRow(yRow, TEST_ROW_WIDTH, is16Bit, &state);
+            fillRow(uvRow, TEST_ROW_WIDTH + 1, is16Bit, &state);
+
+            for (int range = 0; range < 2; range++) {
+                const VideoProcSampleInfo sampleInfo = testSampleInfo(depths[d], range != 0);
+                for (size_t m = 0; m < sizeof(testMatrices) / sizeof(testMatrices[0]); m++) {
+                    for (uint32_t order = 0; order < 4; order++) {
+                        const uint32_t x = nextRandom(&state) % TEST_ROW_WIDTH;
+                        const uint32_t count = nextRandom(&state) % (TEST_ROW_WIDTH - x + 1);
+
+                        memset(expected, 0xcd, sizeof(expected));
+                        nvConvertYuvRowToRgbScalar(yRow, uvRow, x, count, expected, order, is16Bit, &testMatrices[m], &sampleInfo);
+
+                        for (int i = 0; i < implCount; i++) {
+                            memset(actual, 0xcd, sizeof(actual));
+                            impls[i].convert(yRow, uvRow, x, count, actual, order, is16Bit, &testMatrices[m], &sampleInfo);
+                            EXPECTF(memcmp(expected, actual, sizeof(expected)) == 0,
+                                    "%s mismatch: %d-bit %s range, matrix %zu, order %u, x %u, count %u", impls[i].name,
+                                    depths[d], range ? "full" : "limited", m, order, x, count);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return testResult("conversion checks");
+}
@@ -0,0 +1,76 @@
+// Measures the wall-clock time of preallocating render targets serially and
+// through the worker fan-out, with the RM allocation and the CUDA
+// external-memory import replaced by stubs that sleep for about as long as
+// the real calls take.
+
+#define _GNU_SOURCE
+
+#include "preallocate.h"
+#include "test-common.h"
+
+#include <stdio.h>
+#include <time.h>
+
+//rough cost of the alloc_buffer ioctls and of cuImportExternalMemory per surface
+#define STUB_ALLOC_BUFFER_US 1500
+#define STUB_IMPORT_US       500
+
+static void sleepMicroseconds(long us) {
+    const struct timespec duration = { .tv_sec = us / 1000000L, .tv_nsec = (us % 1000000L) * 1000L };
+    nanosleep(&duration, NULL);
+}
+
+static bool stubAllocBuffer(void) {
+    sleepMicroseconds(STUB_ALLOC_BUFFER_US);
+    return true;
+}
+
+static bool stubImport(void) {
+    sleepMicroseconds(STUB_IMPORT_US);
+    return true;
+}
+
+static bool stubRealiseSurface(void *ctx, int index) {
+    return stubAllocBuffer() && stubImport();
+}
+
+static double runPreallocate(int surfaceCount, int workerCount, int *threads) {
+    PreallocateWork work = {
+        .realise = stubRealiseSurface,
+        .count = surfaceCount,
+    };
+    atomic_init(&work.next, 0);
+    atomic_init(&work.realised, 0);
+
+    struct timespec start;
+    benchStart(&start);
+    *threads = nvRunPreallocateWork(&work, workerCount);
+    const double seconds = elapsedSeconds(&start);
+
+    if (atomic_load(&work.realised) != surfaceCount) {
+        fprintf(stderr, "only %d of %d surfaces realised\n", atomic_load(&work.realised), surfaceCount);
+    }
+    return seconds;
+}
+
+int main(void) {
+    static const int surfaceCounts[] = { 4, 8, 16, 20, 32 };
+
+    for (size_t i = 0; i < sizeof(surfaceCounts) / sizeof(surfaceCounts[0]); i++) {
+        const int count = surfaceCounts[i];
+        //the driver also caps the pool by the CPU count, which hides the
+        //fan-out on small hosts, so the uncapped pool is measured as well
+        int uncappedWorkers = count / PREALLOCATE_SURFACES_PER_WORKER;
+        if (uncappedWorkers > PREALLOCATE_MAX_WORKERS) {
+            uncappedWorkers = PREALLOCATE_MAX_WORKERS;
+        }
+        int serialThreads, pooledThreads, uncappedThreads;
+        const double serial = runPreallocate(count, 0, &serialThreads);
+        const double pooled = runPreallocate(count, nvPreallocateWorkerCount(count), &pooledThreads);
+        const double uncapped = runPreallocate(count, uncappedWorkers, &uncappedThreads);
+        printf("%2d surfaces: serial %7.2f ms, pooled %7.2f ms (%d thread(s), %.2fx), uncapped %7.2f ms (%d thread(s), %.2fx)\n",
+               count, serial * 1e3, pooled * 1e3, pooledThreads, serial / pooled,
+               uncapped * 1e3, uncappedThreads, serial / uncapped);
+    }
+    return 0;
+}
@@ -0,0 +1,53 @@
+// Helpers shared by the tests and benchmarks under tests/.
+
+#ifndef TEST_COMMON_H
+#define TEST_COMMON_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+//failed checks beyond this many are counted but not printed
+#define TEST_MAX_REPORTED 10
+
+__attribute__((unused)) static int testFailures = 0;
+
+#define EXPECTF(cond, ...) do { \
+        if (!(cond) && testFailures++ < TEST_MAX_REPORTED) { \
+            fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__); \
+            fputc('\n', stderr); \
+        } \
+    } while (0)
+
+#define EXPECT(cond) EXPECTF(cond, "expected %s", #cond)
+
+// Prints how many of the checks described by what failed, and returns the
+// test's exit status.
+static inline int testResult(const char *what) {
+    if (testFailures > 0) {
+        fprintf(stderr, "%d %s failed\n", testFailures, what);
+        return 1;
+    }
+    return 0;
+}
+
+// xorshift32, so the tests see the same "random" input on every run.
+static inline uint32_t nextRandom(uint32_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static inline void benchStart(struct timespec *start) {
+    timespec_get(start, TIME_UTC);
+}
+
+static inline double elapsedSeconds(const struct timespec *start) {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (double) (now.tv_sec - start->tv_sec) + (double) (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+#endif // TEST_COMMON_H
@@ -0,0 +1,39 @@
+// Measures the throughput of the VP9 uncompressed header parser over a
+// repeating key, inter and intra-only frame sequence.
+
+#include "vp9-header.h"
+#include "vp9-header-samples.h"
+#include "test-common.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define BENCH_ITERATIONS 2000000
+
+int main(void) {
+    uint8_t headers[3][VP9_SAMPLE_MAX_SIZE];
+    const uint32_t sizes[3] = {
+        buildVP9KeyFrame(headers[0]),
+        buildVP9InterFrame(headers[1]),
+        buildVP9IntraOnlyFrame(headers[2]),
+    };
+    VP9HeaderState state;
+    memset(&state, 0, sizeof(state));
+    vp9SetupPastIndependence(&state);
+
+    uint64_t parsed = 0, bytes = 0;
+    struct timespec start;
+    benchStart(&start);
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        const int h = i % 3;
+        parsed += parseVP9UncompressedHeader(&state, headers[h], sizes[h]);
+        bytes += sizes[h];
+    }
+    const double seconds = elapsedSeconds(&start);
+    if (parsed != BENCH_ITERATIONS) {
+        fprintf(stderr, "only %llu of %d headers parsed\n", (unsigned long long) parsed, BENCH_ITERATIONS);
+        return 1;
+    }
+    printf("%8.2f Mheaders/s, %8.1f MB/s\n", BENCH_ITERATIONS / seconds / 1e6, (double) bytes / seconds / 1e6);
+    return 0;
+}
@@ -0,0 +1,180 @@
+// Hand-assembled VP9 uncompressed headers shared by the parser test and
+// benchmark. Each builder returns the header's length in bytes, the trailing
+// bits of the last byte are zero.
+
+#ifndef VP9_HEADER_SAMPLES_H
+#define VP9_HEADER_SAMPLES_H
+
+#include "vp9-header.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define VP9_SAMPLE_MAX_SIZE 64
+
+typedef struct {
+    uint8_t  *data;
+    uint32_t bitPos;
+} SampleBitWriter;
+
+static void sampleWriteBits(SampleBitWriter *bw, uint32_t value, int count) {
+    for (int i = count - 1; i >= 0; i--) {
+        if ((value >> i) & 1) {
+            bw->data[bw->bitPos >> 3] |= (uint8_t) (0x80 >> (bw->bitPos & 7));
+        }
+        bw->bitPos++;
+    }
+}
+
+//su(n): magnitude followed by the sign
+static void sampleWriteSigned(SampleBitWriter *bw, int value, int count) {
+    sampleWriteBits(bw, (uint32_t) (value < 0 ? -value : value), count);
+    sampleWriteBits(bw, value < 0, 1);
+}
+
+static uint32_t sampleFinish(SampleBitWriter *bw) {
+    return (bw->bitPos + 7) / 8;
+}
+
+// Profile 0 key frame: BT.709 limited range, loop filter ref delta 0 = 2 and
+// mode delta 0 = -5, base_q_idx 60 with delta_q_y_dc -3 and delta_q_uv_ac 2,
+// and absolute segment data where segment 1 has alt_q -10 and skip enabled.
+static uint32_t buildVP9KeyFrame(uint8_t *data) {
+    SampleBitWriter bw = { .data = data };
+    memset(data, 0, VP9_SAMPLE_MAX_SIZE);
+
+    sampleWriteBits(&bw, 2, 2);              //frame_marker
+    sampleWriteBits(&bw, 0, 2);              //profile
+    sampleWriteBits(&bw, 0, 1);              //show_existing_frame
+    sampleWriteBits(&bw, VP9_KEY_FRAME, 1);  //frame_type
+    sampleWriteBits(&bw, 1, 1);              //show_frame
+    sampleWriteBits(&bw, 0, 1);              //error_resilient_mode
+    sampleWriteBits(&bw, 0x498342, 24);      //frame_sync_code
+    sampleWriteBits(&bw, VP9_CS_BT_709, 3);  //color_space
+    sampleWriteBits(&bw, 0, 1);              //color_range
+    sampleWriteBits(&bw, 1919, 16);          //frame_width_minus_1
+    sampleWriteBits(&bw, 1079, 16);          //frame_height_minus_1
+    sampleWriteBits(&bw, 0, 1);              //render_and_frame_size_different
+    sampleWriteBits(&bw, 1, 1);              //refresh_frame_context
+    sampleWriteBits(&bw, 0, 1);              //frame_parallel_decoding_mode
+    sampleWriteBits(&bw, 0, 2);              //frame_context_idx
+
+    sampleWriteBits(&bw, 32, 6);             //loop_filter_level
+    sampleWriteBits(&bw, 3, 3);              //loop_filter_sharpness
+    sampleWriteBits(&bw, 1, 1);              //loop_filter_delta_enabled
+    sampleWriteBits(&bw, 1, 1);              //loop_filter_delta_update
+    sampleWriteBits(&bw, 1, 1);              //update_ref_delta[0]
+    sampleWriteSigned(&bw, 2, 6);
+    for (int i = 1; i < VP9_MAX_REF_FRAMES; i++) {
+        sampleWriteBits(&bw, 0, 1);
+    }
+    sampleWriteBits(&bw, 1, 1);              //update_mode_delta[0]
+    sampleWriteSigned(&bw, -5, 6);
+    sampleWriteBits(&bw, 0, 1);              //update_mode_delta[1]
+
+    sampleWriteBits(&bw, 60, 8);             //base_q_idx
+    sampleWriteBits(&bw, 1, 1);              //delta_q_y_dc
+    sampleWriteSigned(&bw, -3, 4);
+    sampleWriteBits(&bw, 0, 1);              //delta_q_uv_dc
+    sampleWriteBits(&bw, 1, 1);              //delta_q_uv_ac
+    sampleWriteSigned(&bw, 2, 4);
+
+    sampleWriteBits(&bw, 1, 1);              //segmentation_enabled
+    sampleWriteBits(&bw, 1, 1);              //segmentation_update_map
+    for (int i = 0; i < 7; i++) {
+        sampleWriteBits(&bw, i == 0, 1);     //tree_prob coded
+        if (i == 0) {
+            sampleWriteBits(&bw, 128, 8);
+        }
+    }
+    sampleWriteBits(&bw, 0, 1);              //segmentation_temporal_update
+    sampleWriteBits(&bw, 1, 1);              //segmentation_update_data
+    sampleWriteBits(&bw, 1, 1);              //segmentation_abs_or_delta_update
+    for (int i = 0; i < VP9_MAX_SEGMENTS; i++) {
+        for (int j = 0; j < VP9_SEG_LVL_MAX; j++) {
+            if (i == 1 && j == 0) {
+                sampleWriteBits(&bw, 1, 1);
+                sampleWriteSigned(&bw, -10, 8);
+            } else if (i == 1 && j == 3) {
+                sampleWriteBits(&bw, 1, 1);
+            } else {
+                sampleWriteBits(&bw, 0, 1);
+            }
+        }
+    }
+    return sampleFinish(&bw);
+}
+
+// Profile 0 inter frame that updates nothing but base_q_idx (40), so the loop
+// filter deltas and segment features of the previous frame carry over.
+static uint32_t buildVP9InterFrame(uint8_t *data) {
+    SampleBitWriter bw = { .data = data };
+    memset(data, 0, VP9_SAMPLE_MAX_SIZE);
+
+    sampleWriteBits(&bw, 2, 2);                  //frame_marker
+    sampleWriteBits(&bw, 0, 2);                  //profile
+    sampleWriteBits(&bw, 0, 1);                  //show_existing_frame
+    sampleWriteBits(&bw, VP9_NON_KEY_FRAME, 1);  //frame_type
+    sampleWriteBits(&bw, 1, 1);                  //show_frame
+    sampleWriteBits(&bw, 0, 1);                  //error_resilient_mode
+    sampleWriteBits(&bw, 0, 2);                  //reset_frame_context
+    sampleWriteBits(&bw, 0x01, 8);               //refresh_frame_flags
+    for (int i = 0; i < VP9_REFS_PER_FRAME; i++) {
+        sampleWriteBits(&bw, i, 3);              //ref_frame_idx
+        sampleWriteBits(&bw, 0, 1);              //ref_frame_sign_bias
+    }
+    sampleWriteBits(&bw, 1, 1);                  //found_ref
+    sampleWriteBits(&bw, 0, 1);                  //render_and_frame_size_different
+    sampleWriteBits(&bw, 1, 1);                  //allow_high_precision_mv
+    sampleWriteBits(&bw, 1, 1);                  //is_filter_switchable
+    sampleWriteBits(&bw, 1, 1);                  //refresh_frame_context
+    sampleWriteBits(&bw, 0, 1);                  //frame_parallel_decoding_mode
+    sampleWriteBits(&bw, 1, 2);                  //frame_context_idx
+
+    sampleWriteBits(&bw, 20, 6);                 //loop_filter_level
+    sampleWriteBits(&bw, 0, 3);                  //loop_filter_sharpness
+    sampleWriteBits(&bw, 1, 1);                  //loop_filter_delta_enabled
+    sampleWriteBits(&bw, 0, 1);                  //loop_filter_delta_update
+
+    sampleWriteBits(&bw, 40, 8);                 //base_q_idx
+    sampleWriteBits(&bw, 0, 3);                  //delta_q_y_dc, delta_q_uv_dc, delta_q_uv_ac
+
+    sampleWriteBits(&bw, 0, 1);                  //segmentation_enabled
+    return sampleFinish(&bw);
+}
+
+// Profile 0 intra-only frame, which resets to BT.601 limited range and to the
+// default loop filter deltas and segment features.
+static uint32_t buildVP9IntraOnlyFrame(uint8_t *data) {
+    SampleBitWriter bw = { .data = data };
+    memset(data, 0, VP9_SAMPLE_MAX_SIZE);
+
+    sampleWriteBits(&bw, 2, 2);                  //frame_marker
+    sampleWriteBits(&bw, 0, 2);                  //profile
+    sampleWriteBits(&bw, 0, 1);                  //show_existing_frame
+    sampleWriteBits(&bw, VP9_NON_KEY_FRAME, 1);  //frame_type
+    sampleWriteBits(&bw, 0, 1);                  //show_frame
+    sampleWriteBits(&bw, 0, 1);                  //error_resilient_mode
+    sampleWriteBits(&bw, 1, 1);                  //intra_only
+    sampleWriteBits(&bw, 0, 2);                  //reset_frame_context
+    sampleWriteBits(&bw, 0x498342, 24);          //frame_sync_code
+    sampleWriteBits(&bw, 0xff, 8);               //refresh_frame_flags
+    sampleWriteBits(&bw, 639, 16);               //frame_width_minus_1
+    sampleWriteBits(&bw, 359, 16);               //frame_height_minus_1
+    sampleWriteBits(&bw, 0, 1);                  //render_and_frame_size_different
+    sampleWriteBits(&bw, 0, 1);                  //refresh_frame_context
+    sampleWriteBits(&bw, 0, 1);                  //frame_parallel_decoding_mode
+    sampleWriteBits(&bw, 0, 2);                  //frame_context_idx
+
+    sampleWriteBits(&bw, 10, 6);                 //loop_filter_level
+    sampleWriteBits(&bw, 0, 3);                  //loop_filter_sharpness
+    sampleWriteBits(&bw, 0, 1);                  //loop_filter_delta_enabled
+
+    sampleWriteBits(&bw, 100, 8);                //base_q_idx
+    sampleWriteBits(&bw, 0, 3);                  //delta_q_y_dc, delta_q_uv_dc, delta_q_uv_ac
+
+    sampleWriteBits(&bw, 0, 1);                  //segmentation_enabled
+    return sampleFinish(&bw);
+}
+
+#endif // VP9_HEADER_SAMPLES_H
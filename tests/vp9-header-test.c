@@ -0,0 +1,151 @@
+// Checks the VP9 uncompressed header parser against hand-assembled key,
+// inter and intra-only frames, and feeds it truncated and randomly corrupted
+// headers, which must either parse or leave the carried-over state untouched.
+
+#include "vp9-header.h"
+#include "vp9-header-samples.h"
+#include "test-common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void initState(VP9HeaderState *state) {
+    memset(state, 0, sizeof(*state));
+    vp9SetupPastIndependence(state);
+}
+
+static void testKnownHeaders(void) {
+    uint8_t data[VP9_SAMPLE_MAX_SIZE];
+    VP9HeaderState state;
+    initState(&state);
+
+    uint32_t size = buildVP9KeyFrame(data);
+    EXPECT(parseVP9UncompressedHeader(&state, data, size));
+    EXPECT(state.colorSpace == VP9_CS_BT_709);
+    EXPECT(!state.colorRangeFull);
+    EXPECT(state.lfModeRefDeltaEnabled);
+    EXPECT(state.lfRefDeltas[0] == 2 && state.lfRefDeltas[1] == 0);
+    EXPECT(state.lfRefDeltas[2] == -1 && state.lfRefDeltas[3] == -1);
+    EXPECT(state.lfModeDeltas[0] == -5 && state.lfModeDeltas[1] == 0);
+    EXPECT(state.baseQIdx == 60);
+    EXPECT(state.deltaQYDc == -3 && state.deltaQUvDc == 0 && state.deltaQUvAc == 2);
+    EXPECT(state.segmentationAbsDelta);
+    EXPECT(state.segmentFeatureEnabled[1][0] && state.segmentFeatureData[1][0] == -10);
+    EXPECT(state.segmentFeatureEnabled[1][3] && state.segmentFeatureData[1][3] == 0);
+    EXPECT(!state.segmentFeatureEnabled[0][0] && !state.segmentFeatureEnabled[1][1]);
+
+    size = buildVP9InterFrame(data);
+    EXPECT(parseVP9UncompressedHeader(&state, data, size));
+    EXPECT(state.colorSpace == VP9_CS_BT_709);
+    EXPECT(state.lfModeRefDeltaEnabled);
+    EXPECT(state.lfRefDeltas[0] == 2 && state.lfModeDeltas[0] == -5);
+    EXPECT(state.baseQIdx == 40);
+    EXPECT(state.deltaQYDc == 0 && state.deltaQUvAc == 0);
+    EXPECT(state.segmentationAbsDelta);
+    EXPECT(state.segmentFeatureEnabled[1][0] && state.segmentFeatureData[1][0] == -10);
+
+    size = buildVP9IntraOnlyFrame(data);
+    EXPECT(parseVP9UncompressedHeader(&state, data, size));
+    EXPECT(state.colorSpace == VP9_CS_BT_601);
+    EXPECT(!state.colorRangeFull);
+    EXPECT(!state.lfModeRefDeltaEnabled);
+    EXPECT(state.lfRefDeltas[0] == 1 && state.lfModeDeltas[0] == 0);
+    EXPECT(state.baseQIdx == 100);
+    EXPECT(!state.segmentationAbsDelta);
+    EXPECT(!state.segmentFeatureEnabled[1][0] && state.segmentFeatureData[1][0] == 0);
+
+    //show_existing_frame carries nothing to decode
+    VP9HeaderState before = state;
+    const uint8_t showExisting[] = { 0x88 };
+    EXPECT(!parseVP9UncompressedHeader(&state, showExisting, sizeof(showExisting)));
+    EXPECT(memcmp(&before, &state, sizeof(state)) == 0);
+
+    //a key frame with a broken sync code
+    size = buildVP9KeyFrame(data);
+    data[2] ^= 0x10;
+    EXPECT(!parseVP9UncompressedHeader(&state, data, size));
+    EXPECT(memcmp(&before, &state, sizeof(state)) == 0);
+}
+
+static void testTruncation(void) {
+    static uint32_t (*const builders[])(uint8_t*) = { buildVP9KeyFrame, buildVP9InterFrame, buildVP9IntraOnlyFrame };
+    uint8_t data[VP9_SAMPLE_MAX_SIZE];
+    VP9HeaderState state, before;
+
+    for (size_t b = 0; b < sizeof(builders) / sizeof(builders[0]); b++) {
+        const uint32_t size = builders[b](data);
+        //the inter frame depends on what the key frame left behind
+        initState(&state);
+        uint8_t key[VP9_SAMPLE_MAX_SIZE];
+        EXPECT(parseVP9UncompressedHeader(&state, key, buildVP9KeyFrame(key)));
+
+        for (uint32_t length = 0; length < size; length++) {
+            //copy the prefix so reads past it land outside the allocation
+            uint8_t *prefix = malloc(length > 0 ? length : 1);
+            memcpy(prefix, data, length);
+            before = state;
+            EXPECT(!parseVP9UncompressedHeader(&state, prefix, length));
+            EXPECT(memcmp(&before, &state, sizeof(state)) == 0);
+            free(prefix);
+        }
+        EXPECT(parseVP9UncompressedHeader(&state, data, size));
+    }
+}
+
+static void testRandomBits(void) {
+    static uint32_t (*const builders[])(uint8_t*) = { buildVP9KeyFrame, buildVP9InterFrame, buildVP9IntraOnlyFrame };
+    uint8_t data[VP9_SAMPLE_MAX_SIZE];
+    uint32_t random = 0x9e3779b9;
+    VP9HeaderState state, before;
+    initState(&state);
+
+    for (int iteration = 0; iteration < 100000; iteration++) {
+        uint32_t size;
+        if (iteration & 1) {
+            //a valid header with a few bits flipped
+            size = builders[nextRandom(&random) % 3](data);
+            const int flips = 1 + nextRandom(&random) % 4;
+            for (int i = 0; i < flips; i++) {
+                const uint32_t bit = nextRandom(&random) % (size * 8);
+                data[bit >> 3] ^= (uint8_t) (0x80 >> (bit & 7));
+            }
+        } else {
+            //pure noise, mostly with a valid frame marker so parsing gets further
+            size = nextRandom(&random) % (VP9_SAMPLE_MAX_SIZE + 1);
+            for (uint32_t i = 0; i < size; i++) {
+                data[i] = (uint8_t) nextRandom(&random);
+            }
+            if (size > 0 && (iteration & 2)) {
+                data[0] = (uint8_t) ((data[0] & 0x3f) | 0x80);
+            }
+        }
+
+        uint8_t *copy = malloc(size > 0 ? size : 1);
+        memcpy(copy, data, size);
+        before = state;
+        if (parseVP9UncompressedHeader(&state, copy, size)) {
+            EXPECT(state.colorSpace <= VP9_CS_SRGB);
+            for (int i = 0; i < VP9_MAX_SEGMENTS; i++) {
+                EXPECT(state.segmentFeatureData[i][0] >= -255 && state.segmentFeatureData[i][0] <= 255);
+                EXPECT(state.segmentFeatureData[i][1] >= -63 && state.segmentFeatureData[i][1] <= 63);
+                EXPECT(state.segmentFeatureData[i][2] >= 0 && state.segmentFeatureData[i][2] <= 3);
+            }
+        } else {
+            EXPECT(memcmp(&before, &state, sizeof(state)) == 0);
+        }
+        free(copy);
+
+        if (testFailures > TEST_MAX_REPORTED) {
+            return;
+        }
+    }
+}
+
+int main(void) {
+    testKnownHeaders();
+    testTruncation();
+    testRandomBits();
+
+    return testResult("VP9 header checks");
+}